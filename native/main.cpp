@@ -5,6 +5,7 @@
 #include "test_admin_rbac.h"
 #include "test_cache_cleanup.h"
 #include "test_canister_functions.h"
+#include "test_chat_log.h"
 #include "test_cycle_balance.h"
 #include "test_files.h"
 #include "test_memory_status.h"
@@ -34,6 +35,7 @@ int main() {
   test_admin_rbac(mockIC);
   test_cache_cleanup(mockIC);
   test_canister_functions(mockIC);
+  test_chat_log(mockIC);
   test_cycle_balance(mockIC);
   test_memory_status(mockIC);
   test_files(mockIC);
@@ -19,8 +19,10 @@
 // file_clock domain.
 
 #include "test_cache_cleanup.h"
+#include "test_helpers.h"
 
 #include "../src/cache_cleanup.h"
+#include "../src/cache_index.h"
 #include "../src/upload.h"
 
 #include "ic_timers.h"
@@ -72,25 +74,22 @@ bool create_test_file(const std::filesystem::path &path,
               << '\n';
     return false;
   }
+  // Written behind the canister's back: report it to the cache index
+  cache_index_note_write(path.string());
   return true;
 }
 
-// Wipe the test_principal dir between scenarios so each starts clean.
-void clear_test_dir() {
+// Create a file of `size` bytes at `path`, fresh
+bool create_sized_test_file(const std::filesystem::path &path, size_t size) {
   std::error_code ec;
-  std::filesystem::remove_all(
-      std::filesystem::path(".canister_cache") / TEST_PRINCIPAL_DIR, ec);
+  std::filesystem::create_directories(path.parent_path(), ec);
+  std::ofstream(path, std::ios::binary) << std::string(size, 'x');
+  cache_index_note_write(path.string());
+  return std::filesystem::exists(path, ec);
 }
 
-int expect_eq_u64(const char *label, uint64_t actual, uint64_t expected) {
-  if (actual != expected) {
-    std::cout << "FAIL: " << label << " expected " << expected << ", got "
-              << actual << '\n';
-    return 1;
-  }
-  std::cout << "PASS: " << label << " == " << actual << '\n';
-  return 0;
-}
+// Wipe the test_principal dir between scenarios so each starts clean.
+void clear_test_dir() { clear_test_principal_dir(TEST_PRINCIPAL_DIR); }
 
 int expect_file_exists(const char *label, const std::filesystem::path &p,
                        bool expected) {
@@ -135,6 +134,7 @@ void test_cache_cleanup(MockIC &mockIC) {
   {
     std::error_code ec;
     std::filesystem::remove_all(".canister_cache", ec);
+    cache_index_reset();
   }
 
   // -----------------------------------------------------------------------
@@ -291,6 +291,178 @@ void test_cache_cleanup(MockIC &mockIC) {
     g_cleanup_ttl_ns = saved_ttl;
   }
 
+  // -----------------------------------------------------------------------
+  // Scenario 4d: The resume cursor reaches stale files behind fresh ones.
+  // 6 fresh files sort before 4 stale ones; with cap=3 a tick that restarts
+  // from the top would never get past the fresh files. Resuming from the
+  // cursor, ceil(10 / 3) = 4 ticks complete one sweep and delete all 4.
+  // The cursor and sweep progress read back from the saved file.
+  // -----------------------------------------------------------------------
+  clear_test_dir();
+  {
+    auto fresh = file_clock::now() - hours{1};
+    auto stale = file_clock::now() - hours{7};
+    for (int i = 0; i < 6; ++i) {
+      create_test_file(session_path("a_fresh_" + std::to_string(i) + ".cache"),
+                       fresh);
+    }
+    for (int i = 0; i < 4; ++i) {
+      create_test_file(session_path("z_stale_" + std::to_string(i) + ".cache"),
+                       stale);
+    }
+
+    uint64_t saved_cap = g_cleanup_max_files_per_run;
+    g_cleanup_max_files_per_run = 3;
+    // Start a fresh sweep at the top of the index
+    g_cleanup_cursor.clear();
+    g_cleanup_sweep_runs = 0;
+    g_cleanup_sweep_files_examined = 0;
+    g_cleanup_sweep_files_deleted = 0;
+    uint64_t sweeps_before = g_cleanup_sweeps_completed;
+
+    for (int tick = 0; tick < 3; ++tick) {
+      run_cache_cleanup_body();
+    }
+    extra_failures += expect_eq_u64("[cursor] sweep not complete after 3 ticks",
+                                    g_cleanup_sweeps_completed - sweeps_before,
+                                    0);
+    extra_failures += expect_eq_u64("[cursor] sweep_files_examined after 3",
+                                    g_cleanup_sweep_files_examined, 9);
+
+    run_cache_cleanup_body();
+    extra_failures += expect_eq_u64("[cursor] one sweep completed in 4 ticks",
+                                    g_cleanup_sweeps_completed - sweeps_before,
+                                    1);
+    extra_failures += expect_eq_u64("[cursor] last_sweep_runs",
+                                    g_cleanup_last_sweep_runs, 4);
+    extra_failures += expect_eq_u64("[cursor] last_sweep_files_examined",
+                                    g_cleanup_last_sweep_files_examined, 10);
+    extra_failures += expect_eq_u64("[cursor] last_sweep_files_deleted",
+                                    g_cleanup_last_sweep_files_deleted, 4);
+    // The 4th tick spends its leftover cap on the next sweep
+    extra_failures += expect_eq_u64("[cursor] 4th tick still examines cap",
+                                    g_cleanup_files_examined, 3);
+    extra_failures += expect_eq_u64("[cursor] next sweep already started",
+                                    g_cleanup_sweep_files_examined, 2);
+    for (int i = 0; i < 4; ++i) {
+      extra_failures += expect_file_exists(
+          "[cursor] stale file behind the fresh ones deleted",
+          session_path("z_stale_" + std::to_string(i) + ".cache"), false);
+    }
+
+    // As after an upgrade: the saved cursor wins over the heap
+    const std::string cursor = g_cleanup_cursor;
+    const uint64_t sweeps = g_cleanup_sweeps_completed;
+    g_cleanup_cursor = "lost";
+    g_cleanup_sweeps_completed = 0;
+    extra_failures += expect_eq_u64("[cursor] saved cursor loads",
+                                    load_cache_cleanup_cursor() ? 1 : 0, 1);
+    extra_failures += expect_eq_u64("[cursor] saved cursor restored",
+                                    g_cleanup_cursor == cursor ? 1 : 0, 1);
+    extra_failures += expect_eq_u64("[cursor] saved sweeps_completed restored",
+                                    g_cleanup_sweeps_completed, sweeps);
+
+    g_cleanup_max_files_per_run = saved_cap;
+  }
+
+  // -----------------------------------------------------------------------
+  // Scenario 4e: Byte quotas evict the least recently used caches. Three
+  // fresh 100-byte caches (one with a stamp); the oldest one is loaded again,
+  // so it is the most recently used. A per-principal quota of 150 bytes keeps
+  // only that one, and its stamp. Then a global quota below it evicts it too.
+  // -----------------------------------------------------------------------
+  clear_test_dir();
+  {
+    // Build the index first, so that the writes and the access are noted
+    (void)cache_index();
+    create_sized_test_file(session_path("lru_1.cache"), 100);
+    create_sized_test_file(session_path("lru_1.cache.icppfmt"), 10);
+    create_sized_test_file(session_path("lru_2.cache"), 100);
+    create_sized_test_file(session_path("lru_3.cache"), 100);
+    cache_index_note_access(session_path("lru_1.cache").string());
+
+    extra_failures += expect_eq_u64(
+        "[quota] principal bytes",
+        cache_index_bytes(TEST_PRINCIPAL_DIR, "sessions"), 310);
+
+    g_cleanup_max_bytes_per_principal = 150;
+    run_cache_cleanup_body();
+
+    extra_failures += expect_eq_u64("[quota] files_evicted (last run)",
+                                    g_cleanup_files_evicted, 2);
+    extra_failures += expect_eq_u64("[quota] bytes_evicted (last run)",
+                                    g_cleanup_bytes_evicted, 200);
+    extra_failures += expect_eq_u64(
+        "[quota] principal bytes within quota",
+        cache_index_bytes(TEST_PRINCIPAL_DIR, "sessions"), 110);
+    extra_failures +=
+        expect_file_exists("[quota] recently used cache kept",
+                           session_path("lru_1.cache"), true);
+    extra_failures +=
+        expect_file_exists("[quota] its stamp kept",
+                           session_path("lru_1.cache.icppfmt"), true);
+    extra_failures +=
+        expect_file_exists("[quota] least recently used cache evicted",
+                           session_path("lru_2.cache"), false);
+    extra_failures += expect_file_exists("[quota] next one evicted",
+                                         session_path("lru_3.cache"), false);
+
+    g_cleanup_max_bytes_per_principal = 0;
+    g_cleanup_max_bytes_total = 50;
+    run_cache_cleanup_body();
+
+    extra_failures += expect_eq_u64("[quota] global: files_evicted (last run)",
+                                    g_cleanup_files_evicted, 1);
+    extra_failures +=
+        expect_file_exists("[quota] global: cache evicted",
+                           session_path("lru_1.cache"), false);
+    extra_failures +=
+        expect_file_exists("[quota] global: its stamp went with it",
+                           session_path("lru_1.cache.icppfmt"), false);
+
+    // No quotas: nothing is evicted
+    g_cleanup_max_bytes_total = 0;
+    create_sized_test_file(session_path("lru_4.cache"), 100);
+    run_cache_cleanup_body();
+    extra_failures += expect_eq_u64("[quota] off: files_evicted (last run)",
+                                    g_cleanup_files_evicted, 0);
+
+    // More session files than the cap: the TTL scan examines only the cap,
+    // and the quota is still enforced, with up to the cap in evictions
+    const uint64_t saved_cap = g_cleanup_max_files_per_run;
+    for (int i = 5; i <= 8; ++i) {
+      create_sized_test_file(
+          session_path("lru_" + std::to_string(i) + ".cache"), 100);
+    }
+    g_cleanup_max_files_per_run = 3;
+    g_cleanup_max_bytes_per_principal = 250;
+    run_cache_cleanup_body();
+    extra_failures += expect_eq_u64("[quota] cap: files_examined (last run)",
+                                    g_cleanup_files_examined, 3);
+    extra_failures += expect_eq_u64("[quota] cap: files_evicted (last run)",
+                                    g_cleanup_files_evicted, 3);
+    extra_failures += expect_eq_u64(
+        "[quota] cap: principal bytes within quota",
+        cache_index_bytes(TEST_PRINCIPAL_DIR, "sessions"), 200);
+
+    // The quotas are saved with the cursor, so an upgrade keeps them
+    g_cleanup_max_bytes_total = 7777;
+    run_cache_cleanup_body();
+    g_cleanup_max_bytes_total = 0;
+    g_cleanup_max_bytes_per_principal = 0;
+    (void)load_cache_cleanup_cursor();
+    extra_failures += expect_eq_u64("[quota] restored: max_bytes_total",
+                                    g_cleanup_max_bytes_total, 7777);
+    extra_failures +=
+        expect_eq_u64("[quota] restored: max_bytes_per_principal",
+                      g_cleanup_max_bytes_per_principal, 250);
+
+    g_cleanup_max_bytes_total = 0;
+    g_cleanup_max_bytes_per_principal = 0;
+    run_cache_cleanup_body(); // saves the quotas as off
+    g_cleanup_max_files_per_run = saved_cap;
+  }
+
   // -----------------------------------------------------------------------
   // Scenario 4c: Recurring timer actually fires the cleanup body after the
   // configured period elapses, driven through IcTimers::dispatch_due. We
@@ -407,6 +579,10 @@ void test_cache_cleanup(MockIC &mockIC) {
                     set_cache_cleanup_config, EMPTY_INPUT,
                     ACCESS_DENIED_API_ERROR, silent_on_trap,
                     anonymous_principal);
+    mockIC.run_test("set_cache_quota_config (anon denied)",
+                    set_cache_quota_config, EMPTY_INPUT,
+                    ACCESS_DENIED_API_ERROR, silent_on_trap,
+                    anonymous_principal);
 
     extra_failures += expect_eq_u64("[anon-denied] no cleanup runs occurred",
                                     g_cleanup_runs - runs_before, 0);
@@ -419,15 +595,6 @@ void test_cache_cleanup(MockIC &mockIC) {
   clear_test_dir();
   IC_API::cancel_all_timers();
 
-  std::cout << "test_cache_cleanup extra_failures: " << extra_failures
-            << "\n========================================\n\n";
-  if (extra_failures > 0) {
-    // Surface the failure count via mockIC's pass/fail summary by running a
-    // synthetic failing test. (mockIC.test_summary() returns 1 if any
-    // run_test failed; the extra_failures don't go through run_test.)
-    mockIC.run_test(
-        "test_cache_cleanup: extra_failures detected (see PASS/FAIL log above)",
-        cache_cleanup_now, EMPTY_INPUT, "DELIBERATE_FAIL_TO_RAISE_ALARM",
-        silent_on_trap, controller_principal);
-  }
+  report_extra_failures(mockIC, "test_cache_cleanup", extra_failures,
+                        cache_cleanup_now);
 }
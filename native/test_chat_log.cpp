@@ -0,0 +1,193 @@
+// Native tests for the append-only chat log behind db_chats.
+//
+// Strategy:
+//   - Call the chat_log_* functions directly, under a fixed test principal
+//     (`.canister_cache/chat_log_test_principal/db_chats/`), and read the
+//     chats back through chat_log_chats / chat_log_read.
+//   - chat_log_reset() forgets the heap index, as an upgrade does, so every
+//     check after it proves the index is rebuilt from the log alone.
+
+#include "test_chat_log.h"
+#include "test_helpers.h"
+
+#include "../src/cache_index.h"
+#include "../src/chat_log.h"
+#include "../src/db_chats.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr const char *TEST_PRINCIPAL = "chat_log_test_principal";
+
+std::filesystem::path chats_dir() {
+  return std::filesystem::path(".canister_cache") / TEST_PRINCIPAL /
+         "db_chats";
+}
+
+void clear_test_dir() {
+  clear_test_principal_dir(TEST_PRINCIPAL);
+  chat_log_reset();
+}
+
+// What an upgrade wipes: the heap indexes, not the files
+void clear_heap_state() {
+  cache_index_reset();
+  chat_log_reset();
+}
+
+int expect_eq_str(const char *label, const std::string &actual,
+                  const std::string &expected) {
+  if (actual != expected) {
+    std::cout << "FAIL: " << label << " expected \"" << expected
+              << "\", got \"" << actual << "\"\n";
+    return 1;
+  }
+  std::cout << "PASS: " << label << '\n';
+  return 0;
+}
+
+// The content of the i-th live chat, "" if it can not be read
+std::string chat_content(size_t i) {
+  std::vector<ChatLogChat> chats;
+  std::string content, error_msg;
+  if (!chat_log_chats(TEST_PRINCIPAL, chats, error_msg) || i >= chats.size() ||
+      !chat_log_read(TEST_PRINCIPAL, chats[i], content, error_msg)) {
+    return "";
+  }
+  return content;
+}
+
+uint64_t chat_count() {
+  std::vector<ChatLogChat> chats;
+  std::string error_msg;
+  if (!chat_log_chats(TEST_PRINCIPAL, chats, error_msg)) return 0;
+  return chats.size();
+}
+
+} // namespace
+
+void test_chat_log(MockIC &mockIC) {
+  int extra_failures = 0;
+  std::string error_msg;
+
+  std::cout << "\n========== test_chat_log ==========\n";
+
+  // -----------------------------------------------------------------------
+  // Scenario 1: A turn appends only what the conversation grew by.
+  // -----------------------------------------------------------------------
+  clear_test_dir();
+  {
+    chat_log_new(TEST_PRINCIPAL, "2025-01-01_00-00-00", error_msg);
+    chat_log_save(TEST_PRINCIPAL, "user: hi\n", error_msg);
+    chat_log_save(TEST_PRINCIPAL, "user: hi\nassistant: hello\n", error_msg);
+    const uint64_t log_size =
+        std::filesystem::file_size(chats_dir() / "chats.log");
+    // The same conversation again: nothing to append
+    chat_log_save(TEST_PRINCIPAL, "user: hi\nassistant: hello\n", error_msg);
+
+    std::vector<ChatLogChat> chats;
+    chat_log_chats(TEST_PRINCIPAL, chats, error_msg);
+    extra_failures += expect_eq_u64("[append] one chat", chats.size(), 1);
+    extra_failures += expect_eq_u64("[append] two pieces, one per turn",
+                                    chats.empty() ? 0 : chats[0].ranges.size(),
+                                    2);
+    extra_failures += expect_eq_str("[append] content", chat_content(0),
+                                    "user: hi\nassistant: hello\n");
+    extra_failures += expect_eq_u64(
+        "[append] unchanged conversation writes nothing",
+        std::filesystem::file_size(chats_dir() / "chats.log"), log_size);
+
+    // A conversation that does not continue the saved one replaces it
+    chat_log_save(TEST_PRINCIPAL, "user: something else\n", error_msg);
+    extra_failures += expect_eq_str("[set] content replaced", chat_content(0),
+                                    "user: something else\n");
+
+    chat_log_reset();
+    extra_failures += expect_eq_str("[reload] content after index rebuild",
+                                    chat_content(0), "user: something else\n");
+  }
+
+  // -----------------------------------------------------------------------
+  // Scenario 2: Only the latest max_chats are kept, the latest chat is the one
+  // saved to, and deleted chats are compacted away.
+  // -----------------------------------------------------------------------
+  clear_test_dir();
+  {
+    const std::string turn(32 * 1024, 'x');
+    for (int i = 0; i < 10; ++i) {
+      chat_log_new(TEST_PRINCIPAL, "chat_" + std::to_string(i), error_msg);
+      chat_log_save(TEST_PRINCIPAL, turn + std::to_string(i), error_msg);
+      chat_log_keep_latest(TEST_PRINCIPAL, 3, error_msg);
+    }
+    extra_failures += expect_eq_u64("[keep] three chats", chat_count(), 3);
+    extra_failures += expect_eq_str("[keep] latest chat saved to",
+                                    chat_content(2), turn + "9");
+    extra_failures += expect_eq_u64(
+        "[compact] deleted chats do not pile up in the log",
+        std::filesystem::file_size(chats_dir() / "chats.log") < 7 * turn.size()
+            ? 1
+            : 0,
+        1);
+
+    chat_log_reset();
+    extra_failures += expect_eq_u64("[compact] three chats after rebuild",
+                                    chat_count(), 3);
+    extra_failures += expect_eq_str("[compact] oldest kept chat after rebuild",
+                                    chat_content(0), turn + "7");
+  }
+
+  // -----------------------------------------------------------------------
+  // Scenario 3: A chat file of the one-file-per-chat layout is imported.
+  // -----------------------------------------------------------------------
+  clear_test_dir();
+  {
+    std::filesystem::create_directories(chats_dir());
+    {
+      std::ofstream ofs(chats_dir() / "2024-12-31_23-59-59");
+      ofs << TEST_PRINCIPAL << std::endl << "user: legacy\n";
+    }
+
+    // Right after the upgrade, a query (get_chats) still returns it, read
+    // from the legacy file, which it leaves alone: its writes are rolled back
+    clear_heap_state();
+    std::vector<ChatLogChat> chats;
+    std::string content;
+    chat_log_chats(TEST_PRINCIPAL, chats, error_msg, false);
+    extra_failures += expect_eq_u64("[legacy] listed by a query",
+                                    chats.size(), 1);
+    if (!chats.empty()) {
+      chat_log_read(TEST_PRINCIPAL, chats[0], content, error_msg);
+    }
+    extra_failures += expect_eq_str("[legacy] content read by a query",
+                                    content, "user: legacy\n");
+    extra_failures += expect_eq_u64(
+        "[legacy] file kept by a query",
+        std::filesystem::exists(chats_dir() / "2024-12-31_23-59-59") ? 1 : 0,
+        1);
+
+    chat_log_new(TEST_PRINCIPAL, "2025-01-01_00-00-00", error_msg);
+
+    chat_log_chats(TEST_PRINCIPAL, chats, error_msg);
+    extra_failures += expect_eq_u64("[legacy] imported + new", chats.size(), 2);
+    extra_failures +=
+        expect_eq_str("[legacy] timestamp from the file name",
+                      chats.empty() ? "" : chats[0].timestamp,
+                      "2024-12-31_23-59-59");
+    extra_failures += expect_eq_str("[legacy] content", chat_content(0),
+                                    "user: legacy\n");
+    extra_failures += expect_eq_u64(
+        "[legacy] file removed",
+        std::filesystem::exists(chats_dir() / "2024-12-31_23-59-59") ? 1 : 0,
+        0);
+  }
+
+  clear_test_dir();
+
+  report_extra_failures(mockIC, "test_chat_log", extra_failures, get_chats);
+}
@@ -0,0 +1,3 @@
+#pragma once
+#include "mock_ic.h"
+void test_chat_log(MockIC &mockIC);
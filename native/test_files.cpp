@@ -8,15 +8,18 @@
 #include "../src/files.h"
 #include "../src/health.h"
 #include "../src/logs.h"
+#include "../src/lz4.h"
 #include "../src/model.h"
 #include "../src/promptcache.h"
 #include "../src/ready.h"
 #include "../src/run.h"
 #include "../src/upload.h"
+#include "../src/utils.h"
 #include "../src/whoami.h"
 
 // The Mock IC
 #include "mock_ic.h"
+#include "test_helpers.h"
 
 // Helper function to create directory and write random binary file
 bool create_random_binary_file(const std::filesystem::path &directory,
@@ -358,6 +361,48 @@ void test_files(MockIC &mockIC) {
       "4449444c026b01b0ad8fcd0c716b01c5fed20100010100003d66696c655f646f776e6c6f61645f6368756e6b5f3a206368756e6b73697a6520333134353732382065786365656473206c696d69742032303937313532",
       silent_on_trap, my_principal);
 
+  // -----------------------------------------------------------------------------
+  // download_prompt_cache_chunk_lz4 test: chunksize exceeds MAX_LZ4_CHUNK_SIZE
+  // '(record { promptcache = "prompt.cache"; chunksize = 2087925 : nat64; offset = 0 : nat64 })'
+  // -> '(variant { Err = variant { Other = "download_prompt_cache_chunk_lz4: chunksize 2087925 exceeds limit 2087924" } })'
+  mockIC.run_test(
+      std::string(__func__) + ": " +
+          "download_prompt_cache_chunk_lz4 - chunksize exceeds MAX_LZ4_CHUNK_SIZE",
+      download_prompt_cache_chunk_lz4,
+      "4449444c016c0393affe8106789eacf7bb0a71aec3faa40b78010000000000000000000c70726f6d70742e6361636865f5db1f0000000000",
+      "4449444c026b01b0ad8fcd0c716b01c5fed201000101000048646f776e6c6f61645f70726f6d70745f63616368655f6368756e6b5f6c7a343a206368756e6b73697a6520323038373932352065786365656473206c696d69742032303837393234",
+      silent_on_trap, my_principal);
+
+  // -----------------------------------------------------------------------------
+  // A random (incompressible) chunk of MAX_LZ4_CHUNK_SIZE bytes is LZ4's worst
+  // case: it must still leave room for the rest of the reply within the
+  // message limit, and come back unchanged
+  {
+    int extra_failures = 0;
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> chunk(MAX_LZ4_CHUNK_SIZE);
+    for (auto &b : chunk) b = static_cast<uint8_t>(dist(gen));
+
+    std::vector<uint8_t> compressed;
+    lz4_compress_block(chunk.data(), chunk.size(), compressed);
+    extra_failures += expect_eq_u64(
+        "[lz4] random chunk fits the reply",
+        compressed.size() + 1024 <= MAX_CHUNK_SIZE, 1);
+
+    std::vector<uint8_t> decompressed;
+    std::string error_msg;
+    bool ok = lz4_decompress_block(compressed.data(), compressed.size(),
+                                   chunk.size(), decompressed, error_msg);
+    extra_failures += expect_eq_u64("[lz4] random chunk decompresses", ok, 1);
+    extra_failures += expect_eq_u64("[lz4] random chunk round-trips",
+                                    decompressed == chunk, 1);
+
+    report_extra_failures(mockIC, std::string(__func__) + ": lz4 worst case",
+                          extra_failures, download_prompt_cache_chunk_lz4);
+  }
+
   // -----------------------------------------------------------------------------
   // Remove the test files created for testing
   delete_directory(top_directory);
@@ -0,0 +1,38 @@
+#include "test_helpers.h"
+
+#include "../src/cache_index.h"
+
+#include <filesystem>
+#include <iostream>
+
+int expect_eq_u64(const char *label, uint64_t actual, uint64_t expected) {
+  if (actual != expected) {
+    std::cout << "FAIL: " << label << " expected " << expected << ", got "
+              << actual << '\n';
+    return 1;
+  }
+  std::cout << "PASS: " << label << " == " << actual << '\n';
+  return 0;
+}
+
+void clear_test_principal_dir(const std::string &principal_dir) {
+  std::error_code ec;
+  std::filesystem::remove_all(
+      std::filesystem::path(".canister_cache") / principal_dir, ec);
+  cache_index_reset();
+}
+
+void report_extra_failures(MockIC &mockIC, const std::string &test_name,
+                           int extra_failures, void (*endpoint)()) {
+  std::cout << test_name << " extra_failures: " << extra_failures
+            << "\n========================================\n\n";
+  if (extra_failures > 0) {
+    // didc encode '()'
+    const std::string EMPTY_INPUT = "4449444c0000";
+    bool silent_on_trap = true;
+    mockIC.run_test(test_name +
+                        ": extra_failures detected (see PASS/FAIL log above)",
+                    endpoint, EMPTY_INPUT, "DELIBERATE_FAIL_TO_RAISE_ALARM",
+                    silent_on_trap, MOCKIC_CONTROLLER);
+  }
+}
@@ -0,0 +1,21 @@
+// Helpers shared by the native tests that check state directly, next to
+// their mockIC.run_test calls.
+#pragma once
+#include "mock_ic.h"
+
+#include <cstdint>
+#include <string>
+
+// Prints PASS or FAIL for `label`, and returns 1 on a mismatch
+int expect_eq_u64(const char *label, uint64_t actual, uint64_t expected);
+
+// Removes .canister_cache/<principal_dir>, so a scenario starts clean, and
+// forgets the cache index, which is rebuilt from the filesystem on next use
+void clear_test_principal_dir(const std::string &principal_dir);
+
+// The direct checks do not go through mockIC.run_test, so
+// mockIC.test_summary() does not count them. Prints the count and, when there
+// are failures, calls `endpoint` expecting an output it never produces, so the
+// summary fails too.
+void report_extra_failures(MockIC &mockIC, const std::string &test_name,
+                           int extra_failures, void (*endpoint)());
@@ -132,7 +132,7 @@ void test_qwen2(MockIC &mockIC) {
             std::to_string(i) + " - " + model,
         run_update,
         "4449444c026c01dd9ad28304016d710100080e2d2d70726f6d70742d63616368650c70726f6d70742e6361636865122d2d70726f6d70742d63616368652d616c6c032d7370022d6e03353132022d708a013c7c696d5f73746172747c3e73797374656d0a596f752061726520612068656c7066756c20617373697374616e742e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e757365720a4578706c61696e204c61726765204c616e6775616765204d6f64656c732e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e617373697374616e740a",
-        "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a010001020001190000000000000000010000000000000000463c7c696d5f73746172747c3e73797374656d0a596f752061726520612068656c7066756c20617373697374616e742e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e00010d00000000000000010000000000000000c80044757365720a4578706c61696e204c61726765204c616e6775616765204d6f64656c732e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e617373697374616e740a00010c00000000000000",
+        "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a010001020001190000000000000000010000000000000000010000000000000000010000000000000000010000000000000000463c7c696d5f73746172747c3e73797374656d0a596f752061726520612068656c7066756c20617373697374616e742e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e00010d00000000000000010000000000000000010000000000000000010000000000000000c80044757365720a4578706c61696e204c61726765204c616e6775616765204d6f64656c732e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e617373697374616e740a01000000000000000001000000000000000000010c00000000000000",
         silent_on_trap, my_principal);
 
     // -----------------------------------------------------------------------------
@@ -144,7 +144,7 @@ void test_qwen2(MockIC &mockIC) {
             std::to_string(i) + " - " + model,
         run_update,
         "4449444c026c01dd9ad28304016d710100080e2d2d70726f6d70742d63616368650c70726f6d70742e6361636865122d2d70726f6d70742d63616368652d616c6c032d7370022d6e03353132022d708a013c7c696d5f73746172747c3e73797374656d0a596f752061726520612068656c7066756c20617373697374616e742e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e757365720a4578706c61696e204c61726765204c616e6775616765204d6f64656c732e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e617373697374616e740a",
-        "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a01000102000119000000000000000001000000000000000089013c7c696d5f73746172747c3e73797374656d0a596f752061726520612068656c7066756c20617373697374616e742e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e757365720a4578706c61696e204c61726765204c616e6775616765204d6f64656c732e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e617373697374616e7400010100000000000000010c00000000000000c800010a00010c00000000000000",
+        "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a01000102000119000000000000000001000000000000000001000000000000000001000000000000000001000000000000000089013c7c696d5f73746172747c3e73797374656d0a596f752061726520612068656c7066756c20617373697374616e742e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e757365720a4578706c61696e204c61726765204c616e6775616765204d6f64656c732e3c7c696d5f656e647c3e0a3c7c696d5f73746172747c3e617373697374616e7400010100000000000000010000000000000000010000000000000000010c00000000000000c800010a01000000000000000001000000000000000000010c00000000000000",
         silent_on_trap, my_principal);
 
     // -----------------------------------------------------------------------------
@@ -116,13 +116,15 @@ void test_qwen3(MockIC &mockIC) {
   // input="<|im_start|>user\nGive a one sentence intro to LLMs", output="",
   // prompt_remaining=".<|im_end|>\n<|im_start|>assistant\n<think>\n\n</think>\n\n"
   candid_out =
-      "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe2"
-      "0801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a01"
-      "0001020001160000000000000000010000000000000000323c7c696d5f73746172747c3e757365"
-      "720a476976652061206f6e652073656e74656e636520696e74726f20746f204c4c4d7300010a00"
-      "000000000000010000000000000000c800352e3c7c696d5f656e647c3e0a3c7c696d5f73746172"
-      "747c3e617373697374616e740a3c7468696e6b3e0a0a3c2f7468696e6b3e0a0a00010c00000000"
-      "000000";
+      "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc5"
+      "0501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019a"
+      "a1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01"
+      "bc8a01000102000116000000000000000001000000000000000001000000000000000001000000"
+      "0000000000010000000000000000323c7c696d5f73746172747c3e757365720a47697665206120"
+      "6f6e652073656e74656e636520696e74726f20746f204c4c4d7300010a00000000000000010000"
+      "000000000000010000000000000000010000000000000000c800352e3c7c696d5f656e647c3e0a"
+      "3c7c696d5f73746172747c3e617373697374616e740a3c7468696e6b3e0a0a3c2f7468696e6b3e"
+      "0a0a01000000000000000001000000000000000000010c00000000000000";
   mockIC.run_test(test_name, run_update, candid_in, candid_out, silent_on_trap,
                   my_principal);
 
@@ -138,14 +140,16 @@ void test_qwen3(MockIC &mockIC) {
   // THE exact-token assertion: 12 greedy tokens through the real decode path
   // (q8_0 KV, ctx 16384). output="\ninspired by the example given\ninspired by the"
   candid_out =
-      "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe2"
-      "0801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a01"
-      "00010200010c000000000000002e0a696e73706972656420627920746865206578616d706c6520"
-      "676976656e0a696e73706972656420627920746865010c00000000000000603c7c696d5f737461"
-      "72747c3e757365720a476976652061206f6e652073656e74656e636520696e74726f20746f204c"
-      "4c4d730a696e73706972656420627920746865206578616d706c6520676976656e0a696e737069"
-      "7265642062792074686500010000000000000000010c00000000000000c8000000010000000000"
-      "000000";
+      "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc5"
+      "0501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019a"
+      "a1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01"
+      "bc8a0100010200010c000000000000002e0a696e73706972656420627920746865206578616d70"
+      "6c6520676976656e0a696e73706972656420627920746865010000000000000000010000000000"
+      "000000010c00000000000000010000000000000000603c7c696d5f73746172747c3e757365720a"
+      "476976652061206f6e652073656e74656e636520696e74726f20746f204c4c4d730a696e737069"
+      "72656420627920746865206578616d706c6520676976656e0a696e737069726564206279207468"
+      "6500010000000000000000010000000000000000010000000000000000010c00000000000000c8"
+      "000001000000000000000001000000000000000000010000000000000000";
   mockIC.run_test(test_name, run_update, candid_in, candid_out, silent_on_trap,
                   my_principal);
 }
@@ -2,8 +2,10 @@
 
 #include "../src/health.h"
 #include "../src/logs.h"
+#include "../src/main_.h"
 #include "../src/max_tokens.h"
 #include "../src/model.h"
+#include "../src/model_registry.h"
 #include "../src/promptcache.h"
 #include "../src/ready.h"
 #include "../src/run.h"
@@ -136,10 +138,10 @@ void test_tiny_stories(MockIC &mockIC) {
         // -> ...
         if (model == "models/stories260Ktok512.gguf") {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200011000000000000000072e204865206c690102000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000010000000000000000c8000000011000000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200011000000000000000072e204865206c690100000000000000000100000000000000000102000000000000000100000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000010000000000000000010000000000000000010000000000000000c8000001000000000000000001000000000000000000011000000000000000";
         } else {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200010600000000000000082e204865206861730102000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000010000000000000000c8000000010600000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200010600000000000000082e204865206861730100000000000000000100000000000000000102000000000000000100000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000010000000000000000010000000000000000010000000000000000c8000001000000000000000001000000000000000000010600000000000000";
         }
         mockIC.run_test(
             std::string(__func__) + ": " + "run_update for chat " +
@@ -154,10 +156,10 @@ void test_tiny_stories(MockIC &mockIC) {
         // -> ...
         if (model == "models/stories260Ktok512.gguf") {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a010001020001120000000000000009206c696b656420746f01020000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e204865206c696b656400010000000000000000011200000000000000c8000000010000000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a010001020001120000000000000009206c696b656420746f01000000000000000001000000000000000001020000000000000001000000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e204865206c696b656400010000000000000000010000000000000000010000000000000000011200000000000000c8000001000000000000000001000000000000000000010000000000000000";
         } else {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a01000102000108000000000000000e206861732061207370656369616c01020000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e20486520686173206100010000000000000000010800000000000000c8000000010000000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a01000102000108000000000000000e206861732061207370656369616c01000000000000000001000000000000000001020000000000000001000000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e20486520686173206100010000000000000000010000000000000000010000000000000000010800000000000000c8000001000000000000000001000000000000000000010000000000000000";
         }
         mockIC.run_test(
             std::string(__func__) + ": " + "run_update for chat " +
@@ -228,10 +230,10 @@ void test_tiny_stories(MockIC &mockIC) {
         // -> ...
         if (model == "models/stories260Ktok512.gguf") {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200011000000000000000072e204865206c690103000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000011000000000000000c8000000010000000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200011000000000000000072e204865206c690100000000000000000100000000000000000103000000000000000100000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000010000000000000000010000000000000000011000000000000000c8000001000000000000000001000000000000000000010000000000000000";
         } else {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200010600000000000000082e204865206861730103000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000010600000000000000c8000000010000000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a0100010200010600000000000000082e204865206861730100000000000000000100000000000000000103000000000000000100000000000000001e204a6f65206c6f7665732077726974696e672073746f726965732e20486500010000000000000000010000000000000000010000000000000000010600000000000000c8000001000000000000000001000000000000000000010000000000000000";
         }
         mockIC.run_test(
             std::string(__func__) + ": " + "run_update for chat " +
@@ -246,10 +248,10 @@ void test_tiny_stories(MockIC &mockIC) {
         // -> ...
         if (model == "models/stories260Ktok512.gguf") {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a010001020001120000000000000008206c69766564206101020000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e204865206c6976656400010000000000000000011200000000000000c8000000010000000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a010001020001120000000000000008206c69766564206101000000000000000001000000000000000001020000000000000001000000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e204865206c6976656400010000000000000000010000000000000000010000000000000000011200000000000000c8000001000000000000000001000000000000000000010000000000000000";
         } else {
           candid_out =
-              "4449444c036c0b84d28e1701819e846471db92ea8f0501838fe5800671c897a7990771bbb1bbe20801fde19a880c019aa1b2f90c7adb92a2c90d71cdd9e6b30e7efba3dbe30e016e786b01bc8a01000102000108000000000000000e206861732061207370656369616c01020000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e20486520686173206100010000000000000000010800000000000000c8000000010000000000000000";
+              "4449444c036c1284d28e1701819e846471ccb2f8c201018198e2cb0101db92ea8f0501b2beadc50501838fe5800671c897a7990771bbb1bbe20801f0d98fd10a01e588b2b20b01fde19a880c019aa1b2f90c7adb92a2c90d718980b9d40d01a0e290f90d01cdd9e6b30e7efba3dbe30e016e786b01bc8a01000102000108000000000000000e206861732061207370656369616c01000000000000000001000000000000000001020000000000000001000000000000000024204a6f65206c6f7665732077726974696e672073746f726965732e20486520686173206100010000000000000000010000000000000000010000000000000000010800000000000000c8000001000000000000000001000000000000000000010000000000000000";
         }
         mockIC.run_test(
             std::string(__func__) + ": " + "run_update for chat " +
@@ -284,6 +286,61 @@ void test_tiny_stories(MockIC &mockIC) {
     }
   }
 
+  // -----------------------------------------------------------------------------
+  // reload_model replays the saved load of every resident model
+  // Keep two models resident: the last one of the loop, and this one
+  // '(record { max_models = 2 : nat64; heap_budget_bytes = 0 : nat64 })' ->
+  // '(variant { Ok = record { status_code = 200 : nat16; } })'
+  mockIC.run_test(
+      std::string(__func__) + ": " + "set_model_registry_config 2",
+      set_model_registry_config,
+      "4449444c016c02a4a3bdcf0778a5e8c5e00c78010000000000000000000200000000000000",
+      "4449444c026c019aa1b2f90c7a6b01bc8a0100010100c800", silent_on_trap,
+      my_principal);
+
+  // '(record { args = vec {"--model"; "models/stories260Ktok512.gguf";} })' ->
+  // '(variant { Ok = record { status_code = 200 : nat16; output="Model succesfully loaded into memory."; ... } })'
+  mockIC.run_test(
+      std::string(__func__) + ": " + "load_model - second resident model",
+      load_model,
+      "4449444c026c01dd9ad28304016d71010002072d2d6d6f64656c1d6d6f64656c732f73746f726965733236304b746f6b3531322e67677566",
+      "4449444c026c06819e846471838fe5800671c897a79907719aa1b2f90c7adb92a2c90d71cdd9e6b30e7e6b01bc8a0100010100254d6f64656c2073756363657366756c6c79206c6f6164656420696e746f206d656d6f72792e0000c8000000",
+      silent_on_trap, my_principal);
+
+  // An upgrade wipes the heap, but not the files
+  icpp_free_model();
+
+  // '()' -> '(variant { Ok = record { status_code = 200 : nat16; output="Model succesfully loaded into memory: models/stories15Mtok4096.gguf (1/2 saved models)."; ... } })'
+  mockIC.run_test(
+      std::string(__func__) + ": " + "reload_model 1/2", reload_model,
+      "4449444c0000",
+      "4449444c026c06819e846471838fe5800671c897a79907719aa1b2f90c7adb92a2c90d71cdd9e6b30e7e6b01bc8a0100010100574d6f64656c2073756363657366756c6c79206c6f6164656420696e746f206d656d6f72793a206d6f64656c732f73746f7269657331354d746f6b343039362e676775662028312f32207361766564206d6f64656c73292e0000c8000000",
+      silent_on_trap, my_principal);
+
+  // '()' -> '(variant { Ok = record { status_code = 200 : nat16; output="Model succesfully loaded into memory: models/stories260Ktok512.gguf (2/2 saved models)."; ... } })'
+  mockIC.run_test(
+      std::string(__func__) + ": " + "reload_model 2/2", reload_model,
+      "4449444c0000",
+      "4449444c026c06819e846471838fe5800671c897a79907719aa1b2f90c7adb92a2c90d71cdd9e6b30e7e6b01bc8a0100010100574d6f64656c2073756363657366756c6c79206c6f6164656420696e746f206d656d6f72793a206d6f64656c732f73746f726965733236304b746f6b3531322e676775662028322f32207361766564206d6f64656c73292e0000c8000000",
+      silent_on_trap, my_principal);
+
+  // '()' -> '(variant { Ok = record { status_code = 200 : nat16; output="All 2 saved models are loaded."; ... } })'
+  mockIC.run_test(
+      std::string(__func__) + ": " + "reload_model done", reload_model,
+      "4449444c0000",
+      "4449444c026c06819e846471838fe5800671c897a79907719aa1b2f90c7adb92a2c90d71cdd9e6b30e7e6b01bc8a01000101001e416c6c2032207361766564206d6f64656c7320617265206c6f616465642e0000c8000000",
+      silent_on_trap, my_principal);
+
+  // Back to one resident model
+  // '(record { max_models = 1 : nat64; heap_budget_bytes = 0 : nat64 })' ->
+  // '(variant { Ok = record { status_code = 200 : nat16; } })'
+  mockIC.run_test(
+      std::string(__func__) + ": " + "set_model_registry_config 1",
+      set_model_registry_config,
+      "4449444c016c02a4a3bdcf0778a5e8c5e00c78010000000000000000000100000000000000",
+      "4449444c026c019aa1b2f90c7a6b01bc8a0100010100c800", silent_on_trap,
+      my_principal);
+
   // -----------------------------------------------------------------------------
   // Resume logging
   // '()' -> '(variant { Ok = record { status_code = 200 : nat16; } })'
@@ -2,7 +2,11 @@
 
 import hashlib
 from pathlib import Path
-from typing import Union
+from typing import List, Union
+
+# Domain separation of the Merkle tree of a parallel upload (see src/upload.cpp)
+MERKLE_LEAF_PREFIX = b"\x00"
+MERKLE_NODE_PREFIX = b"\x01"
 
 
 def calculate_sha256(file_path: Union[str, Path]) -> str:
@@ -20,3 +24,37 @@ def calculate_sha256(file_path: Union[str, Path]) -> str:
         for byte_block in iter(lambda: f.read(4096), b""):
             sha256_hash.update(byte_block)
     return sha256_hash.hexdigest()
+
+
+def calculate_merkle_root(data: bytes, chunksize: int) -> str:
+    """Calculate the Merkle root the canister computes for a parallel upload.
+
+    With domain separation, like the canister: a leaf is the SHA256 of 0x00
+    followed by the chunk, a parent is the SHA256 of 0x01 followed by its two
+    children's hashes. An odd last node is carried up unchanged.
+
+    Args:
+        data: The file contents
+        chunksize: The chunksize of the upload
+
+    Returns:
+        The Merkle root as a hexadecimal string
+    """
+    level: List[bytes] = [
+        hashlib.sha256(MERKLE_LEAF_PREFIX + data[i : i + chunksize]).digest()
+        for i in range(0, len(data), chunksize)
+    ]
+    # An empty file has one empty chunk
+    if not level:
+        level = [hashlib.sha256(MERKLE_LEAF_PREFIX).digest()]
+    while len(level) > 1:
+        parents = []
+        for i in range(0, len(level), 2):
+            if i + 1 == len(level):
+                parents.append(level[i])
+            else:
+                parents.append(
+                    hashlib.sha256(MERKLE_NODE_PREFIX + level[i] + level[i + 1]).digest()
+                )
+        level = parents
+    return level[0].hex()
@@ -10,12 +10,14 @@ Run with:
 
 # pylint: disable=invalid-name, too-few-public-methods, no-member, too-many-statements, line-too-long
 
+import hashlib
 import sys
 from pathlib import Path
-from typing import List
+from typing import Any, List, Tuple
 from .ic_py_canister import extract_variant, get_canister, run_icp_command
 from .parse_args_download import parse_args
 from .calculate_sha256 import calculate_sha256
+from .lz4_block import decompress as lz4_decompress, MAX_LZ4_CHUNK_SIZE
 
 ROOT_PATH = Path(__file__).parent.parent
 
@@ -24,6 +26,95 @@ ROOT_PATH = Path(__file__).parent.parent
 #  2 - a lot
 DEBUG_VERBOSE = 1
 
+# Block size of the delta sync (--delta)
+DELTA_BLOCK_SIZE = 64 * 1024
+# The canister's cap on the blocks of one page, and on the hashes of one call
+DELTA_MAX_HASHES_PER_CALL = 16384
+
+
+def get_remote_hashes(canister_instance: Any, canister_filename: str, block_size: int) -> Tuple[int, List[str]]:
+    """Returns the filesize and the block hashes of the prompt cache in the canister."""
+    remote_hashes: List[str] = []
+    done = False
+    first_block = 0
+    filesize = 0
+    while not done:
+        response = canister_instance.prompt_cache_block_hashes(
+            {
+                "promptcache": canister_filename,
+                "block_size": block_size,
+                "first_block": first_block,
+            }
+        )
+        result = extract_variant(response)
+        if "Ok" not in result:
+            print("Something went wrong:")
+            print(response)
+            sys.exit(1)
+        filesize = result["Ok"]["filesize"]
+        remote_hashes.extend(result["Ok"]["hashes"])
+        first_block = result["Ok"]["next_block"]
+        done = result["Ok"]["done"]
+    return filesize, remote_hashes
+
+
+def download_delta(canister_instance: Any, canister_filename: str, local_filename_path: Path, block_size: int) -> None:
+    """Brings a local copy of a prompt cache up to date, downloading only the blocks that changed.
+
+    The hashes of the canister's copy tell which blocks changed, so the download
+    skips the unchanged runs, and is not called at all when nothing changed.
+    Each download call sends only the local hashes of the blocks its page can reach.
+    """
+    local_hashes: List[str] = []
+    if local_filename_path.exists():
+        with open(local_filename_path, "rb") as f:
+            for block in iter(lambda: f.read(block_size), b""):
+                local_hashes.append(hashlib.sha256(block).hexdigest())
+    else:
+        local_filename_path.touch()
+    print(f"--\nDelta sync: the local copy has {len(local_hashes)} blocks of {block_size} bytes")
+
+    filesize, remote_hashes = get_remote_hashes(canister_instance, canister_filename, block_size)
+    changed = [i for i, h in enumerate(remote_hashes) if i >= len(local_hashes) or local_hashes[i] != h]
+    print(f"--\nDelta sync: {len(changed)} of {len(remote_hashes)} blocks changed")
+
+    n_changed = 0
+    with open(local_filename_path, "r+b") as f:
+        k = 0  # the first changed block not covered yet
+        while k < len(changed):
+            first_block = changed[k]
+            response = canister_instance.download_prompt_cache_blocks(
+                {
+                    "promptcache": canister_filename,
+                    "block_size": block_size,
+                    "first_block": first_block,
+                    "hashes": local_hashes[first_block : first_block + DELTA_MAX_HASHES_PER_CALL],
+                }
+            )
+            result = extract_variant(response)
+            if "Ok" not in result:
+                print("Something went wrong:")
+                print(response)
+                sys.exit(1)
+
+            filesize = result["Ok"]["filesize"]
+            data = bytes(result["Ok"]["data"])
+            pos = 0
+            for index in result["Ok"]["indices"]:
+                # Only the last block of the file can be short
+                length = min(block_size, filesize - index * block_size)
+                f.seek(index * block_size)
+                f.write(data[pos : pos + length])
+                pos += length
+            n_changed += len(result["Ok"]["indices"])
+            if result["Ok"]["done"]:
+                break
+            next_block = result["Ok"]["next_block"]
+            while k < len(changed) and changed[k] < next_block:
+                k += 1
+        f.truncate(filesize)
+    print(f"--\nDelta sync: downloaded {n_changed} changed blocks")
+
 
 def main() -> int:
     """Downloads a file from the canister and writes it to disk."""
@@ -42,6 +133,10 @@ def main() -> int:
     else:
         local_filename_path = ROOT_PATH / canister_filename
     chunksize = args.chunksize
+    compress = args.compress and filetype == "promptcache"
+    if compress:
+        chunksize = min(chunksize, MAX_LZ4_CHUNK_SIZE)
+    delta = args.delta and filetype == "promptcache"
 
     icp_yaml_path = ROOT_PATH / "icp.yaml"
 
@@ -56,6 +151,8 @@ def main() -> int:
         f"\n - filetype            = {filetype}"
         f"\n - local_filename_path = {local_filename_path}"
         f"\n - chunksize           = {chunksize} ({chunksize/1024/1024:.3f} Mb)"
+        f"\n - compress            = {compress}"
+        f"\n - delta               = {delta}"
         f"\n - network             = {network}"
         f"\n - canister            = {canister_name}"
         f"\n - canister_id         = {canister_id}"
@@ -84,40 +181,73 @@ def main() -> int:
     print(f"--\nDownloading the file: {canister_filename}")
     print(f"--\nSaving to: {local_filename_path}")
 
-    done = False
-    offset = 0
-    with open(local_filename_path, "wb") as f:
-        while not done:
-            if filetype == "promptcache":
-                response = canister_instance.download_prompt_cache_chunk(
-                    {
-                        "promptcache": canister_filename,
-                        "chunksize": chunksize,
-                        "offset": offset,
-                    }
-                )
-            else:
-                response = canister_instance.file_download_chunk(
-                    {
-                        "filename": canister_filename,
-                        "chunksize": chunksize,
-                        "offset": offset,
-                    }
-                )
+    if delta:
+        download_delta(canister_instance, canister_filename, local_filename_path, DELTA_BLOCK_SIZE)
+    else:
+        done = False
+        offset = 0
+        with open(local_filename_path, "wb") as f:
+            while not done:
+                if compress:
+                    response = canister_instance.download_prompt_cache_chunk_lz4(
+                        {
+                            "promptcache": canister_filename,
+                            "chunksize": chunksize,
+                            "offset": offset,
+                        }
+                    )
+                elif filetype == "promptcache":
+                    response = canister_instance.download_prompt_cache_chunk(
+                        {
+                            "promptcache": canister_filename,
+                            "chunksize": chunksize,
+                            "offset": offset,
+                        }
+                    )
+                else:
+                    # One segment per call: it is read up to max_bytes, so more
+                    # offsets of the same file would not fit in the reply. The
+                    # batching is for clients that fetch many small files.
+                    response = canister_instance.file_download_chunks(
+                        {
+                            "filenames": [canister_filename],
+                            "offsets": [offset],
+                            "max_bytes": chunksize,
+                        }
+                    )
+
+                result = extract_variant(response)
+                if "Ok" not in result:
+                    print("Something went wrong:")
+                    print(response)
+                    sys.exit(1)
+
+                if compress:
+                    r_filesize = result["Ok"]["filesize"]
+                    r_chunk = list(lz4_decompress(bytes(result["Ok"]["chunk"]), result["Ok"]["chunksize"]))
+                    if hashlib.sha256(bytes(r_chunk)).hexdigest() != result["Ok"]["sha256"]:
+                        print(f"The chunk at offset {offset} does not match its sha256")
+                        sys.exit(1)
+                    r_offset = result["Ok"]["offset"]
+                    done = result["Ok"]["done"]
+                elif filetype == "promptcache":
+                    r_filesize = result["Ok"]["filesize"]
+                    r_chunk: List[int] = result["Ok"]["chunk"]
+                    r_offset = result["Ok"]["offset"]
+                    done = result["Ok"]["done"]
+                else:
+                    segment = result["Ok"]["segments"][0]
+                    r_filesize = segment["filesize"]
+                    r_chunk = result["Ok"]["data"]
+                    r_offset = segment["offset"]
+                    done = r_offset + segment["length"] >= r_filesize
 
-            result = extract_variant(response)
-            if "Ok" in result:
-                r_filesize = result["Ok"]["filesize"]
-                r_chunk: List[int] = result["Ok"]["chunk"]
-                r_chunksize = result["Ok"]["chunksize"]
-                r_offset = result["Ok"]["offset"]
                 total_received = offset + len(r_chunk)
                 print(
                     "--"
                     "\nDownloaded a chunk:"
                     f"\n- filesize       = {r_filesize} bytes ({r_filesize/1024/1024:.3f} Mb), "
                     f"\n- len(chunk)     = {len(r_chunk)} bytes ({len(r_chunk)/1024/1024:.3f} Mb), "
-                    f"\n- chunksize      = {r_chunksize} bytes ({r_chunksize/1024/1024:.3f} Mb), "
                     f"\n- offset         = {r_offset} bytes ({r_offset/1024/1024:.3f} Mb), "
                     f"\n- total_received = {total_received} bytes ({total_received/1024/1024:.3f} Mb)"
                 )
@@ -125,12 +255,6 @@ def main() -> int:
 
                 f.write(bytearray(r_chunk))
 
-                done = result["Ok"]["done"]
-            else:
-                print("Something went wrong:")
-                print(response)
-                sys.exit(1)
-
     # ---------------------------------------------------------------------------
     local_file_sha256 = calculate_sha256(local_filename_path)
     local_file_size = local_filename_path.stat().st_size
@@ -5,14 +5,20 @@ Needed because the canister applies NO chat template
 in its own format. Guessing the format produces output that looks exactly like a
 bad model - read it from the file instead.
 
+With --tensors, it also reports the tensor types in the file and flags those
+that have no wasm SIMD vec_dot kernel in the llama.cpp fork
+(ggml-cpu/arch/wasm/quants.c). Those fall back to generic scalar code in the
+canister, which can cost several times the instructions per token -- check this
+BEFORE uploading a multi-GB model.
+
 Usage:
-  python scripts/gguf_meta.py <model.gguf> [--full]
+  python scripts/gguf_meta.py <model.gguf> [--full] [--tensors]
 """
 
 import re
 import struct
 import sys
-from typing import Any, BinaryIO, Dict, Sequence
+from typing import Any, BinaryIO, Dict, List, Sequence, Tuple
 
 KEYS = (
     "general.architecture",
@@ -24,19 +30,120 @@ KEYS = (
 )
 
 
+# ggml_type ids (ggml/include/ggml.h) -> name
+GGML_TYPES = {
+    0: "F32",
+    1: "F16",
+    2: "Q4_0",
+    3: "Q4_1",
+    6: "Q5_0",
+    7: "Q5_1",
+    8: "Q8_0",
+    9: "Q8_1",
+    10: "Q2_K",
+    11: "Q3_K",
+    12: "Q4_K",
+    13: "Q5_K",
+    14: "Q6_K",
+    15: "Q8_K",
+    16: "IQ2_XXS",
+    17: "IQ2_XS",
+    18: "IQ3_XXS",
+    19: "IQ1_S",
+    20: "IQ4_NL",
+    21: "IQ3_S",
+    22: "IQ2_S",
+    23: "IQ4_XS",
+    24: "I8",
+    25: "I16",
+    26: "I32",
+    27: "I64",
+    28: "F64",
+    29: "IQ1_M",
+    30: "BF16",
+    34: "TQ1_0",
+    35: "TQ2_0",
+    39: "MXFP4",
+    40: "NVFP4",
+    41: "Q1_0",
+}
+
+# Types with a hand-written wasm SIMD path: the quants in arch/wasm/quants.c,
+# plus F32/F16 through the GGML_F32/F16 SIMD macros. Everything else
+# (BF16, TQ1_0/TQ2_0, Q1_0, MXFP4, NVFP4, the IQ* family, ...) runs scalar code.
+WASM_SIMD_TYPES = {
+    "F32",
+    "F16",
+    "Q4_0",
+    "Q4_1",
+    "Q5_0",
+    "Q5_1",
+    "Q8_0",
+    "Q2_K",
+    "Q3_K",
+    "Q4_K",
+    "Q5_K",
+    "Q6_K",
+}
+
+
 def read_kv(path: str, keys: Sequence[str] = KEYS) -> Dict[str, Any]:
     """Return the requested GGUF key/value metadata entries as a dict."""
     with open(path, "rb") as f:
         return _read_kv(f, keys)
 
 
-def _read_kv(f: BinaryIO, keys: Sequence[str]) -> Dict[str, Any]:
-    """Parse the GGUF KV header from an open binary file object."""
+def read_tensor_types(path: str) -> List[Tuple[str, str, int]]:
+    """Return (name, type, n_bytes) for every tensor in the gguf.
+
+    The size of a tensor is the distance from its data offset to the next one
+    (the last one ends at the end of the file), so it is right for every type,
+    including those not in GGML_TYPES. It includes the alignment padding, at
+    most general.alignment (32) bytes per tensor.
+    """
+    with open(path, "rb") as f:
+        n_tensors, n_kv = _read_header(f)
+        alignment = _read_kv_entries(f, n_kv, ("general.alignment",)).get(
+            "general.alignment", 32
+        )
+        infos = []
+        for _ in range(n_tensors):
+            (nl,) = struct.unpack("<Q", f.read(8))
+            name = f.read(nl).decode("utf-8", "replace")
+            (n_dims,) = struct.unpack("<I", f.read(4))
+            f.read(8 * n_dims)  # dims
+            (ttype,) = struct.unpack("<I", f.read(4))
+            (offset,) = struct.unpack("<Q", f.read(8))
+            infos.append((offset, name, GGML_TYPES.get(ttype, f"type{ttype}")))
+        data_start = -(-f.tell() // alignment) * alignment
+        f.seek(0, 2)
+        data_size = f.tell() - data_start
+    infos.sort()
+    ends = [offset for offset, _, _ in infos[1:]] + [data_size]
+    return [
+        (name, ttype, end - offset)
+        for (offset, name, ttype), end in zip(infos, ends)
+    ]
+
+
+def _read_header(f: BinaryIO) -> Tuple[int, int]:
+    """Parse the GGUF header; return (n_tensors, n_kv)."""
     if f.read(4) != b"GGUF":
         raise ValueError("not a gguf file")
     struct.unpack("<I", f.read(4))  # version
-    struct.unpack("<Q", f.read(8))  # n_tensors
+    (n_tensors,) = struct.unpack("<Q", f.read(8))
     (n_kv,) = struct.unpack("<Q", f.read(8))
+    return n_tensors, n_kv
+
+
+def _read_kv(f: BinaryIO, keys: Sequence[str]) -> Dict[str, Any]:
+    """Parse the GGUF KV header from an open binary file object."""
+    _, n_kv = _read_header(f)
+    return _read_kv_entries(f, n_kv, keys)
+
+
+def _read_kv_entries(f: BinaryIO, n_kv: int, keys: Sequence[str]) -> Dict[str, Any]:
+    """Parse n_kv key/value entries; keep the requested keys."""
 
     def rd(t: int) -> Any:  # pylint: disable=too-many-return-statements
         if t == 0:
@@ -81,6 +188,31 @@ def _read_kv(f: BinaryIO, keys: Sequence[str]) -> Dict[str, Any]:
     return found
 
 
+def print_tensor_types(path: str) -> None:
+    """Print a per-type tensor summary and flag types without wasm SIMD."""
+    counts: Dict[str, List[int]] = {}
+    for _, ttype, n_bytes in read_tensor_types(path):
+        entry = counts.setdefault(ttype, [0, 0])
+        entry[0] += 1
+        entry[1] += n_bytes
+    total = sum(n for _, n in counts.values())
+    print("\n--- tensor types ---")
+    for ttype, (n_tensors, n_bytes) in sorted(
+        counts.items(), key=lambda kv: -kv[1][1]
+    ):
+        simd = "wasm SIMD" if ttype in WASM_SIMD_TYPES else "SCALAR fallback"
+        print(
+            f"{ttype:8s}: {n_tensors:4d} tensors, "
+            f"{100.0 * n_bytes / max(total, 1):5.1f}% of bytes  [{simd}]"
+        )
+    slow = sorted(t for t in counts if t not in WASM_SIMD_TYPES)
+    if slow:
+        print(
+            f"\nWARNING: {', '.join(slow)} have no wasm SIMD vec_dot kernel; "
+            "expect a much lower max_tokens per call for this model."
+        )
+
+
 def main() -> int:
     """CLI entry point: print arch and chat template for a gguf path."""
     path = sys.argv[1]
@@ -93,6 +225,8 @@ def main() -> int:
         f"{kv.get('tokenizer.ggml.eos_token_id')}"
     )
     print(f"add_bos      : {kv.get('tokenizer.ggml.add_bos_token')}")
+    if "--tensors" in sys.argv:
+        print_tensor_types(path)
     t = kv.get("tokenizer.chat_template", "")
     if not t:
         print("\nchat_template: (none)")
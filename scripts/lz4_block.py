@@ -0,0 +1,128 @@
+"""LZ4 block compression, compatible with the canister's src/lz4.cpp.
+
+Used for the compressed prompt-cache transfer endpoints. Each chunk is one LZ4
+block: no frame header and no stored size. The uncompressed size travels as the
+chunk's `chunksize`.
+
+Uses the `lz4` package when it is installed, which is much faster. Otherwise it
+falls back to the pure-Python codec below.
+"""
+
+# pylint: disable=invalid-name
+
+try:
+    import lz4.block as _lz4_block  # type: ignore
+except ImportError:  # pragma: no cover
+    _lz4_block = None
+
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MF_LIMIT = 12
+MAX_OFFSET = 65535
+
+# The canister's MAX_LZ4_CHUNK_SIZE: an incompressible chunk, LZ4's worst case,
+# must still fit the 2 MiB message together with the rest of the reply
+MAX_LZ4_CHUNK_SIZE = (2 * 1024 * 1024 - 16 - 1024) * 255 // 256
+
+
+def _write_length(out: bytearray, length: int) -> None:
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def _write_literals(out: bytearray, literals: bytes, token_low: int) -> None:
+    n = len(literals)
+    out.append(min(n, 15) << 4 | token_low)
+    if n >= 15:
+        _write_length(out, n - 15)
+    out += literals
+
+
+def compress(data: bytes) -> bytes:
+    """Compress data into one LZ4 block."""
+    if _lz4_block is not None:
+        return bytes(_lz4_block.compress(data, store_size=False))
+
+    out = bytearray()
+    table: dict = {}
+    n = len(data)
+    anchor = 0
+    ip = 0
+    if n > MF_LIMIT:
+        match_end_limit = n - LAST_LITERALS
+        while ip <= n - MF_LIMIT:
+            sequence = data[ip : ip + MIN_MATCH]
+            ref = table.get(sequence)
+            table[sequence] = ip
+            if ref is None or ip - ref > MAX_OFFSET:
+                ip += 1
+                continue
+
+            while ip > anchor and ref > 0 and data[ip - 1] == data[ref - 1]:
+                ip -= 1
+                ref -= 1
+            length = MIN_MATCH
+            while ip + length < match_end_limit and data[ip + length] == data[ref + length]:
+                length += 1
+
+            match_len = length - MIN_MATCH
+            _write_literals(out, data[anchor:ip], min(match_len, 15))
+            offset = ip - ref
+            out.append(offset & 0xFF)
+            out.append(offset >> 8)
+            if match_len >= 15:
+                _write_length(out, match_len - 15)
+
+            ip += length
+            anchor = ip
+    _write_literals(out, data[anchor:], 0)
+    return bytes(out)
+
+
+def _read_length(block: bytes, ip: int) -> tuple:
+    length = 0
+    while True:
+        b = block[ip]
+        ip += 1
+        length += b
+        if b != 255:
+            return length, ip
+
+
+def decompress(block: bytes, uncompressed_size: int) -> bytes:
+    """Decompress one LZ4 block of exactly uncompressed_size bytes."""
+    if _lz4_block is not None:
+        return bytes(_lz4_block.decompress(block, uncompressed_size=uncompressed_size))
+
+    out = bytearray()
+    n = len(block)
+    ip = 0
+    while ip < n:
+        token = block[ip]
+        ip += 1
+        n_literals = token >> 4
+        if n_literals == 15:
+            extra, ip = _read_length(block, ip)
+            n_literals += extra
+        out += block[ip : ip + n_literals]
+        ip += n_literals
+        if ip >= n:
+            break
+        offset = block[ip] | block[ip + 1] << 8
+        ip += 2
+        match_len = token & 0x0F
+        if match_len == 15:
+            extra, ip = _read_length(block, ip)
+            match_len += extra
+        match_len += MIN_MATCH
+        start = len(out) - offset
+        if offset >= match_len:
+            out += out[start : start + match_len]
+        else:
+            for k in range(match_len):
+                out.append(out[start + k])
+    if len(out) != uncompressed_size:
+        raise ValueError(f"LZ4 block decompressed to {len(out)} bytes, expected {uncompressed_size}")
+    return bytes(out)
@@ -58,5 +58,19 @@ def parse_args() -> argparse.Namespace:
         help="Chunk Size used during file download, in bytes",
     )
 
+    parser.add_argument(
+        "--compress",
+        action="store_true",
+        help="Compress every chunk with LZ4 during the download "
+        "(--filetype promptcache only)",
+    )
+
+    parser.add_argument(
+        "--delta",
+        action="store_true",
+        help="Update an existing local copy, downloading only the blocks that changed "
+        "(--filetype promptcache only)",
+    )
+
     args = parser.parse_args()
     return args
@@ -56,6 +56,14 @@ def parse_args() -> argparse.Namespace:
         default=2000000,
         help="Chunk Size used during file upload, in bytes",
     )
+    parser.add_argument(
+        "--parallel",
+        type=int,
+        default=1,
+        help="Number of chunks uploaded concurrently. 1 = sequential upload; "
+        "more uses file_upload_chunk_at, verified by a Merkle root "
+        "(not for --filetype promptcache)",
+    )
     parser.add_argument(
         "--hf-sha256",
         type=str,
@@ -63,5 +71,12 @@ def parse_args() -> argparse.Namespace:
         help="Optional - provides the HuggingFace Hash, to check against.",
     )
 
+    parser.add_argument(
+        "--compress",
+        action="store_true",
+        help="Compress every chunk with LZ4 during the upload "
+        "(--filetype promptcache only)",
+    )
+
     args = parser.parse_args()
     return args
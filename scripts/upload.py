@@ -11,12 +11,16 @@ Run with:
 
 # pylint: disable=invalid-name, too-few-public-methods, no-member, too-many-statements, broad-except
 
+import hashlib
 import sys
+import threading
 import time
+from concurrent.futures import ThreadPoolExecutor
 from pathlib import Path
-from typing import Generator
-from .calculate_sha256 import calculate_sha256
+from typing import Any, Callable, Generator, Tuple
+from .calculate_sha256 import calculate_merkle_root, calculate_sha256
 from .ic_py_canister import extract_variant, get_canister, run_icp_command
+from .lz4_block import compress as lz4_compress, MAX_LZ4_CHUNK_SIZE
 from .parse_args_upload import parse_args
 
 ROOT_PATH = Path(__file__).parent.parent
@@ -47,6 +51,90 @@ def generate_chunks(data: bytes, chunksize: int) -> Generator[bytes, None, None]
         yield data[i : i + chunksize]
 
 
+def call_with_retries(call: Callable[[], Any], max_retries: int = 10) -> Any:
+    """Calls the canister, retrying when the Ingress is busy"""
+    retry_delay = 2  # seconds
+    for attempt in range(1, max_retries + 1):
+        try:
+            return call()
+        except Exception as e:
+            print(f"Attempt {attempt} failed: {e}")
+            if attempt == max_retries:
+                print("Max retries reached. Failing.")
+                raise
+            print(f"Retrying in {retry_delay} seconds...")
+            time.sleep(retry_delay)
+    return None
+
+
+def upload_parallel(
+    canister_instance: Any,
+    make_canister: Callable[[], Any],
+    canister_filename: str,
+    file_bytes: bytes,
+    chunksize: int,
+    parallel: int,
+) -> Tuple[int, str]:
+    """Uploads the chunks concurrently, in any order.
+
+    Returns the filesize and the Merkle root reported by file_upload_finish."""
+    response = call_with_retries(
+        lambda: canister_instance.file_upload_begin(
+            {
+                "filename": canister_filename,
+                "filesize": len(file_bytes),
+                "chunksize": chunksize,
+            },
+            verify_certificate=False,
+        )
+    )
+    result = extract_variant(response)
+    if "Ok" not in result:
+        print("Something went wrong:")
+        print(response)
+        sys.exit(1)
+    total_chunks = result["Ok"]["total_chunks"]
+    print(f"--\nUploading {total_chunks} chunks, {parallel} at a time")
+
+    # Each worker thread uses its own agent
+    local = threading.local()
+
+    def upload_chunk(index: int) -> None:
+        if not hasattr(local, "canister"):
+            local.canister = make_canister()
+        chunk = file_bytes[index * chunksize : (index + 1) * chunksize]
+        response = call_with_retries(
+            lambda: local.canister.file_upload_chunk_at(
+                {"filename": canister_filename, "chunk": chunk, "index": index},
+                verify_certificate=False,
+            )
+        )
+        result = extract_variant(response)
+        if "Ok" not in result:
+            raise RuntimeError(f"chunk {index}: {response}")
+        if DEBUG_VERBOSE > 0 and (index % 10 == 0 or DEBUG_VERBOSE == 2):
+            print(
+                f"OK! chunk {index}: received {result['Ok']['received_chunks']} "
+                f"of {result['Ok']['total_chunks']} chunks"
+            )
+
+    with ThreadPoolExecutor(max_workers=parallel) as executor:
+        # list() re-raises the first failure
+        list(executor.map(upload_chunk, range(total_chunks)))
+
+    response = call_with_retries(
+        lambda: canister_instance.file_upload_finish(
+            {"filename": canister_filename}, verify_certificate=False
+        )
+    )
+    result = extract_variant(response)
+    if "Ok" not in result:
+        print("Something went wrong:")
+        print(response)
+        sys.exit(1)
+    return result["Ok"]["filesize"], result["Ok"]["filesha256"]
+
+
 def main() -> int:
     """Uploads a local file to the canister."""
 
@@ -65,6 +153,12 @@ def main() -> int:
         canister_filename = args.__dict__["local-filename"]
     chunksize = args.chunksize
     hf_sha256 = args.hf_sha256
+    parallel = args.parallel
+    if filetype == "promptcache":
+        parallel = 1
+    compress = args.compress and filetype == "promptcache"
+    if compress:
+        chunksize = min(chunksize, MAX_LZ4_CHUNK_SIZE)
 
     icp_yaml_path = ROOT_PATH / "icp.yaml"
 
@@ -79,6 +173,8 @@ def main() -> int:
         f"\n - filetype            = {filetype}"
         f"\n - local_filename_path = {local_filename_path}"
         f"\n - chunksize           = {chunksize} ({chunksize/1024/1024:.3f} Mb)"
+        f"\n - parallel            = {parallel}"
+        f"\n - compress            = {compress}"
         f"\n - network             = {network}"
         f"\n - canister            = {canister_name}"
         f"\n - canister_id         = {canister_id}"
@@ -126,11 +222,29 @@ def main() -> int:
     print(f"--\nReading the file into a bytes object: {local_filename_path}")
     file_bytes = read_file_bytes(local_filename_path)
 
+    # A parallel upload is verified by the Merkle root of the chunks, which the
+    # canister also reports as the filesha256 of the uploaded file.
+    expected_sha256 = local_file_sha256
+    if parallel > 1:
+        expected_sha256 = calculate_merkle_root(file_bytes, chunksize)
+        print(f"Calculated Merkle root : {expected_sha256}")
+
     # Iterate over all chunks
     offset = 0
     canister_filesize = 0
     canister_filesha256 = ""
-    for i, chunk in enumerate(generate_chunks(file_bytes, chunksize)):
+    if parallel > 1:
+        canister_filesize, canister_filesha256 = upload_parallel(
+            canister_instance,
+            lambda: get_canister(canister_name, candid_path, network, canister_id),
+            canister_filename,
+            file_bytes,
+            chunksize,
+            parallel,
+        )
+    # A parallel upload sent all the chunks already; this is the sequential one
+    sequential_bytes = file_bytes if parallel == 1 else b""
+    for i, chunk in enumerate(generate_chunks(sequential_bytes, chunksize)):
         if DEBUG_VERBOSE == 0:
             pass
         elif DEBUG_VERBOSE == 1:
@@ -157,7 +271,19 @@ def main() -> int:
         retry_delay = 2  # seconds
         for attempt in range(1, max_retries + 1):
             try:
-                if filetype == "promptcache":
+                if compress:
+                    response = canister_instance.upload_prompt_cache_chunk_lz4(
+                        {
+                            "promptcache": canister_filename,
+                            "chunk": lz4_compress(chunk),
+                            "chunksize": len(chunk),
+                            "upload_chunksize": chunksize,
+                            "offset": offset,
+                            "sha256": hashlib.sha256(chunk).hexdigest(),
+                        },
+                        verify_certificate=False,
+                    )  # pylint: disable=no-member
+                elif filetype == "promptcache":
                     response = canister_instance.upload_prompt_cache_chunk(
                         {
                             "promptcache": canister_filename,
@@ -217,14 +343,14 @@ def main() -> int:
         offset += len(chunk)
 
     if (canister_filesize != local_file_size) or (
-        canister_filesha256 != local_file_sha256
+        canister_filesha256 != expected_sha256
     ):
         print(" ")
         print("ERROR - canister file does not match the local file:")
         print(f"- canister_filesize: {canister_filesize}")
         print(f"- local_file_size: {local_file_size}")
         print(f"- canister_filesha256: {canister_filesha256}")
-        print(f"- local_file_sha256: {local_file_sha256}")
+        print(f"- expected_sha256: {expected_sha256}")
         sys.exit(1)
 
     print(
@@ -260,14 +386,14 @@ def main() -> int:
         canister_filesha256 = result["Ok"]["filesha256"]
 
         if (canister_filesize != local_file_size) or (
-            canister_filesha256 != local_file_sha256
+            canister_filesha256 != expected_sha256
         ):
             print(" ")
             print("ERROR - canister file metadata does not match the local file:")
             print(f"- canister_filesize: {canister_filesize}")
             print(f"- local_file_size: {local_file_size}")
             print(f"- canister_filesha256: {canister_filesha256}")
-            print(f"- local_file_sha256: {local_file_sha256}")
+            print(f"- expected_sha256: {expected_sha256}")
             sys.exit(1)
     else:
         print("Something went wrong:")
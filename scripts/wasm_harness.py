@@ -37,6 +37,28 @@ didc encode '(record { args = vec {"--model"; "models/tiny.gguf";} })' > /tmp/lo
 python -m scripts.wasm_harness build/llama_cpp_before_opt.wasm \
     --method 'canister_update load_model' --arg-hex-file /tmp/load.hex
 
+# Count the wasm instructions a method executes (wasmtime fuel, 1 unit per
+# instruction -- close to, but not identical with, the IC's metering). With
+# --fuel, ic0.performance_counter reports the same count to the canister:
+python -m scripts.wasm_harness build/llama_cpp_before_opt.wasm --fuel \
+    --method 'canister_update run_update' --arg-hex-file /tmp/run.hex
+
+Use --fuel to compare builds, e.g. before/after a kernel or graph change in the
+llama.cpp fork: run the same call on both wasms and diff the reported counts.
+
+--method / --arg-hex-file can be repeated: the calls run in order, in the same
+instance, so one harness run can upload a model, load it, and then run it. Each
+call reports its own count. With --n-layer, a --fuel run also reports the count
+per layer of the model. To get the cost of one layer for one token, without the
+fixed cost of a call (arg parsing, the prompt cache), run the same prompt twice
+with a different -n and divide the difference by the tokens and by n_layer:
+
+python -m scripts.wasm_harness build/llama_cpp_before_opt.wasm --fuel --n-layer 28 \
+    --method 'canister_update load_model' --arg-hex-file /tmp/load.hex \
+    --method 'canister_update run_update' --arg-hex-file /tmp/run_n1.hex \
+    --method 'canister_update new_chat' --arg-hex-file /tmp/new_chat.hex \
+    --method 'canister_update run_update' --arg-hex-file /tmp/run_n5.hex
+
 Note: methods that read a model file will fault on "file not found" unless you
 first upload one into the harness vFS (call file_upload_chunk the same way, with
 a candid blob arg). getenv-class faults surface at arg-parse, BEFORE any file
@@ -47,17 +69,33 @@ import argparse
 import binascii
 import ctypes
 import sys
-from typing import Any, Callable, Tuple
+from typing import Any, Callable, Optional, Tuple
 
 import wasmtime
 
+# Fuel given to a --fuel run. Far above the IC's 40B instruction limit per
+# update call, so the count is never cut short by the harness itself.
+FUEL_BUDGET = 10**15
+
+
+def fuel_used(store: wasmtime.Store) -> Optional[int]:
+    """Instructions executed so far, or None when fuel metering is off."""
+    try:
+        return FUEL_BUDGET - store.get_fuel()
+    except wasmtime.WasmtimeError:
+        return None
+
 
 def build_linker(
-    store: wasmtime.Store, module: wasmtime.Module, arg_bytes: bytes
+    store: wasmtime.Store, module: wasmtime.Module, message: dict[str, bytes]
 ) -> Tuple[wasmtime.Linker, bytearray]:
-    """Wire faithful ic0 host functions. Stable memory = a real bytearray."""
+    """Wire faithful ic0 host functions. Stable memory = a real bytearray.
+
+    message["arg"] is the candid arg of the current call; set it before each call.
+    """
     linker = wasmtime.Linker(store.engine)
     stable = bytearray()
+    fuel_off_warned = False
 
     # Memory is accessed via the Caller so it works during the start section
     # (which runs before instantiate() returns and before we hold a memory ref).
@@ -80,6 +118,21 @@ def build_linker(
 
     caller_principal = b"\x01"  # any non-anonymous principal; auth forced below
 
+    def performance_counter(_caller: Any, _counter_type: int) -> int:
+        # Without --fuel there is nothing to count. Say so once, instead of
+        # letting the canister log a 0 that looks like a measurement.
+        nonlocal fuel_off_warned
+        used = fuel_used(store)
+        if used is None:
+            if not fuel_off_warned:
+                sys.stderr.write(
+                    "=== WARNING: ic0.performance_counter called without --fuel: "
+                    "the canister sees 0 instructions ===\n"
+                )
+                fuel_off_warned = True
+            return 0
+        return used
+
     def debug_print(caller: Any, src: int, size: int) -> None:
         # Must NOT return a value. sys.stderr.write() returns an int (chars
         # written); as a *statement* here its result is discarded and the
@@ -109,9 +162,9 @@ def build_linker(
         ),
         # --- message context (realistic-ish values) ---
         "time": lambda c: 1753000000000000000,
-        "msg_arg_data_size": lambda c: len(arg_bytes),
+        "msg_arg_data_size": lambda c: len(message["arg"]),
         "msg_arg_data_copy": lambda c, dst, off, sz: write_mem(
-            c, dst, arg_bytes[off : off + sz]
+            c, dst, message["arg"][off : off + sz]
         ),
         "msg_caller_size": lambda c: len(caller_principal),
         "msg_caller_copy": lambda c, dst, off, sz: write_mem(
@@ -120,6 +173,8 @@ def build_linker(
         "is_controller": lambda c, src, sz: 1,  # force admin/controller auth to pass
         "msg_reply_data_append": lambda c, src, sz: None,
         "msg_reply": lambda c: None,
+        # --- instruction counter: wasmtime fuel (--fuel) ---
+        "performance_counter": performance_counter,
         # --- diagnostics ---
         "debug_print": debug_print,
         "trap": lambda c, src, sz: _do_trap(read_mem(c, src, sz) if sz else b""),
@@ -176,27 +231,56 @@ def main() -> None:
     )
     parser.add_argument(
         "--method",
+        action="append",
+        default=[],
         help="exported method to call, e.g. "
-        "'canister_update load_model' (default: just instantiate)",
+        "'canister_update load_model' (default: just instantiate); "
+        "repeat to call several methods in order",
     )
     parser.add_argument(
         "--arg-hex-file",
-        help="file with the hex candid arg (from `didc encode ...`)",
+        action="append",
+        default=[],
+        help="file with the hex candid arg (from `didc encode ...`); "
+        "one per --method, in the same order",
+    )
+    parser.add_argument(
+        "--fuel",
+        action="store_true",
+        help="count executed wasm instructions (wasmtime fuel) and report them",
+    )
+    parser.add_argument(
+        "--n-layer",
+        type=int,
+        default=0,
+        help="with --fuel: also report the instructions per layer of the model",
     )
     args = parser.parse_args()
-
-    arg_bytes = b""
-    if args.arg_hex_file:
-        with open(args.arg_hex_file, encoding="utf-8") as hexfile:
-            arg_bytes = binascii.unhexlify(hexfile.read().strip())
+    if len(args.arg_hex_file) > len(args.method):
+        parser.error("more --arg-hex-file than --method")
+    if args.n_layer and not args.fuel:
+        parser.error("--n-layer needs --fuel")
+
+    call_args = []
+    for i in range(len(args.method)):
+        arg_bytes = b""
+        if i < len(args.arg_hex_file):
+            with open(args.arg_hex_file[i], encoding="utf-8") as hexfile:
+                arg_bytes = binascii.unhexlify(hexfile.read().strip())
+        call_args.append(arg_bytes)
 
     cfg = wasmtime.Config()
     # wasmtime's type stubs omit this attribute, but it works at runtime and
     # gives fuller (named) backtraces.
     cfg.wasm_backtrace_details = True  # type: ignore[attr-defined]
+    if args.fuel:
+        cfg.consume_fuel = True
     store = wasmtime.Store(wasmtime.Engine(cfg))
+    if args.fuel:
+        store.set_fuel(FUEL_BUDGET)
     module = wasmtime.Module.from_file(store.engine, args.wasm)
-    linker, stable = build_linker(store, module, arg_bytes)
+    message = {"arg": b""}
+    linker, stable = build_linker(store, module, message)
 
     try:
         # Instantiation runs the wasm start section = the C++ ctors (post-wasi2ic).
@@ -206,13 +290,24 @@ def main() -> None:
             f"=== instantiated OK (ctors ran clean); stable pages: {pages} ===",
             file=sys.stderr,
         )
-        if args.method:
-            print(f"=== calling {args.method!r} ===", file=sys.stderr)
-            export = inst.exports(store)[args.method]
+        for method, arg_bytes in zip(args.method, call_args):
+            print(f"=== calling {method!r} ===", file=sys.stderr)
+            message["arg"] = arg_bytes
+            export = inst.exports(store)[method]
             assert isinstance(export, wasmtime.Func)
+            before = fuel_used(store)
             export(store)
-            print("=== method returned OK (no trap) ===")
-        else:
+            print(f"=== {method!r} returned OK (no trap) ===")
+            after = fuel_used(store)
+            if before is not None and after is not None:
+                used = after - before
+                print(f"=== instructions (fuel): {used:_} ===")
+                if args.n_layer:
+                    print(
+                        f"=== per layer ({args.n_layer} layers): "
+                        f"{used // args.n_layer:_} ==="
+                    )
+        if not args.method:
             print("=== OK (no method requested) ===")
     except Exception as exc:  # pylint: disable=broad-except
         print("=== TRAP ===")
@@ -0,0 +1,138 @@
+#include "allowed_tokens.h"
+
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "auth.h"
+#include "model_recipe.h"
+
+#include "llama.h"
+
+#include "ic_api.h"
+
+std::vector<uint64_t> allowed_token_ids; // empty = no restriction
+
+void set_allowed_tokens() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::vector<uint64_t> token_ids;
+  CandidTypeRecord r_in;
+  r_in.append("token_ids", CandidTypeVecNat64{&token_ids});
+  ic_api.from_wire(r_in);
+
+  // The ids are validated against the vocabulary of the loaded model in
+  // main_, at every run: the model may be (re)loaded after this call.
+  allowed_token_ids = token_ids;
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - "
+            << allowed_token_ids.size() << " allowed tokens" << std::endl;
+
+  // Keep the saved model recipe in sync, for reload_model
+  model_recipe_save_settings();
+
+  CandidTypeRecord status_code_record;
+  status_code_record.append("status_code", CandidTypeNat16{200});
+  ic_api.to_wire(CandidTypeVariant{"Ok", status_code_record});
+}
+
+void get_allowed_tokens() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  CandidTypeRecord r_out;
+  r_out.append("token_ids", CandidTypeVecNat64{allowed_token_ids});
+
+  ic_api.to_wire(CandidTypeVariant{"Ok", r_out});
+}
+
+// --- the sampler -------------------------------------------------------------
+
+struct AllowedTokensSampler {
+  std::vector<uint8_t> allowed; // by token id, n_vocab entries
+};
+
+static const char *allowed_tokens_sampler_name(const llama_sampler *) {
+  return "allowed-tokens";
+}
+
+static void allowed_tokens_sampler_apply(llama_sampler *smpl,
+                                         llama_token_data_array *cur_p) {
+  const auto *ctx = (const AllowedTokensSampler *)smpl->ctx;
+  // Keep the allowed candidates, in their order, so `sorted` stays valid.
+  size_t n_kept = 0;
+  for (size_t i = 0; i < cur_p->size; ++i) {
+    const llama_token id = cur_p->data[i].id;
+    if (id >= 0 && (size_t)id < ctx->allowed.size() && ctx->allowed[id]) {
+      cur_p->data[n_kept++] = cur_p->data[i];
+    }
+  }
+  cur_p->size = n_kept;
+  cur_p->selected = -1;
+}
+
+static llama_sampler *allowed_tokens_sampler_clone(const llama_sampler *smpl);
+
+static void allowed_tokens_sampler_free(llama_sampler *smpl) {
+  delete (AllowedTokensSampler *)smpl->ctx;
+}
+
+static llama_sampler_i allowed_tokens_sampler_i = {
+    /* .name   = */ allowed_tokens_sampler_name,
+    /* .accept = */ nullptr,
+    /* .apply  = */ allowed_tokens_sampler_apply,
+    /* .reset  = */ nullptr,
+    /* .clone  = */ allowed_tokens_sampler_clone,
+    /* .free   = */ allowed_tokens_sampler_free,
+};
+
+static llama_sampler *allowed_tokens_sampler_clone(const llama_sampler *smpl) {
+  const auto *ctx = (const AllowedTokensSampler *)smpl->ctx;
+  return llama_sampler_init(&allowed_tokens_sampler_i,
+                            new AllowedTokensSampler(*ctx));
+}
+
+llama_sampler *allowed_tokens_sampler_init(const llama_vocab *vocab,
+                                           std::string &error_msg) {
+  const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+  auto *ctx = new AllowedTokensSampler;
+  ctx->allowed.assign(n_vocab, 0);
+  for (const uint64_t id : allowed_token_ids) {
+    if (id >= (uint64_t)n_vocab) {
+      error_msg = std::format(
+          "{}: error: allowed token id {} is out of range (n_vocab = {})",
+          __func__, id, n_vocab);
+      delete ctx;
+      return nullptr;
+    }
+    ctx->allowed[id] = 1;
+  }
+  for (llama_token id = 0; id < n_vocab; ++id) {
+    if (llama_vocab_is_eog(vocab, id)) {
+      ctx->allowed[id] = 1;
+    }
+  }
+  return llama_sampler_init(&allowed_tokens_sampler_i, ctx);
+}
+
+void allowed_tokens_sampler_prepend(llama_sampler *chain,
+                                    llama_sampler *first) {
+  // The chain only appends: take the samplers out, and put them back after.
+  std::vector<llama_sampler *> rest;
+  while (llama_sampler_chain_n(chain) > 0) {
+    rest.push_back(llama_sampler_chain_remove(chain, 0));
+  }
+  llama_sampler_chain_add(chain, first);
+  for (llama_sampler *smpl : rest) {
+    llama_sampler_chain_add(chain, smpl);
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ic_api.h"
+#include "wasm_symbol.h"
+#include <string>
+#include <vector>
+
+// Restrict generation to an admin-provided token subset.
+// An empty list (default) means no restriction. When set, a sampler first in
+// the chain drops every other token from the candidates, so it can never be
+// generated, and the samplers after it only look at the allowed tokens.
+// End-of-generation tokens are always allowed, or generation could not stop.
+void set_allowed_tokens()
+    WASM_SYMBOL_EXPORTED("canister_update set_allowed_tokens");
+void get_allowed_tokens()
+    WASM_SYMBOL_EXPORTED("canister_query get_allowed_tokens");
+
+extern std::vector<uint64_t> allowed_token_ids;
+
+struct llama_sampler;
+struct llama_vocab;
+
+// The sampler that keeps only the allowed tokens (and end-of-generation ones)
+// in the candidates, in one pass over a bitmap of the vocabulary. Returns
+// nullptr, with an error message, when an allowed id is not in the vocabulary.
+llama_sampler *allowed_tokens_sampler_init(const llama_vocab *vocab,
+                                           std::string &error_msg);
+
+// Inserts `first` at the front of the sampler chain, which takes ownership.
+void allowed_tokens_sampler_prepend(llama_sampler *chain, llama_sampler *first);
@@ -4,16 +4,24 @@
 #include "cache_cleanup.h"
 
 #include "auth.h"
+#include "cache_index.h"
 #include "ic_api.h"
+#include "promptcache.h"
 #include "upload.h"
+#include "utils.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <limits>
 #include <optional>
+#include <string>
 #include <system_error>
+#include <tuple>
+#include <vector>
 
 // --- Defaults & bounds ---------------------------------------------------
 namespace {
@@ -27,6 +35,11 @@ constexpr uint64_t DEFAULT_MAX_FILES_PER_RUN = 256;
 
 constexpr uint64_t MAX_FILES_PER_RUN_FLOOR = 1;
 constexpr uint64_t MAX_FILES_PER_RUN_CEILING = 10'000;
+
+// Resume cursor + sweep progress + byte quotas, kept outside .canister_cache
+// so it is not indexed or swept itself. The filesystem lives in stable
+// memory, so this survives an upgrade.
+const std::string CACHE_CLEANUP_CURSOR_FILE = "cache_cleanup_cursor.dat";
 } // namespace
 
 // --- File-scope state (extern in cache_cleanup.h for native-test access) -
@@ -43,6 +56,19 @@ constexpr uint64_t MAX_FILES_PER_RUN_CEILING = 10'000;
 // the candid stats record: callers want "what did the last cleanup do?",
 // not "what is the lifetime total?". If a lifetime total is needed later,
 // add separate `g_cleanup_total_files_*` counters alongside.
+//
+// SWEEP progress (persisted in CACHE_CLEANUP_CURSOR_FILE):
+//   g_cleanup_cursor               — last index path examined; "" = start
+//   g_cleanup_sweeps_completed     — full passes over the index
+//   g_cleanup_sweep_runs           — ticks spent in the current sweep
+//   g_cleanup_sweep_files_examined — files examined in the current sweep
+//   g_cleanup_sweep_files_deleted  — files deleted in the current sweep
+//   g_cleanup_last_sweep_*         — the same, for the last completed sweep
+//
+// Byte quotas on the sessions/ files (0 = no quota) and what the most recent
+// run evicted to stay under them:
+//   g_cleanup_max_bytes_total, g_cleanup_max_bytes_per_principal
+//   g_cleanup_files_evicted, g_cleanup_bytes_evicted (LAST-RUN)
 uint64_t g_cleanup_runs = 0;
 uint64_t g_cleanup_files_examined = 0;
 uint64_t g_cleanup_files_deleted = 0;
@@ -52,9 +78,203 @@ uint64_t g_cleanup_period_ns = DEFAULT_PERIOD_NS;
 uint64_t g_cleanup_ttl_ns = DEFAULT_TTL_NS;
 uint64_t g_cleanup_max_files_per_run = DEFAULT_MAX_FILES_PER_RUN;
 uint64_t g_cleanup_timer_id = 0;
+std::string g_cleanup_cursor;
+uint64_t g_cleanup_sweeps_completed = 0;
+uint64_t g_cleanup_sweep_runs = 0;
+uint64_t g_cleanup_sweep_files_examined = 0;
+uint64_t g_cleanup_sweep_files_deleted = 0;
+uint64_t g_cleanup_last_sweep_runs = 0;
+uint64_t g_cleanup_last_sweep_files_examined = 0;
+uint64_t g_cleanup_last_sweep_files_deleted = 0;
+uint64_t g_cleanup_max_bytes_total = 0;
+uint64_t g_cleanup_max_bytes_per_principal = 0;
+uint64_t g_cleanup_files_evicted = 0;
+uint64_t g_cleanup_bytes_evicted = 0;
 
 namespace {
 
+bool g_cleanup_cursor_loaded = false;
+
+void write_u64_(std::ofstream &file, uint64_t value) {
+  file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+bool read_u64_(std::ifstream &file, uint64_t &value) {
+  file.read(reinterpret_cast<char *>(&value), sizeof(value));
+  return file.good();
+}
+
+void save_cursor_() {
+  std::ofstream file(CACHE_CLEANUP_CURSOR_FILE,
+                     std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open cache cleanup cursor file for writing"
+              << std::endl;
+    return;
+  }
+  write_u64_(file, g_cleanup_cursor.size());
+  file.write(g_cleanup_cursor.data(), g_cleanup_cursor.size());
+  write_u64_(file, g_cleanup_sweeps_completed);
+  write_u64_(file, g_cleanup_sweep_runs);
+  write_u64_(file, g_cleanup_sweep_files_examined);
+  write_u64_(file, g_cleanup_sweep_files_deleted);
+  write_u64_(file, g_cleanup_last_sweep_runs);
+  write_u64_(file, g_cleanup_last_sweep_files_examined);
+  write_u64_(file, g_cleanup_last_sweep_files_deleted);
+  write_u64_(file, g_cleanup_max_bytes_total);
+  write_u64_(file, g_cleanup_max_bytes_per_principal);
+}
+
+void ensure_cursor_loaded_() {
+  if (!g_cleanup_cursor_loaded) load_cache_cleanup_cursor();
+}
+
+// Examines the "sessions" entries of [first, last) in path order until
+// `budget` runs out. Moves g_cleanup_cursor along and returns the stale
+// paths; `at_end` tells whether `last` was reached.
+std::vector<std::string> scan_sessions_(CacheIndex::const_iterator first,
+                                        CacheIndex::const_iterator last,
+                                        uint64_t &budget, uint64_t &examined,
+                                        bool &at_end) {
+  using std::chrono::duration_cast;
+  using std::chrono::file_clock;
+  using std::chrono::nanoseconds;
+
+  std::vector<std::string> stale_paths;
+  const auto now_tp = file_clock::now();
+  at_end = false;
+  for (auto it = first;; ++it) {
+    if (it == last) {
+      at_end = true;
+      break;
+    }
+    const auto &[path, entry] = *it;
+    if (entry.category != "sessions") continue;
+    if (budget == 0) break;
+
+    --budget;
+    ++examined;
+    g_cleanup_cursor = path;
+
+    // Age in nanoseconds, computed in file_clock domain.
+    // Pattern mirrors src/files.cpp:276-281.
+    auto age_ns = duration_cast<nanoseconds>(now_tp.time_since_epoch() -
+                                             entry.mtime.time_since_epoch())
+                      .count();
+    bool stale =
+        (age_ns >= 0) && static_cast<uint64_t>(age_ns) >= g_cleanup_ttl_ns;
+    if (stale) {
+      stale_paths.push_back(path);
+    }
+  }
+  return stale_paths;
+}
+
+void remove_stale_(const std::vector<std::string> &stale_paths,
+                   uint64_t &deleted, uint64_t &failed) {
+  for (const std::string &file_path : stale_paths) {
+    // An upload still writing to it keeps an open stream: close it first
+    file_upload_close(file_path);
+    std::error_code ec_rm;
+    if (!std::filesystem::remove(file_path, ec_rm) || ec_rm) {
+      ++failed;
+    } else {
+      ++deleted;
+      // Pair the file-delete with metadata-delete. A false return means
+      // no metadata record matched (fine if upload tracking did not
+      // record this file). Best-effort: we do not escalate "no record"
+      // to ++failed.
+      (void)delete_file_metadata(file_path);
+    }
+    // Either way it is not there anymore (or it was already gone)
+    if (!std::filesystem::exists(file_path, ec_rm)) {
+      cache_index_note_remove(file_path);
+    }
+  }
+}
+
+// (last access, path, size) of a prompt cache, oldest access first
+using LruCache =
+    std::tuple<std::filesystem::file_time_type, std::string, uint64_t>;
+
+// The `limit` least recently used caches of `files`: a tick evicts no more,
+// so only those are sorted.
+std::vector<LruCache> lru_caches_(const CacheIndex &files, uint64_t limit) {
+  std::vector<LruCache> caches;
+  for (const auto &[path, entry] : files) {
+    if (entry.category != "sessions" || prompt_cache_is_stamp(path)) continue;
+    caches.emplace_back(entry.last_access, path, entry.size);
+  }
+  if (limit < caches.size()) {
+    std::partial_sort(caches.begin(), caches.begin() + limit, caches.end());
+    caches.resize(limit);
+  } else {
+    std::sort(caches.begin(), caches.end());
+  }
+  return caches;
+}
+
+// Evicts the least recently used caches of `caches` while `over_quota()`,
+// with their stamps, spending one unit of `budget` per cache.
+template <typename OverQuota>
+void evict_lru_(const std::vector<LruCache> &caches, OverQuota over_quota,
+                uint64_t &budget, uint64_t &evicted, uint64_t &bytes_evicted,
+                uint64_t &failed) {
+  for (const auto &[last_access, path, size] : caches) {
+    if (budget == 0 || !over_quota()) break;
+    --budget;
+
+    file_upload_close(path); // see remove_stale_
+    std::error_code ec_rm;
+    if (!std::filesystem::remove(path, ec_rm) || ec_rm) {
+      ++failed;
+    } else {
+      ++evicted;
+      bytes_evicted += size;
+      (void)delete_file_metadata(path);
+    }
+    if (!std::filesystem::exists(path, ec_rm)) {
+      cache_index_note_remove(path);
+      prompt_cache_remove_stamp(path);
+    }
+  }
+}
+
+// Per principal first, so that one heavy principal can not push the caches
+// of everybody else out of the global quota. Evicts at most `budget` caches;
+// the candidates are gathered only for a quota that is exceeded.
+void enforce_quotas_(uint64_t &budget, uint64_t &evicted,
+                     uint64_t &bytes_evicted, uint64_t &failed) {
+  if (budget == 0) return;
+
+  if (g_cleanup_max_bytes_per_principal > 0) {
+    for (const auto &[principal_id, bytes] :
+         cache_index_bytes_by_principal("sessions")) {
+      if (budget == 0) break;
+      if (bytes <= g_cleanup_max_bytes_per_principal) continue;
+      const std::string &p = principal_id;
+      evict_lru_(
+          lru_caches_(cache_index_files(p, "sessions"), budget),
+          [&p]() {
+            return cache_index_bytes(p, "sessions") >
+                   g_cleanup_max_bytes_per_principal;
+          },
+          budget, evicted, bytes_evicted, failed);
+    }
+  }
+
+  if (budget > 0 && g_cleanup_max_bytes_total > 0 &&
+      cache_index_total_bytes("sessions") > g_cleanup_max_bytes_total) {
+    evict_lru_(
+        lru_caches_(cache_index(), budget),
+        []() {
+          return cache_index_total_bytes("sessions") >
+                 g_cleanup_max_bytes_total;
+        },
+        budget, evicted, bytes_evicted, failed);
+  }
+}
+
 // Re-arm the recurring timer with the current g_cleanup_period_ns.
 // Caller must have first cancelled any existing timer (id stored in
 // g_cleanup_timer_id).
@@ -67,6 +287,7 @@ void arm_timer_() {
 // cache_cleanup_now and get_cache_cleanup_stats endpoints to construct
 // their return record consistently.
 CandidTypeRecord build_stats_record_() {
+  ensure_cursor_loaded_();
   CandidTypeRecord r;
   r.append("runs", CandidTypeNat64{g_cleanup_runs});
   r.append("files_examined", CandidTypeNat64{g_cleanup_files_examined});
@@ -77,15 +298,42 @@ CandidTypeRecord build_stats_record_() {
   r.append("ttl_seconds", CandidTypeNat64{g_cleanup_ttl_ns / NS_PER_SEC});
   r.append("max_files_per_run", CandidTypeNat64{g_cleanup_max_files_per_run});
   r.append("is_running", CandidTypeBool{g_cleanup_timer_id != 0});
+  r.append("sweeps_completed", CandidTypeNat64{g_cleanup_sweeps_completed});
+  r.append("sweep_runs", CandidTypeNat64{g_cleanup_sweep_runs});
+  r.append("sweep_files_examined",
+           CandidTypeNat64{g_cleanup_sweep_files_examined});
+  r.append("sweep_files_deleted",
+           CandidTypeNat64{g_cleanup_sweep_files_deleted});
+  r.append("last_sweep_runs", CandidTypeNat64{g_cleanup_last_sweep_runs});
+  r.append("last_sweep_files_examined",
+           CandidTypeNat64{g_cleanup_last_sweep_files_examined});
+  r.append("last_sweep_files_deleted",
+           CandidTypeNat64{g_cleanup_last_sweep_files_deleted});
+  r.append("cursor", CandidTypeText{g_cleanup_cursor});
+  r.append("max_bytes_total", CandidTypeNat64{g_cleanup_max_bytes_total});
+  r.append("max_bytes_per_principal",
+           CandidTypeNat64{g_cleanup_max_bytes_per_principal});
+  // Building the index walks all of .canister_cache, and in a query the
+  // result is thrown away: report 0 until an update call has built it.
+  r.append("bytes_total",
+           CandidTypeNat64{cache_index_is_built()
+                               ? cache_index_total_bytes("sessions")
+                               : 0});
+  r.append("files_evicted", CandidTypeNat64{g_cleanup_files_evicted});
+  r.append("bytes_evicted", CandidTypeNat64{g_cleanup_bytes_evicted});
   return r;
 }
 
 CandidTypeRecord build_config_record_() {
+  ensure_cursor_loaded_(); // the quotas
   CandidTypeRecord r;
   r.append("period_seconds", CandidTypeNat64{g_cleanup_period_ns / NS_PER_SEC});
   r.append("ttl_seconds", CandidTypeNat64{g_cleanup_ttl_ns / NS_PER_SEC});
   r.append("max_files_per_run", CandidTypeNat64{g_cleanup_max_files_per_run});
   r.append("is_running", CandidTypeBool{g_cleanup_timer_id != 0});
+  r.append("max_bytes_total", CandidTypeNat64{g_cleanup_max_bytes_total});
+  r.append("max_bytes_per_principal",
+           CandidTypeNat64{g_cleanup_max_bytes_per_principal});
   return r;
 }
 
@@ -98,128 +346,121 @@ CandidTypeRecord build_action_record_() {
 
 } // namespace
 
+// --- Resume cursor --------------------------------------------------------
+//
+// Read lazily on first use, by a timer tick or an update, so the sweep picks
+// up where it was before the upgrade, under the same quotas.
+bool load_cache_cleanup_cursor() {
+  g_cleanup_cursor_loaded = true;
+  std::ifstream file(CACHE_CLEANUP_CURSOR_FILE, std::ios::binary);
+  if (!file.is_open()) return false; // Never ran: start from the beginning
+
+  uint64_t size = 0;
+  if (!read_u64_(file, size) || size > MAX_FILENAME_SIZE) return false;
+  std::string cursor(size, '\0');
+  file.read(cursor.data(), size);
+  uint64_t v[7];
+  for (uint64_t &x : v) {
+    if (!read_u64_(file, x)) return false;
+  }
+  g_cleanup_cursor = cursor;
+  g_cleanup_sweeps_completed = v[0];
+  g_cleanup_sweep_runs = v[1];
+  g_cleanup_sweep_files_examined = v[2];
+  g_cleanup_sweep_files_deleted = v[3];
+  g_cleanup_last_sweep_runs = v[4];
+  g_cleanup_last_sweep_files_examined = v[5];
+  g_cleanup_last_sweep_files_deleted = v[6];
+
+  // The byte quotas, if they were saved (files of older versions end here)
+  uint64_t max_bytes_total = 0, max_bytes_per_principal = 0;
+  if (read_u64_(file, max_bytes_total) &&
+      read_u64_(file, max_bytes_per_principal)) {
+    g_cleanup_max_bytes_total = max_bytes_total;
+    g_cleanup_max_bytes_per_principal = max_bytes_per_principal;
+  }
+  return true;
+}
+
 // --- Cleanup body ---------------------------------------------------------
 //
-// Walks `.canister_cache/<principal>/sessions/` using two explicit levels of
-// non-recursive directory_iterator: outer over principal subdirectories,
-// inner over each principal's sessions/ files. The two-level walk maps 1:1
-// to the on-disk layout and is structurally clearer than a recursive walk
-// with a parent-dir-name filter.
+// Examines the `.canister_cache/<principal>/sessions/` files of the resident
+// cache index (cache_index.h), in path order, instead of walking the
+// directory tree: the size and mtime of every file are already in the heap.
 //
 // Age is computed in the host file_clock domain, NEVER mixed with
-// IC_API::time(). Bounded by g_cleanup_max_files_per_run; if we hit the
-// cap, the next tick continues from the start of the directory tree
-// (bounded repeated scanning, not cursor-based — acceptable for v1).
+// IC_API::time(). Bounded by g_cleanup_max_files_per_run. Each tick resumes
+// right after g_cleanup_cursor and, when it reaches the end of the index,
+// completes the sweep and wraps around to the start, stopping once it is
+// back where it started. Every tick therefore examines
+// min(files, cap) distinct files, and any ceil(files / cap) consecutive
+// ticks cover every file that existed throughout them.
+//
+// Then, if the sessions/ files of a principal or of all principals together
+// exceed their byte quota, the least recently used prompt caches are evicted
+// (with their stamps) until they fit. Examining and removing are bounded
+// separately: the TTL scan examines at most g_cleanup_max_files_per_run
+// files, and the stale files plus the evicted caches are at most that many
+// too. So the quotas are enforced however many files the cache holds. "Used"
+// is the last write, or the last load by main_ in an update call; a load in a
+// query call is not kept, like the rest of its state.
 void run_cache_cleanup_body() {
-  using std::chrono::duration_cast;
-  using std::chrono::file_clock;
-  using std::chrono::nanoseconds;
+  ensure_cursor_loaded_();
 
   uint64_t examined = 0, deleted = 0, failed = 0;
-
-  std::error_code ec_outer;
-  std::filesystem::directory_iterator outer(".canister_cache", ec_outer);
-  if (ec_outer) {
-    // No .canister_cache yet — fresh canister, first run.
-    ++g_cleanup_runs;
-    g_cleanup_files_examined = 0;
-    g_cleanup_files_deleted = 0;
-    g_cleanup_files_failed = 0;
-    g_cleanup_last_run_ns = IC_API::time();
-    std::string msg = "no .canister_cache directory yet — nothing to clean";
-    std::cout << "llama_cpp: " << std::string(__func__) << " - " << msg
-              << std::endl;
-    return;
+  uint64_t budget = g_cleanup_max_files_per_run;
+  const std::string start = g_cleanup_cursor;
+  ++g_cleanup_sweep_runs;
+
+  // Resume right after the cursor. Pick the stale files first: removing them
+  // updates the index.
+  bool at_end = false;
+  {
+    const CacheIndex &index = cache_index();
+    uint64_t n = 0, d = 0;
+    auto stale_paths =
+        scan_sessions_(start.empty() ? index.begin() : index.upper_bound(start),
+                       index.end(), budget, n, at_end);
+    remove_stale_(stale_paths, d, failed);
+    examined += n;
+    deleted += d;
+    g_cleanup_sweep_files_examined += n;
+    g_cleanup_sweep_files_deleted += d;
   }
 
-  const auto outer_end = std::filesystem::directory_iterator{};
-  for (; outer != outer_end && examined < g_cleanup_max_files_per_run;) {
-    const auto principal_path = outer->path();
-
-    std::error_code ec;
-    bool is_dir = outer->is_directory(ec);
-    if (ec || !is_dir) {
-      std::error_code adv_ec;
-      outer.increment(adv_ec);
-      if (adv_ec) break;
-      continue;
-    }
-
-    auto sessions_path = principal_path / "sessions";
-    std::error_code sess_ec;
-    if (!std::filesystem::is_directory(sessions_path, sess_ec) || sess_ec) {
-      std::error_code adv_ec;
-      outer.increment(adv_ec);
-      if (adv_ec) break;
-      continue;
-    }
-
-    std::error_code ec_inner;
-    std::filesystem::directory_iterator inner(sessions_path, ec_inner);
-    if (ec_inner) {
-      std::error_code adv_ec;
-      outer.increment(adv_ec);
-      if (adv_ec) break;
-      continue;
+  if (at_end) {
+    // Sweep complete
+    ++g_cleanup_sweeps_completed;
+    g_cleanup_last_sweep_runs = g_cleanup_sweep_runs;
+    g_cleanup_last_sweep_files_examined = g_cleanup_sweep_files_examined;
+    g_cleanup_last_sweep_files_deleted = g_cleanup_sweep_files_deleted;
+    g_cleanup_sweep_runs = 0;
+    g_cleanup_sweep_files_examined = 0;
+    g_cleanup_sweep_files_deleted = 0;
+    g_cleanup_cursor.clear();
+
+    // Spend what is left of the cap on the next sweep, up to where we started
+    if (!start.empty() && budget > 0) {
+      const CacheIndex &index = cache_index();
+      uint64_t n = 0, d = 0;
+      bool wrapped_to_start = false;
+      auto stale_paths = scan_sessions_(
+          index.begin(), index.upper_bound(start), budget, n, wrapped_to_start);
+      remove_stale_(stale_paths, d, failed);
+      examined += n;
+      deleted += d;
+      g_cleanup_sweep_files_examined += n;
+      g_cleanup_sweep_files_deleted += d;
+      if (n > 0) g_cleanup_sweep_runs = 1;
     }
-
-    const auto inner_end = std::filesystem::directory_iterator{};
-    for (; inner != inner_end && examined < g_cleanup_max_files_per_run;) {
-      const auto file_path = inner->path();
-
-      std::error_code ec_ftype;
-      bool is_file = inner->is_regular_file(ec_ftype);
-      if (ec_ftype || !is_file) {
-        std::error_code adv_ec;
-        inner.increment(adv_ec);
-        if (adv_ec) break;
-        continue;
-      }
-
-      ++examined;
-
-      std::error_code ec_mtime;
-      auto mtime = std::filesystem::last_write_time(file_path, ec_mtime);
-      if (ec_mtime) {
-        ++failed;
-        std::error_code adv_ec;
-        inner.increment(adv_ec);
-        if (adv_ec) break;
-        continue;
-      }
-
-      // Age in nanoseconds, computed in file_clock domain.
-      // Pattern mirrors src/files.cpp:276-281.
-      auto now_tp = file_clock::now();
-      auto age_ns = duration_cast<nanoseconds>(now_tp.time_since_epoch() -
-                                               mtime.time_since_epoch())
-                        .count();
-      bool stale =
-          (age_ns >= 0) && static_cast<uint64_t>(age_ns) >= g_cleanup_ttl_ns;
-
-      if (stale) {
-        std::error_code ec_rm;
-        if (!std::filesystem::remove(file_path, ec_rm) || ec_rm) {
-          ++failed;
-        } else {
-          ++deleted;
-          // Pair the file-delete with metadata-delete. A false return means
-          // no metadata record matched (fine if upload tracking did not
-          // record this file). Best-effort: we do not escalate "no record"
-          // to ++failed.
-          (void)delete_file_metadata(file_path.string());
-        }
-      }
-
-      std::error_code adv_ec;
-      inner.increment(adv_ec);
-      if (adv_ec) break;
-    }
-
-    std::error_code adv_ec;
-    outer.increment(adv_ec);
-    if (adv_ec) break;
   }
+  save_cursor_();
+
+  // Then the byte quotas, with the removals the stale files left (they are
+  // at most the files examined, so at most the cap)
+  uint64_t evicted = 0, bytes_evicted = 0;
+  uint64_t removals = g_cleanup_max_files_per_run - deleted - failed;
+  enforce_quotas_(removals, evicted, bytes_evicted, failed);
 
   ++g_cleanup_runs;
   // Last-run stats: assign, do not accumulate. Each invocation overwrites
@@ -228,14 +469,21 @@ void run_cache_cleanup_body() {
   g_cleanup_files_examined = examined;
   g_cleanup_files_deleted = deleted;
   g_cleanup_files_failed = failed;
+  g_cleanup_files_evicted = evicted;
+  g_cleanup_bytes_evicted = bytes_evicted;
   g_cleanup_last_run_ns = IC_API::time(); // reporting only, not for age math.
 
   std::string msg = "run #" + std::to_string(g_cleanup_runs) +
                     ": examined=" + std::to_string(examined) +
                     " deleted=" + std::to_string(deleted) +
                     " failed=" + std::to_string(failed) +
+                    " evicted=" + std::to_string(evicted) +
+                    " bytes_evicted=" + std::to_string(bytes_evicted) +
                     " ttl_s=" + std::to_string(g_cleanup_ttl_ns / NS_PER_SEC) +
-                    " cap=" + std::to_string(g_cleanup_max_files_per_run);
+                    " cap=" + std::to_string(g_cleanup_max_files_per_run) +
+                    " sweeps=" + std::to_string(g_cleanup_sweeps_completed) +
+                    " sweep_examined=" +
+                    std::to_string(g_cleanup_sweep_files_examined);
   std::cout << "llama_cpp: " << std::string(__func__) << " - " << msg
             << std::endl;
 }
@@ -380,3 +628,42 @@ void set_cache_cleanup_config() {
   ic_api.to_wire(
       CandidTypeVariant{"Ok", CandidTypeRecord{build_config_record_()}});
 }
+
+void set_cache_quota_config() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  // Load the saved quotas first, so that the lazy load does not undo these
+  ensure_cursor_loaded_();
+
+  // CacheQuotaConfigInput, each opt: null → no change, opt 0 → no quota
+  std::optional<uint64_t> opt_max_bytes_total;
+  std::optional<uint64_t> opt_max_bytes_per_principal;
+
+  CandidTypeRecord r_in;
+  r_in.append("max_bytes_total", CandidTypeOptNat64{&opt_max_bytes_total});
+  r_in.append("max_bytes_per_principal",
+              CandidTypeOptNat64{&opt_max_bytes_per_principal});
+  ic_api.from_wire(r_in);
+
+  if (opt_max_bytes_total.has_value()) {
+    g_cleanup_max_bytes_total = *opt_max_bytes_total;
+  }
+  if (opt_max_bytes_per_principal.has_value()) {
+    g_cleanup_max_bytes_per_principal = *opt_max_bytes_per_principal;
+  }
+  save_cursor_();
+
+  std::string msg =
+      "quotas updated; max_bytes_total=" +
+      std::to_string(g_cleanup_max_bytes_total) + " max_bytes_per_principal=" +
+      std::to_string(g_cleanup_max_bytes_per_principal);
+  std::cout << "llama_cpp: " << std::string(__func__) << " - " << msg
+            << std::endl;
+
+  ic_api.to_wire(
+      CandidTypeVariant{"Ok", CandidTypeRecord{build_config_record_()}});
+}
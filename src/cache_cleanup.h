@@ -1,20 +1,26 @@
 // Recurring prompt-cache cleanup timer.
 //
-// Walks `.canister_cache/<principal>/sessions/` on a configurable schedule
-// (default: every 10 minutes) and deletes files whose mtime is older than a
-// configurable TTL (default: 6 hours). Each tick is bounded by
-// `g_max_files_per_run` to stay under the IC's per-message instruction
-// budget; the next tick continues the cleanup.
+// Examines the `.canister_cache/<principal>/sessions/` files of the resident
+// cache index (cache_index.h) on a configurable schedule (default: every 10
+// minutes) and deletes files whose mtime is older than a configurable TTL
+// (default: 6 hours). When byte quotas are set (global and per principal),
+// it then evicts the least recently used prompt caches until they fit. Each
+// tick is bounded by `g_max_files_per_run` to stay under the IC's
+// per-message instruction budget; the next tick resumes from a cursor, so a
+// sweep over all files takes ceil(files / cap) ticks.
 //
 // Lifecycle is operator-driven: the timer is NOT auto-armed in
 // canister_init / canister_post_upgrade. The deploy/upgrade workflow must
 // explicitly call `cache_cleanup_start_timer` after the canister is
-// reachable. Timer state is in-memory only and does not survive an upgrade.
+// reachable. Timer state is in-memory only and does not survive an upgrade;
+// the resume cursor, sweep progress and byte quotas are saved to a file and
+// do.
 #pragma once
 
 #include "wasm_symbol.h"
 
 #include <cstdint>
+#include <string>
 
 // --- Endpoints ------------------------------------------------------------
 // Update endpoints — RBAC: has_admin_update_role required.
@@ -26,6 +32,8 @@ void cache_cleanup_now()
     WASM_SYMBOL_EXPORTED("canister_update cache_cleanup_now");
 void set_cache_cleanup_config()
     WASM_SYMBOL_EXPORTED("canister_update set_cache_cleanup_config");
+void set_cache_quota_config()
+    WASM_SYMBOL_EXPORTED("canister_update set_cache_quota_config");
 
 // Query endpoint — RBAC: has_admin_query_role required.
 void get_cache_cleanup_stats()
@@ -38,6 +46,10 @@ void get_cache_cleanup_stats()
 // IC_API frame). This function does NOT construct an IC_API instance.
 void run_cache_cleanup_body();
 
+// (Re)reads the resume cursor and sweep progress saved by the last run.
+// Called lazily on first use; returns false if nothing (valid) was saved.
+bool load_cache_cleanup_cursor();
+
 // --- Test introspection (extern for native tests) ------------------------
 // These are file-scope statics in cache_cleanup.cpp; they are exposed via
 // extern declarations here exclusively so native tests in
@@ -49,7 +61,13 @@ void run_cache_cleanup_body();
 //       g_cleanup_runs, g_cleanup_last_run_ns
 //   - LAST-RUN (overwritten on every cleanup invocation):
 //       g_cleanup_files_examined, g_cleanup_files_deleted,
-//       g_cleanup_files_failed
+//       g_cleanup_files_failed, g_cleanup_files_evicted,
+//       g_cleanup_bytes_evicted
+//   - SWEEP (persisted across upgrade):
+//       g_cleanup_cursor, g_cleanup_sweeps_completed, g_cleanup_sweep_*,
+//       g_cleanup_last_sweep_*
+//   - QUOTAS (persisted across upgrade, with the sweep):
+//       g_cleanup_max_bytes_total, g_cleanup_max_bytes_per_principal
 extern uint64_t g_cleanup_runs;
 extern uint64_t g_cleanup_files_examined;
 extern uint64_t g_cleanup_files_deleted;
@@ -59,3 +77,15 @@ extern uint64_t g_cleanup_period_ns;
 extern uint64_t g_cleanup_ttl_ns;
 extern uint64_t g_cleanup_max_files_per_run;
 extern uint64_t g_cleanup_timer_id;
+extern std::string g_cleanup_cursor;
+extern uint64_t g_cleanup_sweeps_completed;
+extern uint64_t g_cleanup_sweep_runs;
+extern uint64_t g_cleanup_sweep_files_examined;
+extern uint64_t g_cleanup_sweep_files_deleted;
+extern uint64_t g_cleanup_last_sweep_runs;
+extern uint64_t g_cleanup_last_sweep_files_examined;
+extern uint64_t g_cleanup_last_sweep_files_deleted;
+extern uint64_t g_cleanup_max_bytes_total;
+extern uint64_t g_cleanup_max_bytes_per_principal;
+extern uint64_t g_cleanup_files_evicted;
+extern uint64_t g_cleanup_bytes_evicted;
@@ -0,0 +1,196 @@
+// Resident index of the files in .canister_cache — implementation.
+// See cache_index.h for the high-level contract.
+
+#include "cache_index.h"
+
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+#include <vector>
+
+namespace {
+const std::string CACHE_ROOT = ".canister_cache";
+
+CacheIndex g_cache_index;
+bool g_cache_index_built = false;
+
+// category -> principal -> bytes of the indexed files
+std::map<std::string, std::map<std::string, uint64_t>> g_cache_bytes;
+
+void count_bytes(const CacheIndexEntry &entry, bool add) {
+  auto &by_principal = g_cache_bytes[entry.category];
+  uint64_t &bytes = by_principal[entry.principal_id];
+  if (add) {
+    bytes += entry.size;
+  } else {
+    bytes -= std::min(bytes, entry.size);
+    if (bytes == 0) by_principal.erase(entry.principal_id);
+  }
+}
+
+void erase_entry(const std::string &path) {
+  auto it = g_cache_index.find(path);
+  if (it == g_cache_index.end()) return;
+  count_bytes(it->second, false);
+  g_cache_index.erase(it);
+}
+
+// Splits .canister_cache/<principal>/<category>/<file>. Returns false for any
+// other shape.
+bool parse_cache_path(const std::string &path, std::string &normalized,
+                      std::string &principal_id, std::string &category) {
+  std::filesystem::path p = std::filesystem::path(path).lexically_normal();
+  std::vector<std::string> parts;
+  for (const auto &component : p) {
+    parts.push_back(component.string());
+  }
+  if (parts.size() != 4 || parts[0] != CACHE_ROOT) {
+    return false;
+  }
+  normalized = p.string();
+  principal_id = parts[1];
+  category = parts[2];
+  return true;
+}
+
+// Stats the file at an already parsed path into the index
+void index_file(const std::string &path, const std::string &principal_id,
+                const std::string &category) {
+  std::error_code ec;
+  CacheIndexEntry entry;
+  entry.principal_id = principal_id;
+  entry.category = category;
+  entry.size = std::filesystem::file_size(path, ec);
+  erase_entry(path);
+  if (ec) {
+    return; // gone, or not a regular file
+  }
+  entry.mtime = std::filesystem::last_write_time(path, ec);
+  entry.last_access = entry.mtime;
+  count_bytes(entry, true);
+  g_cache_index[path] = std::move(entry);
+}
+
+// The one walk: two levels of directories, then the files
+void build_cache_index() {
+  g_cache_index.clear();
+  g_cache_bytes.clear();
+  g_cache_index_built = true;
+
+  std::error_code ec;
+  for (const auto &principal :
+       std::filesystem::directory_iterator(CACHE_ROOT, ec)) {
+    if (!principal.is_directory(ec)) continue;
+    for (const auto &category :
+         std::filesystem::directory_iterator(principal.path(), ec)) {
+      if (!category.is_directory(ec)) continue;
+      for (const auto &file :
+           std::filesystem::directory_iterator(category.path(), ec)) {
+        if (!file.is_regular_file(ec)) continue;
+        index_file(file.path().lexically_normal().string(),
+                   principal.path().filename().string(),
+                   category.path().filename().string());
+      }
+    }
+  }
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - indexed "
+            << g_cache_index.size() << " files in " << CACHE_ROOT
+            << std::endl;
+}
+} // namespace
+
+const CacheIndex &cache_index() {
+  if (!g_cache_index_built) {
+    build_cache_index();
+  }
+  return g_cache_index;
+}
+
+bool cache_index_is_built() { return g_cache_index_built; }
+
+void cache_index_note_write(const std::string &path) {
+  if (!g_cache_index_built) {
+    return; // the walk on first use will see it
+  }
+  std::string normalized, principal_id, category;
+  if (parse_cache_path(path, normalized, principal_id, category)) {
+    index_file(normalized, principal_id, category);
+    auto it = g_cache_index.find(normalized);
+    if (it != g_cache_index.end()) {
+      it->second.last_access = std::filesystem::file_time_type::clock::now();
+    }
+  }
+}
+
+void cache_index_note_remove(const std::string &path) {
+  if (!g_cache_index_built) {
+    return;
+  }
+  std::string normalized, principal_id, category;
+  if (parse_cache_path(path, normalized, principal_id, category)) {
+    erase_entry(normalized);
+  }
+}
+
+void cache_index_note_access(const std::string &path) {
+  if (!g_cache_index_built) {
+    return; // the entry is not there yet: its mtime stands in
+  }
+  std::string normalized, principal_id, category;
+  if (parse_cache_path(path, normalized, principal_id, category)) {
+    auto it = g_cache_index.find(normalized);
+    if (it != g_cache_index.end()) {
+      it->second.last_access = std::filesystem::file_time_type::clock::now();
+    }
+  }
+}
+
+std::map<std::string, CacheIndexEntry>
+cache_index_files(const std::string &principal_id,
+                  const std::string &category) {
+  const CacheIndex &index = cache_index();
+  const std::string prefix = CACHE_ROOT + "/" + principal_id + "/" + category +
+                             "/";
+  std::map<std::string, CacheIndexEntry> files;
+  for (auto it = index.lower_bound(prefix);
+       it != index.end() && it->first.starts_with(prefix); ++it) {
+    files.insert(*it);
+  }
+  return files;
+}
+
+uint64_t cache_index_bytes(const std::string &principal_id,
+                           const std::string &category) {
+  cache_index();
+  auto by_category = g_cache_bytes.find(category);
+  if (by_category == g_cache_bytes.end()) return 0;
+  auto by_principal = by_category->second.find(principal_id);
+  if (by_principal == by_category->second.end()) return 0;
+  return by_principal->second;
+}
+
+uint64_t cache_index_total_bytes(const std::string &category) {
+  cache_index();
+  auto by_category = g_cache_bytes.find(category);
+  if (by_category == g_cache_bytes.end()) return 0;
+  uint64_t total = 0;
+  for (const auto &[principal_id, bytes] : by_category->second) {
+    total += bytes;
+  }
+  return total;
+}
+
+std::map<std::string, uint64_t>
+cache_index_bytes_by_principal(const std::string &category) {
+  cache_index();
+  auto by_category = g_cache_bytes.find(category);
+  if (by_category == g_cache_bytes.end()) return {};
+  return by_category->second;
+}
+
+void cache_index_reset() {
+  g_cache_index.clear();
+  g_cache_bytes.clear();
+  g_cache_index_built = false;
+}
@@ -0,0 +1,71 @@
+// Resident index of the files in .canister_cache.
+//
+// The cache holds one file per prompt cache, and the saved chats:
+//   .canister_cache/<principal>/sessions/<file>
+//   .canister_cache/<principal>/db_chats/<file>  (chats.log, see chat_log.h)
+//   .canister_cache/<principal>/lora/<file>      (selection.dat, see lora.h)
+// Walking it with directory iterators goes through the polyfilled filesystem
+// on every call, and costs more as the cache grows. Instead, this module keeps
+// every such file in the heap, ordered by path, with its size and mtime:
+//  - the code that writes or removes a file reports it here
+//    (cache_index_note_write / cache_index_note_remove)
+//  - the index is built with one walk on first use, so it is rebuilt after an
+//    upgrade, which starts with an empty heap
+//  - main_ reports the session files it reads (cache_index_note_access), so
+//    the index knows which prompt caches are hot
+// A principal's files are then a range lookup instead of a directory walk.
+//
+// Files written without going through the canister (e.g. by a native test
+// fixture) are reported with cache_index_note_write, or picked up with
+// cache_index_reset, which rebuilds the index on next use.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+struct CacheIndexEntry {
+  std::string principal_id;
+  std::string category; // "sessions", "db_chats" or "lora"
+  uint64_t size = 0;
+  // As reported by last_write_time. NOTE: on the IC, this is the creation time
+  std::filesystem::file_time_type mtime;
+  // Last time the canister wrote or read the file; the mtime until then, so
+  // right after an upgrade this is the creation time again.
+  std::filesystem::file_time_type last_access;
+};
+
+// path -> entry, for every .canister_cache/<principal>/<category>/<file>
+using CacheIndex = std::map<std::string, CacheIndexEntry>;
+
+// The index, built on first use.
+const CacheIndex &cache_index();
+// Whether the index is built, i.e. whether cache_index() costs no walk.
+bool cache_index_is_built();
+
+// Report a file that was written, or whose size or mtime changed. Paths
+// outside .canister_cache/<principal>/<category>/ are ignored.
+void cache_index_note_write(const std::string &path);
+// Report a file that was removed.
+void cache_index_note_remove(const std::string &path);
+// Report a file that was read, e.g. a prompt cache loaded by main_.
+void cache_index_note_access(const std::string &path);
+
+// The files of one principal in one category, in path order: an O(log n)
+// lookup plus the files returned.
+std::map<std::string, CacheIndexEntry>
+cache_index_files(const std::string &principal_id, const std::string &category);
+
+// Bytes held by one principal in one category, and by all principals in one
+// category. Kept up to date as files are noted, so no file is visited.
+uint64_t cache_index_bytes(const std::string &principal_id,
+                           const std::string &category);
+uint64_t cache_index_total_bytes(const std::string &category);
+// principal -> bytes, for every principal with files in `category`
+std::map<std::string, uint64_t>
+cache_index_bytes_by_principal(const std::string &category);
+
+// Forget the index: it is rebuilt from the filesystem on next use.
+void cache_index_reset();
@@ -0,0 +1,15 @@
+// canister_init & canister_post_upgrade
+//
+// They load the persisted state that queries read into the heap, once. A query
+// cannot do it lazily: its heap changes are discarded, so every query would
+// load it again.
+//
+// Nothing is armed or replayed here: the timers and reload_model stay
+// operator-driven (see cache_cleanup.h & model_recipe.h).
+#include "canister.h"
+
+#include "upload.h"
+
+void canister_init() { load_file_metadata_store(); }
+
+void canister_post_upgrade() { load_file_metadata_store(); }
@@ -0,0 +1,7 @@
+// Canister lifecycle hooks
+#pragma once
+
+#include "wasm_symbol.h"
+
+void canister_init() WASM_SYMBOL_EXPORTED("canister_init");
+void canister_post_upgrade() WASM_SYMBOL_EXPORTED("canister_post_upgrade");
@@ -0,0 +1,490 @@
+// Append-only log of the saved chats of each principal — implementation.
+// See chat_log.h for the high-level contract.
+
+#include "chat_log.h"
+
+#include "cache_index.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <system_error>
+
+namespace {
+const std::string CHAT_LOG_FILENAME = "chats.log";
+const std::string CHAT_LOG_MAGIC = "icppchat"; // followed by the principal id
+
+// type (1 byte), chat id, payload length, content hash
+constexpr uint64_t RECORD_HEADER_SIZE = 1 + 3 * sizeof(uint64_t);
+
+// Compact once deleted chats take more room than the live ones, and at least
+constexpr uint64_t COMPACT_MIN_DEAD_BYTES = 64 * 1024;
+
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+struct ChatLogIndex {
+  uint64_t size = 0; // bytes in the log; 0 = no log yet
+  uint64_t next_id = 1;
+  std::map<uint64_t, ChatLogChat> chats;
+};
+
+// principal -> index of its log, built on first use
+std::map<std::string, ChatLogIndex> g_chat_logs;
+
+uint64_t fnv1a(uint64_t hash, const char *data, uint64_t size) {
+  for (uint64_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+std::string chat_log_dir(const std::string &principal_id) {
+  return ".canister_cache/" + principal_id + "/db_chats";
+}
+
+std::string chat_log_path(const std::string &principal_id) {
+  return chat_log_dir(principal_id) + "/" + CHAT_LOG_FILENAME;
+}
+
+void write_u64(std::ofstream &file, uint64_t value) {
+  file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+bool read_u64(std::ifstream &file, uint64_t &value) {
+  file.read(reinterpret_cast<char *>(&value), sizeof(value));
+  return file.good();
+}
+
+void write_header(std::ofstream &file, const std::string &principal_id) {
+  file.write(CHAT_LOG_MAGIC.data(), CHAT_LOG_MAGIC.size());
+  write_u64(file, principal_id.size());
+  file.write(principal_id.data(), principal_id.size());
+}
+
+void write_record(std::ofstream &file, char type, uint64_t id,
+                  const std::string &payload, uint64_t hash) {
+  file.write(&type, 1);
+  write_u64(file, id);
+  write_u64(file, payload.size());
+  write_u64(file, hash);
+  file.write(payload.data(), payload.size());
+}
+
+// Applies one record, whose payload is at `offset`, to the index
+void apply_record(ChatLogIndex &index, char type, uint64_t id, uint64_t offset,
+                  uint64_t length, uint64_t hash,
+                  const std::string &timestamp) {
+  switch (type) {
+  case 'N': {
+    ChatLogChat &chat = index.chats[id];
+    chat = ChatLogChat{};
+    chat.id = id;
+    chat.timestamp = timestamp;
+    chat.hash = FNV_OFFSET_BASIS;
+    index.next_id = std::max(index.next_id, id + 1);
+    break;
+  }
+  case 'A':
+  case 'S': {
+    auto it = index.chats.find(id);
+    if (it == index.chats.end()) break;
+    ChatLogChat &chat = it->second;
+    if (type == 'S') {
+      chat.ranges.clear();
+      chat.length = 0;
+    }
+    if (length > 0) chat.ranges.emplace_back(offset, length);
+    chat.length += length;
+    chat.hash = hash;
+    break;
+  }
+  case 'D':
+    index.chats.erase(id);
+    break;
+  }
+}
+
+// Reads the record headers of the log into the index; the payloads are only
+// read for 'N' records (the timestamp).
+bool load_index(const std::string &principal_id, ChatLogIndex &index,
+                std::string &error_msg) {
+  const std::string path = chat_log_path(principal_id);
+  std::error_code ec;
+  if (!std::filesystem::exists(path, ec)) {
+    return true; // Nothing saved yet
+  }
+  const uint64_t file_size = std::filesystem::file_size(path, ec);
+  std::ifstream file(path, std::ios::binary);
+  if (ec || !file.is_open()) {
+    error_msg = std::string(__func__) + ": Failed to open file: " + path;
+    return false;
+  }
+
+  std::string magic(CHAT_LOG_MAGIC.size(), '\0');
+  file.read(magic.data(), magic.size());
+  uint64_t size = 0;
+  if (!file.good() || magic != CHAT_LOG_MAGIC || !read_u64(file, size) ||
+      size > MAX_FILENAME_SIZE) {
+    error_msg = std::string(__func__) + ": Corrupted chat log: " + path;
+    return false;
+  }
+  std::string file_principal_id(size, '\0');
+  file.read(file_principal_id.data(), size);
+  if (file_principal_id != principal_id) {
+    error_msg = std::string(__func__) +
+                ": Principal id not correct in file: " + path;
+    return false;
+  }
+
+  uint64_t offset = CHAT_LOG_MAGIC.size() + sizeof(uint64_t) + size;
+  while (offset + RECORD_HEADER_SIZE <= file_size) {
+    char type = 0;
+    uint64_t id = 0, length = 0, hash = 0;
+    file.seekg(offset);
+    file.read(&type, 1);
+    if (!file.good() || !read_u64(file, id) || !read_u64(file, length) ||
+        !read_u64(file, hash)) {
+      break;
+    }
+    const uint64_t payload_offset = offset + RECORD_HEADER_SIZE;
+    if (length > file_size - payload_offset) {
+      break; // a record cut short
+    }
+
+    std::string timestamp;
+    if (type == 'N') {
+      if (length > MAX_FILENAME_SIZE) {
+        error_msg = std::string(__func__) + ": Corrupted chat log: " + path;
+        return false;
+      }
+      timestamp.resize(length);
+      file.read(timestamp.data(), length);
+    } else if (type != 'A' && type != 'S' && type != 'D') {
+      error_msg = std::string(__func__) + ": Corrupted chat log: " + path;
+      return false;
+    }
+    apply_record(index, type, id, payload_offset, length, hash, timestamp);
+    offset = payload_offset + length;
+  }
+
+  if (offset < file_size) {
+    // Drop the record that was cut short, so the next append starts right
+    std::filesystem::resize_file(path, offset, ec);
+    cache_index_note_write(path);
+  }
+  index.size = offset;
+  return true;
+}
+
+bool append_record(const std::string &principal_id, ChatLogIndex &index,
+                   char type, uint64_t id, const std::string &payload,
+                   uint64_t hash, std::string &error_msg) {
+  const std::string path = chat_log_path(principal_id);
+  if (!my_create_directory(chat_log_dir(principal_id), error_msg)) {
+    return false;
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::app);
+  if (!file.is_open()) {
+    error_msg = std::string(__func__) + ": Failed to open file: " + path;
+    return false;
+  }
+  if (index.size == 0) {
+    write_header(file, principal_id);
+    index.size = CHAT_LOG_MAGIC.size() + sizeof(uint64_t) + principal_id.size();
+  }
+  write_record(file, type, id, payload, hash);
+  file.close();
+  if (!file) {
+    error_msg = std::string(__func__) + ": Error writing to file - " + path;
+    return false;
+  }
+
+  const uint64_t payload_offset = index.size + RECORD_HEADER_SIZE;
+  index.size = payload_offset + payload.size();
+  apply_record(index, type, id, payload_offset, payload.size(), hash,
+               type == 'N' ? payload : std::string());
+  cache_index_note_write(path);
+  return true;
+}
+
+bool read_chat(const std::string &principal_id, const ChatLogChat &chat,
+               std::string &content, std::string &error_msg) {
+  const std::string path = chat_log_path(principal_id);
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    error_msg = std::string(__func__) + ": Failed to open file: " + path;
+    return false;
+  }
+  content.clear();
+  content.reserve(chat.length);
+  for (const auto &[offset, length] : chat.ranges) {
+    const uint64_t start = content.size();
+    content.resize(start + length);
+    file.seekg(offset);
+    file.read(content.data() + start, length);
+    if (!file.good()) {
+      error_msg = std::string(__func__) + ": Error reading file - " + path;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Chats of the one-file-per-chat layout: the principal id on the first line,
+// then the conversation. Returned oldest first, so the newest stays latest.
+// Without a cache index yet (a query), the folder is read instead of building
+// the index for all of .canister_cache.
+std::vector<std::pair<std::filesystem::file_time_type, std::string>>
+legacy_chat_files(const std::string &principal_id) {
+  std::vector<std::pair<std::filesystem::file_time_type, std::string>> files;
+  auto add = [&files](const std::string &path,
+                      std::filesystem::file_time_type mtime) {
+    if (!std::filesystem::path(path).filename().string().starts_with(
+            CHAT_LOG_FILENAME)) {
+      files.emplace_back(mtime, path);
+    }
+  };
+  if (cache_index_is_built()) {
+    for (const auto &[path, entry] :
+         cache_index_files(principal_id, "db_chats")) {
+      add(path, entry.mtime);
+    }
+  } else {
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(
+             chat_log_dir(principal_id), ec)) {
+      if (!entry.is_regular_file(ec)) continue;
+      add(entry.path().string(), entry.last_write_time(ec));
+    }
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// Lists the legacy chats after those of `index`, with the ids the import
+// will give them, without writing anything.
+void list_legacy_chats(const std::string &principal_id,
+                       const ChatLogIndex &index,
+                       std::vector<ChatLogChat> &chats) {
+  uint64_t id = index.next_id;
+  for (const auto &[mtime, path] : legacy_chat_files(principal_id)) {
+    std::error_code ec;
+    const uint64_t size = std::filesystem::file_size(path, ec);
+    const uint64_t header = principal_id.size() + 1;
+    ChatLogChat chat;
+    chat.id = id++;
+    chat.timestamp = std::filesystem::path(path).filename().string();
+    chat.length = !ec && size > header ? size - header : 0;
+    chat.legacy_path = path;
+    chats.push_back(chat);
+  }
+}
+
+// Reads a chat of the legacy layout, checking the principal id on its first
+// line
+bool read_legacy_chat(const std::string &principal_id, const std::string &path,
+                      std::string &chat, std::string &error_msg) {
+  std::ifstream ifs(path);
+  if (!ifs.is_open()) {
+    error_msg = std::string(__func__) + ": Failed to open file: " + path;
+    return false;
+  }
+  std::string file_principal_id;
+  std::getline(ifs, file_principal_id);
+  if (file_principal_id != principal_id) {
+    error_msg =
+        std::string(__func__) + ": Principal id not correct in file: " + path;
+    return false;
+  }
+  chat.assign(std::istreambuf_iterator<char>(ifs),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool import_legacy_chats(const std::string &principal_id, ChatLogIndex &index,
+                         std::string &error_msg) {
+  for (const auto &[mtime, path] : legacy_chat_files(principal_id)) {
+    std::string chat;
+    if (!read_legacy_chat(principal_id, path, chat, error_msg)) return false;
+
+    const uint64_t id = index.next_id;
+    const std::string timestamp =
+        std::filesystem::path(path).filename().string();
+    if (!append_record(principal_id, index, 'N', id, timestamp,
+                       FNV_OFFSET_BASIS, error_msg) ||
+        !append_record(principal_id, index, 'S', id, chat,
+                       fnv1a(FNV_OFFSET_BASIS, chat.data(), chat.size()),
+                       error_msg)) {
+      return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    cache_index_note_remove(path);
+    std::cout << "llama_cpp: " << std::string(__func__) << " - "
+              << "Imported into " << CHAT_LOG_FILENAME << ": " << path
+              << std::endl;
+  }
+  return true;
+}
+
+ChatLogIndex *get_index(const std::string &principal_id,
+                        std::string &error_msg) {
+  auto it = g_chat_logs.find(principal_id);
+  if (it != g_chat_logs.end()) return &it->second;
+
+  ChatLogIndex index;
+  if (!load_index(principal_id, index, error_msg)) return nullptr;
+  ChatLogIndex &loaded = g_chat_logs[principal_id] = std::move(index);
+  if (!import_legacy_chats(principal_id, loaded, error_msg)) {
+    g_chat_logs.erase(principal_id);
+    return nullptr;
+  }
+  return &loaded;
+}
+
+// Rewrites the log with the live chats only, as one 'N' + 'S' each
+bool compact(const std::string &principal_id, ChatLogIndex &index,
+             std::string &error_msg) {
+  const std::string path = chat_log_path(principal_id);
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      error_msg = std::string(__func__) + ": Failed to open file: " + tmp_path;
+      return false;
+    }
+    write_header(file, principal_id);
+    for (const auto &[id, chat] : index.chats) {
+      std::string content;
+      if (!read_chat(principal_id, chat, content, error_msg)) return false;
+      write_record(file, 'N', id, chat.timestamp, FNV_OFFSET_BASIS);
+      write_record(file, 'S', id, content, chat.hash);
+    }
+    file.close();
+    if (!file) {
+      error_msg = std::string(__func__) + ": Error writing to file - " +
+                  tmp_path;
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    error_msg = std::string(__func__) + ": Error renaming " + tmp_path +
+                ": " + ec.message();
+    return false;
+  }
+  cache_index_note_write(path);
+
+  // The offsets moved: read the new headers
+  const uint64_t next_id = index.next_id;
+  index = ChatLogIndex{};
+  if (!load_index(principal_id, index, error_msg)) {
+    g_chat_logs.erase(principal_id);
+    return false;
+  }
+  index.next_id = std::max(index.next_id, next_id);
+  return true;
+}
+} // namespace
+
+bool chat_log_new(const std::string &principal_id, const std::string &timestamp,
+                  std::string &error_msg) {
+  ChatLogIndex *index = get_index(principal_id, error_msg);
+  if (index == nullptr) return false;
+  return append_record(principal_id, *index, 'N', index->next_id, timestamp,
+                       FNV_OFFSET_BASIS, error_msg);
+}
+
+bool chat_log_save(const std::string &principal_id,
+                   const std::string &conversation, std::string &error_msg) {
+  ChatLogIndex *index = get_index(principal_id, error_msg);
+  if (index == nullptr) return false;
+  if (index->chats.empty()) {
+    error_msg = std::string(__func__) + ": No chats found";
+    return false;
+  }
+  const ChatLogChat &chat = index->chats.rbegin()->second;
+
+  // Usually the conversation is what was saved plus this turn
+  if (conversation.size() >= chat.length &&
+      fnv1a(FNV_OFFSET_BASIS, conversation.data(), chat.length) == chat.hash) {
+    if (conversation.size() == chat.length) return true; // nothing new
+    const std::string delta = conversation.substr(chat.length);
+    return append_record(principal_id, *index, 'A', chat.id, delta,
+                         fnv1a(chat.hash, delta.data(), delta.size()),
+                         error_msg);
+  }
+  return append_record(
+      principal_id, *index, 'S', chat.id, conversation,
+      fnv1a(FNV_OFFSET_BASIS, conversation.data(), conversation.size()),
+      error_msg);
+}
+
+bool chat_log_keep_latest(const std::string &principal_id, uint64_t max_chats,
+                          std::string &error_msg) {
+  ChatLogIndex *index = get_index(principal_id, error_msg);
+  if (index == nullptr) return false;
+  while (index->chats.size() > max_chats) {
+    const uint64_t id = index->chats.begin()->first;
+    if (!append_record(principal_id, *index, 'D', id, "", 0, error_msg)) {
+      return false;
+    }
+    std::cout << "llama_cpp: " << std::string(__func__) << " - "
+              << "Deleted chat " << id << " of " << principal_id << std::endl;
+  }
+
+  uint64_t live_bytes = 0;
+  for (const auto &[id, chat] : index->chats) {
+    live_bytes += 2 * RECORD_HEADER_SIZE + chat.timestamp.size() + chat.length;
+  }
+  const uint64_t dead_bytes = index->size > live_bytes ? index->size - live_bytes
+                                                       : 0;
+  if (dead_bytes > live_bytes && dead_bytes > COMPACT_MIN_DEAD_BYTES) {
+    return compact(principal_id, *index, error_msg);
+  }
+  return true;
+}
+
+bool chat_log_chats(const std::string &principal_id,
+                    std::vector<ChatLogChat> &chats, std::string &error_msg,
+                    bool import_legacy) {
+  const ChatLogIndex *index = nullptr;
+  ChatLogIndex log_only;
+  if (import_legacy || g_chat_logs.contains(principal_id)) {
+    index = get_index(principal_id, error_msg);
+    if (index == nullptr) return false;
+  } else {
+    // Not kept: the update call that builds the index also imports. Until
+    // then, the legacy chats are listed read-only.
+    if (!load_index(principal_id, log_only, error_msg)) return false;
+    index = &log_only;
+  }
+  chats.clear();
+  for (const auto &[id, chat] : index->chats) {
+    chats.push_back(chat);
+  }
+  if (index == &log_only) {
+    list_legacy_chats(principal_id, log_only, chats);
+  }
+  return true;
+}
+
+bool chat_log_read(const std::string &principal_id, const ChatLogChat &chat,
+                   std::string &content, std::string &error_msg) {
+  if (!chat.legacy_path.empty()) {
+    return read_legacy_chat(principal_id, chat.legacy_path, content,
+                            error_msg);
+  }
+  return read_chat(principal_id, chat, content, error_msg);
+}
+
+void chat_log_reset() { g_chat_logs.clear(); }
@@ -0,0 +1,67 @@
+// Append-only log of the saved chats of each principal.
+//
+// Instead of one file per chat that is rewritten after every turn, all chats
+// of a principal live in one log, .canister_cache/<principal>/db_chats/chats.log:
+//  - a header with the principal id, then records of
+//    (type, chat id, length, content hash) + payload
+//  - 'N' starts a chat (payload: its timestamp), 'A' appends to it, 'S' sets
+//    its whole content, 'D' deletes it
+// A turn is saved as one 'A' record holding only what the conversation grew
+// by since the last save. When the conversation no longer starts with what was
+// saved (the content hash does not match), the turn is an 'S' record instead.
+//
+// Each principal's log has a small heap index: chat id -> the (offset, length)
+// ranges of its content. It is built from the record headers on first use, so
+// it is rebuilt after an upgrade without reading any chat. Deleted chats are
+// dropped from the log by a compaction once they take more room than the live
+// ones.
+//
+// Chat files of the older one-file-per-chat layout found next to the log are
+// imported into it on first use in an update call, and removed.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ChatLogChat {
+  uint64_t id = 0;
+  std::string timestamp;
+  uint64_t length = 0; // bytes of content
+  uint64_t hash = 0;   // FNV-1a of the content
+  // (offset, length) of the pieces of the content in the log, in order
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  // A chat file of the legacy layout, not imported yet: the content is read
+  // from there instead. "" = the chat is in the log.
+  std::string legacy_path;
+};
+
+// Starts a new chat, which becomes the latest one.
+bool chat_log_new(const std::string &principal_id, const std::string &timestamp,
+                  std::string &error_msg);
+
+// Saves the conversation as the content of the latest chat, by appending
+// only what it grew by.
+bool chat_log_save(const std::string &principal_id,
+                   const std::string &conversation, std::string &error_msg);
+
+// Deletes all but the `max_chats` latest chats.
+bool chat_log_keep_latest(const std::string &principal_id, uint64_t max_chats,
+                          std::string &error_msg);
+
+// The live chats, oldest first.
+// A query call passes import_legacy = false: its writes are rolled back, so
+// every query would import the legacy chats again. The legacy chats are then
+// listed read-only after those of the log, with the ids the import will give
+// them, until an update call imports them.
+bool chat_log_chats(const std::string &principal_id,
+                    std::vector<ChatLogChat> &chats, std::string &error_msg,
+                    bool import_legacy = true);
+
+// Reads the content of a chat returned by chat_log_chats.
+bool chat_log_read(const std::string &principal_id, const ChatLogChat &chat,
+                   std::string &content, std::string &error_msg);
+
+// Forget the heap index of every principal: rebuilt from the logs on next use.
+void chat_log_reset();
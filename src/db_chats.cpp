@@ -1,5 +1,6 @@
 #include "db_chats.h"
 #include "auth.h"
+#include "chat_log.h"
 #include "common.h"
 #include "files.h"
 #include "http.h"
@@ -8,10 +9,12 @@
 #include "run.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 #include <string>
 #include <system_error>
+#include <vector>
 
 #include "ic_api.h"
 
@@ -19,70 +22,12 @@ bool DB_CHATS_ACTIVE = false;
 
 bool is_db_chats_active() { return DB_CHATS_ACTIVE; }
 
-bool get_saved_chats_dir(const std::string &principal_id,
-                         std::string &saved_chats_dir, std::string &error_msg) {
-  if (!DB_CHATS_ACTIVE) {
-    error_msg = std::string(__func__) +
-                ": do not call this function if DB_CHATS_ACTIVE is false";
-    return false;
-  }
-
-  saved_chats_dir = ".canister_cache/" + principal_id + "/db_chats";
-
-  // Make sure that the directory exists, else we cannot create the file
-  std::filesystem::path dir_path(saved_chats_dir);
-  if (!my_create_directory(dir_path, error_msg)) {
-    return false;
-  }
-
-  return true;
-}
-
-bool db_chats_write_conversation(const std::string &file_path,
-                                 const std::string &conversation,
-                                 const std::string &principal_id,
-                                 std::string &error_msg) {
-  if (!DB_CHATS_ACTIVE) {
-    error_msg = std::string(__func__) +
-                ": do not call this function if DB_CHATS_ACTIVE is false";
-    return false;
-  }
-  std::ofstream ofs(file_path);
-  if (ofs.is_open()) {
-    ofs << principal_id << std::endl;
-    if (!ofs) {
-      error_msg = std::string(__func__) + ": Error writing header to file - " +
-                  file_path;
-      return false;
-    }
-
-    ofs << conversation;
-    if (!ofs) {
-      error_msg = std::string(__func__) +
-                  ": Error writing conversation to file - " + file_path;
-      return false;
-    }
-
-  } else {
-    error_msg = std::string(__func__) + ": Failed to open file: " + file_path;
-    return false;
-  }
-
-  ofs.close();
-  return true;
-}
-
 bool db_chats_new(const std::string &principal_id, std::string &error_msg) {
   if (!DB_CHATS_ACTIVE) {
     error_msg = std::string(__func__) +
                 ": do not call this function if DB_CHATS_ACTIVE is false";
     return false;
   }
-  // The chats will be stored in ".saved_chats/<principal_id>"
-  std::string saved_chats_dir;
-  if (!get_saved_chats_dir(principal_id, saved_chats_dir, error_msg)) {
-    return false;
-  }
 
   // Get the current time as a timestamp
   std::time_t now_time = std::time(0);
@@ -92,17 +37,8 @@ bool db_chats_new(const std::string &principal_id, std::string &error_msg) {
   ss << std::put_time(std::localtime(&now_time), "%Y-%m-%d_%H-%M-%S");
   std::string timestamp = ss.str();
 
-  // Full file path with directory and timestamp as name
-  std::string file_path = saved_chats_dir + "/" + ss.str();
-
-  // Create and open the file and write the header.
-  std::string conversation; // empty conversation
-  if (!db_chats_write_conversation(file_path, conversation, principal_id,
-                                   error_msg)) {
-    return false;
-  }
-
-  return true;
+  // Start an empty chat in the principal's chat log
+  return chat_log_new(principal_id, timestamp, error_msg);
 }
 
 bool db_chats_clean(const std::string &principal_id, std::string &error_msg) {
@@ -114,54 +50,7 @@ bool db_chats_clean(const std::string &principal_id, std::string &error_msg) {
   // Each principal can only save max_chats
   uint64_t max_chats = 3; // Just hardcode it for now
 
-  std::string saved_chats_dir;
-  if (!get_saved_chats_dir(principal_id, saved_chats_dir, error_msg)) {
-    return false;
-  }
-
-  std::vector<std::filesystem::directory_entry> files;
-
-  // Error code to store any errors during filesystem operations
-  std::error_code ec;
-
-  // Iterate through the directory and collect all regular files
-  for (const auto &entry :
-       std::filesystem::directory_iterator(saved_chats_dir, ec)) {
-    if (ec) {
-      error_msg =
-          std::string(__func__) + ": Error reading directory: " + ec.message();
-      return false;
-    }
-
-    if (std::filesystem::is_regular_file(entry, ec) && !ec) {
-      files.emplace_back(entry);
-    }
-  }
-
-  // If the number of files is more than 'n', delete the older ones
-  if (files.size() > max_chats) {
-    // Sort files by their last write time (most recent first)
-    std::sort(files.begin(), files.end(),
-              [&ec](const std::filesystem::directory_entry &a,
-                    const std::filesystem::directory_entry &b) {
-                return get_last_write_time(a.path(), ec) >
-                       get_last_write_time(b.path(), ec);
-              });
-    // keep only max_chats
-    for (std::size_t i = max_chats; i < files.size(); ++i) {
-      std::filesystem::remove(files[i], ec);
-      if (ec) {
-        error_msg = std::string(__func__) + ": Error deleting file " +
-                    files[i].path().string() + ": " + ec.message();
-        return false;
-      } else {
-        std::cout << "llama_cpp: " << std::string(__func__) << " - "
-                  << "Deleted: " << files[i].path().string() << '\n';
-      }
-    }
-  }
-
-  return true;
+  return chat_log_keep_latest(principal_id, max_chats, error_msg);
 }
 
 bool db_chats_save_conversation(const std::string &conversation,
@@ -172,54 +61,9 @@ bool db_chats_save_conversation(const std::string &conversation,
                 ": do not call this function if DB_CHATS_ACTIVE is false";
     return false;
   }
-  std::string saved_chats_dir;
-  if (!get_saved_chats_dir(principal_id, saved_chats_dir, error_msg)) {
-    return false;
-  }
-
-  std::vector<std::filesystem::directory_entry> files;
-  std::error_code ec;
-
-  // Iterate through the directory and collect all regular files
-  for (const auto &entry :
-       std::filesystem::directory_iterator(saved_chats_dir, ec)) {
-    if (ec) {
-      error_msg =
-          std::string(__func__) + ": Error reading directory: " + ec.message();
-      return false;
-    }
-
-    if (std::filesystem::is_regular_file(entry, ec) && !ec) {
-      files.emplace_back(entry);
-    }
-  }
-
-  if (files.empty()) {
-    error_msg = std::string(__func__) + ": No files found in directory";
-    return false;
-  }
-
-  // Find the file with the most recent last write time
-  auto latest_file =
-      std::max_element(files.begin(), files.end(),
-                       [&ec](const std::filesystem::directory_entry &a,
-                             const std::filesystem::directory_entry &b) {
-                         return get_last_write_time(a.path(), ec) <
-                                get_last_write_time(b.path(), ec);
-                       });
-
-  if (ec) {
-    error_msg = std::string(__func__) +
-                ": Error retrieving last write time: " + ec.message();
-    return false;
-  }
 
-  std::string file_path = latest_file->path().string();
-  if (!db_chats_write_conversation(file_path, conversation, principal_id,
-                                   error_msg)) {
-    return false;
-  }
-  return true;
+  // Appends only what the conversation of the latest chat grew by
+  return chat_log_save(principal_id, conversation, error_msg);
 }
 
 // Canister API to retrieve saved chats for authenticated caller
@@ -243,70 +87,31 @@ void get_chats() {
   // Get the principal ID as a string
   std::string principal_id = caller.get_text();
 
-  // Directory where chats are stored for this principal
-  std::string saved_chats_dir;
+  // The chats, from the principal's chat log
+  std::vector<ChatLogChat> log_chats;
   std::string error_msg;
-  if (!get_saved_chats_dir(principal_id, saved_chats_dir, error_msg)) {
+  // A query: the legacy chats are imported by the next update call
+  if (!chat_log_chats(principal_id, log_chats, error_msg, false)) {
     ic_api.to_wire(CandidTypeVariant{
         "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
                                                          ": " + error_msg}}});
     return;
   }
 
-  // Vectors to store the chats read from file
+  // Vectors to store the chats read from the log
   std::vector<std::string> timestamps;
   std::vector<std::string> chats;
-  std::error_code ec;
-
-  // Iterate through the directory and collect all regular files
-  for (const auto &entry :
-       std::filesystem::directory_iterator(saved_chats_dir, ec)) {
-    if (ec) {
-      std::string msg = "Error reading directory: " + ec.message();
+  for (const ChatLogChat &log_chat : log_chats) {
+    std::string chat;
+    if (!chat_log_read(principal_id, log_chat, chat, error_msg)) {
       ic_api.to_wire(CandidTypeVariant{
           "Err",
-          CandidTypeVariant{
-              "Other", CandidTypeText{std::string(__func__) + ": " + msg}}});
+          CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                    ": " + error_msg}}});
       return;
     }
-
-    if (std::filesystem::is_regular_file(entry, ec) && !ec) {
-      std::ifstream ifs(entry.path());
-      if (!ifs.is_open()) {
-        std::string msg = "Failed to open file: " + entry.path().string();
-        ic_api.to_wire(CandidTypeVariant{
-            "Err",
-            CandidTypeVariant{
-                "Other", CandidTypeText{std::string(__func__) + ": " + msg}}});
-        return;
-      }
-
-      // Read the principal ID from the file (first line)
-      std::string file_principal_id;
-      std::getline(ifs, file_principal_id);
-
-      // Verify the file's principal ID matches the caller's principal ID
-      if (file_principal_id != principal_id) {
-        std::string msg =
-            "Principal id not correct in file: " + entry.path().string();
-        ic_api.to_wire(CandidTypeVariant{
-            "Err",
-            CandidTypeVariant{
-                "Other", CandidTypeText{std::string(__func__) + ": " + msg}}});
-        return;
-      }
-
-      // Read the rest of the file as the chat
-      std::string chat((std::istreambuf_iterator<char>(ifs)),
-                       std::istreambuf_iterator<char>());
-
-      // Extract the timestamp from the filename (assuming it's formatted as in db_chats_new)
-      std::string timestamp = entry.path().filename().string();
-
-      // Add the data to the vectors
-      timestamps.emplace_back(timestamp);
-      chats.emplace_back(chat);
-    }
+    timestamps.emplace_back(log_chat.timestamp);
+    chats.emplace_back(chat);
   }
 
   // ---------------------------------------------------
@@ -326,6 +131,100 @@ void get_chats() {
   ic_api.to_wire(CandidTypeVariant{"Ok", get_chats_record});
 }
 
+// Canister API to page through the saved chats of the authenticated caller,
+// newest first. Only the chats of the page are read from the chat log.
+void get_chats_page() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_or_whitelisted(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  const uint64_t DEFAULT_PAGE_CHATS = 10;
+  const uint64_t MAX_PAGE_CHATS = 100;
+
+  uint64_t offset{0};
+  uint64_t limit{0};  // 0 = DEFAULT_PAGE_CHATS
+  std::string since{""}; // "" = all
+
+  CandidTypeRecord r_in;
+  r_in.append("offset", CandidTypeNat64{&offset});
+  r_in.append("limit", CandidTypeNat64{&limit});
+  r_in.append("since", CandidTypeText{&since});
+  ic_api.from_wire(r_in);
+
+  if (!DB_CHATS_ACTIVE) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other",
+                                 CandidTypeText{std::string(__func__) + ": " +
+                                                "DB_CHATS_ACTIVE is false"}}});
+    return;
+  }
+  if (limit == 0) {
+    limit = DEFAULT_PAGE_CHATS;
+  }
+  limit = std::min(limit, MAX_PAGE_CHATS);
+
+  std::string principal_id = ic_api.get_caller().get_text();
+
+  std::vector<ChatLogChat> log_chats;
+  std::string error_msg;
+  // A query: the legacy chats are imported by the next update call
+  if (!chat_log_chats(principal_id, log_chats, error_msg, false)) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                         ": " + error_msg}}});
+    return;
+  }
+
+  // Newest first, only those since the given timestamp. The timestamps are
+  // formatted as "%Y-%m-%d_%H-%M-%S", so they compare as text.
+  std::vector<const ChatLogChat *> matching;
+  for (auto it = log_chats.rbegin(); it != log_chats.rend(); ++it) {
+    if (since.empty() || it->timestamp >= since) {
+      matching.push_back(&*it);
+    }
+  }
+  const uint64_t total = matching.size();
+
+  // The page also ends before the reply outgrows the message size limit, but
+  // it always holds at least one chat
+  std::vector<std::string> timestamps;
+  std::vector<std::string> chats;
+  uint64_t reply_bytes = 0;
+  uint64_t next_offset = std::min(offset, total);
+  while (next_offset < total && chats.size() < limit) {
+    const ChatLogChat &log_chat = *matching[next_offset];
+    const uint64_t chat_bytes = log_chat.timestamp.size() + log_chat.length;
+    if (!chats.empty() && reply_bytes + chat_bytes > MAX_CHUNK_SIZE) {
+      break;
+    }
+    std::string chat;
+    if (!chat_log_read(principal_id, log_chat, chat, error_msg)) {
+      ic_api.to_wire(CandidTypeVariant{
+          "Err",
+          CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                    ": " + error_msg}}});
+      return;
+    }
+    timestamps.emplace_back(log_chat.timestamp);
+    chats.emplace_back(chat);
+    reply_bytes += chat_bytes;
+    ++next_offset;
+  }
+
+  CandidTypeRecord r_chats;
+  r_chats.append("timestamp", CandidTypeVecText{&timestamps});
+  r_chats.append("chat", CandidTypeVecText{&chats});
+
+  CandidTypeRecord r_out;
+  r_out.append("chats", CandidTypeVecRecord{r_chats});
+  r_out.append("total", CandidTypeNat64{total});
+  r_out.append("next_offset", CandidTypeNat64{next_offset});
+  r_out.append("done", CandidTypeBool{next_offset >= total});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
+
 void chats_resume() {
   IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
   if (!has_admin_update_or_whitelisted(ic_api)) {
@@ -2,10 +2,13 @@
 #include "auth.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <stdio.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "ic_api.h"
 
@@ -93,4 +96,135 @@ void file_download_chunk_(IC_API &ic_api, const std::string &filename,
   file_download_record.append("done", CandidTypeBool{done});
   ic_api.to_wire(
       CandidTypeVariant{"Ok", CandidTypeRecord{file_download_record}});
-}
\ No newline at end of file
+}
+
+bool read_file_chunk(const std::string &filename, uint64_t chunksize,
+                     uint64_t offset, std::vector<uint8_t> &v,
+                     uint64_t &filesize, std::string &msg) {
+  if (chunksize > MAX_CHUNK_SIZE) {
+    msg = "chunksize " + std::to_string(chunksize) + " exceeds limit " +
+          std::to_string(MAX_CHUNK_SIZE);
+    return false;
+  }
+  std::ifstream if_stream;
+  if (!open_ifstream(filename, std::ios::binary, if_stream, msg)) {
+    return false;
+  }
+  if_stream.seekg(0, std::ios::end);
+  filesize = if_stream.tellg();
+
+  v.resize(chunksize);
+  if_stream.seekg(offset, std::ios::beg);
+  if_stream.read(reinterpret_cast<char *>(v.data()), chunksize);
+  v.resize(if_stream.gcount());
+  return true;
+}
+
+// An open file and its size, shared by all segments of one
+// file_download_chunks call that read from the same file.
+struct DownloadHandle {
+  std::ifstream if_stream;
+  uint64_t filesize = 0;
+};
+
+void file_download_chunks() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  // The segments to read: segment i starts at offsets[i] of filenames[i]
+  std::vector<std::string> filenames;
+  std::vector<uint64_t> offsets;
+  uint64_t max_bytes{0};
+
+  CandidTypeRecord r_in;
+  r_in.append("filenames", CandidTypeVecText{&filenames});
+  r_in.append("offsets", CandidTypeVecNat64{&offsets});
+  r_in.append("max_bytes", CandidTypeNat64{&max_bytes});
+  ic_api.from_wire(r_in);
+
+  if (filenames.size() != offsets.size()) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err",
+        CandidTypeVariant{
+            "Other", CandidTypeText{std::string(__func__) +
+                                    ": filenames and offsets must have the "
+                                    "same length"}}});
+    return;
+  }
+
+  // Pack the segments up to the reply-size limit
+  uint64_t budget = MAX_CHUNK_SIZE;
+  if (max_bytes > 0) {
+    budget = std::min(budget, max_bytes);
+  }
+
+  // A query cannot keep state between calls, so the handles live for this
+  // call only: every file is opened & sized once, however many segments of it
+  // are requested.
+  std::unordered_map<std::string, DownloadHandle> handles;
+
+  std::vector<uint8_t> data;
+  std::vector<std::string> segment_filenames;
+  std::vector<uint64_t> segment_offsets;
+  std::vector<uint64_t> segment_lengths;
+  std::vector<uint64_t> segment_filesizes;
+  for (size_t i = 0; i < filenames.size() && budget > 0; i++) {
+    const std::string &filename = filenames[i];
+    auto it = handles.find(filename);
+    if (it == handles.end()) {
+      DownloadHandle handle;
+      std::string msg;
+      if (!open_ifstream(filename, std::ios::binary, handle.if_stream, msg)) {
+        ic_api.to_wire(CandidTypeVariant{
+            "Err",
+            CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                      ": " + msg}}});
+        return;
+      }
+      handle.if_stream.seekg(0, std::ios::end);
+      handle.filesize = handle.if_stream.tellg();
+      it = handles.emplace(filename, std::move(handle)).first;
+    }
+    DownloadHandle &handle = it->second;
+
+    const uint64_t offset = offsets[i];
+    uint64_t length = 0;
+    if (offset < handle.filesize) {
+      length = std::min(budget, handle.filesize - offset);
+      const size_t start = data.size();
+      data.resize(start + length);
+      handle.if_stream.clear();
+      handle.if_stream.seekg(offset, std::ios::beg);
+      handle.if_stream.read(reinterpret_cast<char *>(data.data() + start),
+                            length);
+      length = handle.if_stream.gcount();
+      data.resize(start + length);
+      budget -= length;
+    }
+
+    segment_filenames.push_back(filename);
+    segment_offsets.push_back(offset);
+    segment_lengths.push_back(length);
+    segment_filesizes.push_back(handle.filesize);
+  }
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - "
+            << segment_filenames.size() << " of " << filenames.size()
+            << " segments from " << handles.size()
+            << " files; bytes=" << data.size() << std::endl;
+
+  // Segment i is data[sum of the lengths of segments 0..i-1, + length]
+  CandidTypeRecord segments;
+  segments.append("filename", CandidTypeVecText{segment_filenames});
+  segments.append("offset", CandidTypeVecNat64{segment_offsets});
+  segments.append("length", CandidTypeVecNat64{segment_lengths});
+  segments.append("filesize", CandidTypeVecNat64{segment_filesizes});
+
+  CandidTypeRecord r_out;
+  r_out.append("data", CandidTypeVecNat8{data});
+  r_out.append("segments", CandidTypeVecRecord{segments});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
@@ -5,9 +5,26 @@
 #include "ic_api.h"
 #include <cstdint>
 #include <string>
+#include <vector>
 
 void file_download_chunk()
     WASM_SYMBOL_EXPORTED("canister_query file_download_chunk");
 
+// Batched download: reads several segments (a file and an offset each), packed
+// into one reply of at most max_bytes (0 = the reply-size limit). A segment is
+// read from its offset to the end of the file or until the reply is full; the
+// segments that did not fit are left out, so the client asks again from where
+// the last one stopped. It saves calls when many small files are fetched;
+// for one large file, a single segment per call already fills the reply.
+void file_download_chunks()
+    WASM_SYMBOL_EXPORTED("canister_query file_download_chunks");
+
 void file_download_chunk_(IC_API &ic_api, const std::string &filename,
-                          const uint64_t &chunksize, const uint64_t &offset);
\ No newline at end of file
+                          const uint64_t &chunksize, const uint64_t &offset);
+
+// Reads up to chunksize bytes of filename, starting at offset, into v (fewer at
+// the end of the file). Returns false with msg if the file cannot be opened or
+// chunksize exceeds MAX_CHUNK_SIZE.
+bool read_file_chunk(const std::string &filename, uint64_t chunksize,
+                     uint64_t offset, std::vector<uint8_t> &v,
+                     uint64_t &filesize, std::string &msg);
@@ -1,12 +1,16 @@
 #include "files.h"
 #include "auth.h"
+#include "cache_index.h"
 #include "http.h"
+#include "instructions.h"
 #include "ready.h"
+#include "upload.h"
 #include "utils.h"
 
 // This library is included with icpp-pro
 #include "hash-library/sha256.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <fstream>
@@ -129,6 +133,82 @@ void recursive_dir_content_(IC_API &ic_api) {
   ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeVecRecord{r_file_entries}});
 }
 
+void recursive_dir_content_page_update() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+  recursive_dir_content_page_(ic_api);
+}
+
+void recursive_dir_content_page_query() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+  recursive_dir_content_page_(ic_api);
+}
+
+void recursive_dir_content_page_(IC_API &ic_api) {
+  const std::uint64_t DEFAULT_PAGE_ENTRIES = 1000;
+  const std::uint64_t MAX_PAGE_ENTRIES = 10000;
+
+  std::string dir{""};
+  std::string cursor{""};
+  std::string prefix{""};
+  std::uint64_t max_entries{0}; // 0 = DEFAULT_PAGE_ENTRIES
+
+  CandidTypeRecord r_in;
+  r_in.append("dir", CandidTypeText{&dir});
+  r_in.append("cursor", CandidTypeText{&cursor});
+  r_in.append("prefix", CandidTypeText{&prefix});
+  r_in.append("max_entries", CandidTypeNat64{&max_entries});
+  ic_api.from_wire(r_in);
+
+  std::error_code ec;
+  if (!std::filesystem::exists(dir, ec) ||
+      !std::filesystem::is_directory(dir, ec)) {
+    std::string msg = "Directory does not exist: " + dir + "\n";
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                         ": " + msg}}});
+    return;
+  }
+  if (max_entries == 0) {
+    max_entries = DEFAULT_PAGE_ENTRIES;
+  }
+  max_entries = std::min(max_entries, MAX_PAGE_ENTRIES);
+
+  std::vector<FilePageEntry> entries;
+  std::string next_cursor = list_directory_page(std::filesystem::path(dir),
+                                                cursor, prefix, max_entries,
+                                                entries);
+
+  std::vector<std::string> filenames;
+  std::vector<std::string> filetypes;
+  std::vector<std::uint64_t> sizes;
+  std::vector<std::uint64_t> modified_ns;
+  for (const auto &entry : entries) {
+    filenames.push_back(entry.filename);
+    filetypes.push_back(entry.filetype);
+    sizes.push_back(entry.size);
+    modified_ns.push_back(entry.modified_ns);
+  }
+  CandidTypeRecord r_file_entries;
+  r_file_entries.append("filename", CandidTypeVecText{filenames});
+  r_file_entries.append("filetype", CandidTypeVecText{filetypes});
+  r_file_entries.append("size", CandidTypeVecNat64{sizes});
+  r_file_entries.append("modified_ns", CandidTypeVecNat64{modified_ns});
+
+  CandidTypeRecord r_out;
+  r_out.append("entries", CandidTypeVecRecord{r_file_entries});
+  r_out.append("next_cursor", CandidTypeText{next_cursor});
+  r_out.append("done", CandidTypeBool{next_cursor.empty()});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
+
 bool filesystem_remove_(IC_API &ic_api, const std::string &filename, bool all,
                         bool to_wire) {
   // Use the non-throwing version of std::filesystem::remove
@@ -158,7 +238,11 @@ bool filesystem_remove_(IC_API &ic_api, const std::string &filename, bool all,
       // removed = std::filesystem::remove_all(filename, ec);
     } else {
       // Use std::filesystem::remove to remove a single file or empty directory
+      file_upload_close(filename);
       removed = std::filesystem::remove(filename, ec);
+      if (removed) {
+        cache_index_note_remove(filename);
+      }
     }
     if (ec) {
       error = true;
@@ -359,6 +443,160 @@ list_directory_contents(const std::filesystem::path &dir,
   return entries;
 }
 
+namespace {
+// One page of list_directory_page, filled depth first
+struct DirectoryPage {
+  std::string prefix;
+  std::uint64_t max_entries = 0;
+  std::uint64_t instructions_start = 0;
+  std::vector<FilePageEntry> *entries = nullptr;
+  std::string last; // the path of the last entry visited
+  bool full = false;
+};
+
+// A page also ends when its instruction budget is used, so that a page of
+// huge directories still fits in one query.
+const std::uint64_t DIRECTORY_PAGE_INSTRUCTION_BUDGET =
+    IC_INSTRUCTION_LIMIT_QUERY / 2;
+
+bool page_is_full(const DirectoryPage &page) {
+  // A page always makes progress: at least one entry
+  return page.entries->size() >= page.max_entries ||
+         (!page.entries->empty() &&
+          instruction_counter() - page.instructions_start >=
+              DIRECTORY_PAGE_INSTRUCTION_BUDGET);
+}
+
+// Can `path`, or anything below it, start with the prefix?
+bool may_match_prefix(const std::string &path, const std::string &prefix) {
+  return path.starts_with(prefix) || prefix.starts_with(path + "/");
+}
+
+void add_page_entry(DirectoryPage &page,
+                    const std::filesystem::directory_entry &entry) {
+  std::error_code ec;
+  FilePageEntry fe;
+  fe.filename = entry.path().string();
+  if (entry.is_directory(ec)) {
+    fe.filetype = "directory";
+  } else if (entry.is_regular_file(ec)) {
+    fe.filetype = "file";
+    fe.size = static_cast<std::uint64_t>(entry.file_size(ec));
+  } else {
+    fe.filetype = "other";
+  }
+  // NOTE: on the IC, this is actually the creation time
+  auto ftime = entry.last_write_time(ec);
+  if (!ec) {
+    fe.modified_ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            ftime.time_since_epoch())
+            .count());
+  }
+  page.entries->push_back(std::move(fe));
+}
+
+// Visits the entries of `dir` in name order, descending into directories.
+// `after` holds the components of the cursor below `dir`: entries up to and
+// including it were listed by an earlier page and are only passed through.
+void list_directory_page_(const std::filesystem::path &dir,
+                          const std::vector<std::string> &after, size_t depth,
+                          DirectoryPage &page) {
+  std::error_code ec;
+  const bool resuming = depth < after.size();
+  auto by_name = [](const std::filesystem::directory_entry &a,
+                    const std::filesystem::directory_entry &b) {
+    return a.path().filename() < b.path().filename();
+  };
+
+  // The page has room for only so many more entries, and every child takes
+  // one, except the one on the cursor's path and the one on the prefix's
+  // path. So only the smallest names from the cursor on are kept (one more,
+  // to tell that the page is full), in a bounded max-heap: a directory costs
+  // O(n log page) and no full sort, and the entries before the cursor are
+  // dropped while reading.
+  const size_t keep =
+      static_cast<size_t>(page.max_entries - page.entries->size()) + 3;
+  std::vector<std::filesystem::directory_entry> children;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    // Before the cursor: listed by an earlier page
+    if (resuming && entry.path().filename().string() < after[depth]) {
+      continue;
+    }
+    if (!page.prefix.empty() &&
+        !may_match_prefix(entry.path().string(), page.prefix)) {
+      continue;
+    }
+    if (children.size() == keep) {
+      if (!by_name(entry, children.front())) {
+        continue;
+      }
+      std::pop_heap(children.begin(), children.end(), by_name);
+      children.back() = entry;
+    } else {
+      children.push_back(entry);
+    }
+    std::push_heap(children.begin(), children.end(), by_name);
+  }
+  std::sort_heap(children.begin(), children.end(), by_name);
+
+  for (const auto &entry : children) {
+    const std::string name = entry.path().filename().string();
+    const std::string path = entry.path().string();
+
+    // On the cursor's path: the entry itself was listed, its contents
+    // (after the cursor) maybe not
+    const bool on_cursor = resuming && name == after[depth];
+    if (!on_cursor && (page.prefix.empty() || path.starts_with(page.prefix))) {
+      if (page_is_full(page)) {
+        page.full = true;
+        return;
+      }
+      add_page_entry(page, entry);
+      page.last = path;
+    }
+
+    if (entry.is_directory(ec)) {
+      static const std::vector<std::string> no_cursor;
+      const bool inside_cursor = on_cursor && depth + 1 < after.size();
+      list_directory_page_(entry.path(), inside_cursor ? after : no_cursor,
+                           inside_cursor ? depth + 1 : 0, page);
+      if (page.full) {
+        return;
+      }
+    }
+  }
+}
+} // namespace
+
+std::string list_directory_page(const std::filesystem::path &dir,
+                                const std::string &cursor,
+                                const std::string &prefix,
+                                std::uint64_t max_entries,
+                                std::vector<FilePageEntry> &entries) {
+  DirectoryPage page;
+  page.prefix = prefix;
+  page.max_entries = max_entries;
+  page.instructions_start = instruction_counter();
+  page.entries = &entries;
+
+  // The cursor is the path of the last entry of the previous page
+  std::vector<std::string> after;
+  if (!cursor.empty()) {
+    for (const auto &component :
+         std::filesystem::path(cursor).lexically_relative(dir)) {
+      after.push_back(component.string());
+    }
+  }
+
+  list_directory_page_(dir, after, 0, page);
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - " << dir << ": "
+            << entries.size() << " entries"
+            << (page.full ? ", more to come" : ", done") << std::endl;
+  return page.full ? page.last : "";
+}
+
 // Helper function to retrieve the last write time of a file
 // NOTE: on the IC, this is actually the creation time, not the last write time
 std::filesystem::file_time_type
@@ -19,7 +19,16 @@ void recursive_dir_content_query()
 void recursive_dir_content_update()
     WASM_SYMBOL_EXPORTED("canister_update recursive_dir_content_update");
 
+// Paginated listing: one page of entries per call, resumed with the opaque
+// next_cursor of the previous page. Each page costs what it lists, not what
+// precedes it in the tree, plus one pass over each directory on its path.
+void recursive_dir_content_page_query()
+    WASM_SYMBOL_EXPORTED("canister_query recursive_dir_content_page_query");
+void recursive_dir_content_page_update()
+    WASM_SYMBOL_EXPORTED("canister_update recursive_dir_content_page_update");
+
 void recursive_dir_content_(IC_API &ic_api);
+void recursive_dir_content_page_(IC_API &ic_api);
 bool filesystem_remove_(IC_API &ic_api, const std::string &filename, bool all,
                         bool to_wire = true);
 std::uint64_t filesystem_file_size_(IC_API &ic_api, const std::string &filename,
@@ -36,6 +45,23 @@ std::vector<FileEntry>
 list_directory_contents(const std::filesystem::path &dir,
                         const std::uint64_t &max_entries);
 
+struct FilePageEntry {
+  std::string filename;
+  std::string filetype;  // "file", "directory" or "other"
+  std::uint64_t size = 0; // 0 for a directory
+  std::uint64_t modified_ns = 0;
+};
+// Lists dir depth first, with the entries of every directory in name order, so
+// the listing has a stable order that a cursor can resume. Appends up to
+// max_entries entries that come after `cursor` ("" = from the start) and whose
+// path starts with `prefix`. Returns the cursor of the next page, or "" when
+// the listing is complete.
+std::string list_directory_page(const std::filesystem::path &dir,
+                                const std::string &cursor,
+                                const std::string &prefix,
+                                std::uint64_t max_entries,
+                                std::vector<FilePageEntry> &entries);
+
 // Helper function to retrieve the last write time of a file
 // NOTE: on the IC, this is actually the creation time, not the last write time
 std::filesystem::file_time_type
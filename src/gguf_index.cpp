@@ -0,0 +1,145 @@
+// Tensor index of uploaded gguf files — implementation.
+// See gguf_index.h for the high-level contract.
+
+#include "gguf_index.h"
+#include "auth.h"
+#include "upload.h"
+
+#include "ggml.h"
+#include "gguf.h"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "ic_api.h"
+
+// filename -> index, for gguf files whose header has been parsed
+static std::unordered_map<std::string, GgufTensorIndex> gguf_indexes;
+
+static bool is_gguf_filename(const std::string &filename) {
+  const std::string ext = ".gguf";
+  return filename.size() >= ext.size() &&
+         filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+// Parse the header of a gguf file into an index. Only the header is read
+// (no_alloc, no ggml context), so this also works on a partially uploaded
+// file, and fails cleanly while the header itself is still incomplete.
+static bool gguf_index_build(const std::string &filename,
+                             GgufTensorIndex &index) {
+  struct gguf_init_params params = {/*.no_alloc =*/true, /*.ctx =*/nullptr};
+  struct gguf_context *ctx = gguf_init_from_file(filename.c_str(), params);
+  if (ctx == nullptr) {
+    return false;
+  }
+
+  index = GgufTensorIndex{};
+  index.data_offset = gguf_get_data_offset(ctx);
+  const int64_t n_tensors = gguf_get_n_tensors(ctx);
+  index.tensors.reserve(n_tensors);
+  for (int64_t i = 0; i < n_tensors; ++i) {
+    GgufTensorIndexEntry entry;
+    entry.name = gguf_get_tensor_name(ctx, i);
+    entry.ggml_type = ggml_type_name(gguf_get_tensor_type(ctx, i));
+    entry.offset = index.data_offset + gguf_get_tensor_offset(ctx, i);
+    entry.nbytes = gguf_get_tensor_size(ctx, i);
+    if (entry.offset + entry.nbytes > index.data_end) {
+      index.data_end = entry.offset + entry.nbytes;
+    }
+    index.tensors.push_back(std::move(entry));
+  }
+  gguf_free(ctx);
+  return true;
+}
+
+void gguf_index_on_upload_chunk(const std::string &filename, uint64_t offset,
+                                uint64_t filesize) {
+  if (!is_gguf_filename(filename)) {
+    return;
+  }
+  if (offset == 0) {
+    gguf_indexes.erase(filename); // a new upload of this file
+  }
+  if (gguf_indexes.contains(filename)) {
+    return; // header already parsed
+  }
+
+  GgufTensorIndex index;
+  if (gguf_index_build(filename, index)) {
+    std::cout << "llama_cpp: " << std::string(__func__) << " - " << filename
+              << ": header complete after " << filesize << " bytes, "
+              << index.tensors.size() << " tensors" << std::endl;
+    gguf_indexes[filename] = std::move(index);
+  }
+}
+
+const GgufTensorIndex *gguf_index_get(const std::string &filename) {
+  auto it = gguf_indexes.find(filename);
+  if (it == gguf_indexes.end()) {
+    GgufTensorIndex index;
+    if (!gguf_index_build(filename, index)) {
+      return nullptr;
+    }
+    it = gguf_indexes.emplace(filename, std::move(index)).first;
+  }
+  return &it->second;
+}
+
+void uploaded_file_tensor_index() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string filename{""};
+  CandidTypeRecord r_in;
+  r_in.append("filename", CandidTypeText{&filename});
+  ic_api.from_wire(r_in);
+
+  auto metadata = get_file_metadata(filename);
+  if (!metadata.has_value()) {
+    std::string msg = "Metadata for this file are not found: " + filename;
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                         ": " + msg}}});
+    return;
+  }
+
+  const GgufTensorIndex *index = gguf_index_get(filename);
+  if (index == nullptr) {
+    std::string msg = "No complete gguf header (yet) in: " + filename;
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                         ": " + msg}}});
+    return;
+  }
+
+  std::vector<std::string> names;
+  std::vector<std::string> types;
+  std::vector<uint64_t> offsets;
+  std::vector<uint64_t> nbytes;
+  for (const auto &entry : index->tensors) {
+    names.push_back(entry.name);
+    types.push_back(entry.ggml_type);
+    offsets.push_back(entry.offset);
+    nbytes.push_back(entry.nbytes);
+  }
+  CandidTypeRecord tensor_record;
+  tensor_record.append("name", CandidTypeVecText{names});
+  tensor_record.append("ggml_type", CandidTypeVecText{types});
+  tensor_record.append("offset", CandidTypeVecNat64{offsets});
+  tensor_record.append("nbytes", CandidTypeVecNat64{nbytes});
+
+  CandidTypeRecord r_out;
+  r_out.append("filename", CandidTypeText{filename});
+  r_out.append("filesize", CandidTypeNat64{metadata->filesize});
+  r_out.append("filesha256", CandidTypeText{metadata->sha256});
+  r_out.append("data_offset", CandidTypeNat64{index->data_offset});
+  // All tensor data has arrived (the upload may still be in progress)
+  r_out.append("complete", CandidTypeBool{metadata->filesize >= index->data_end});
+  r_out.append("tensors", CandidTypeVecRecord{tensor_record});
+  ic_api.to_wire(CandidTypeVariant{"Ok", r_out});
+}
@@ -0,0 +1,43 @@
+// Tensor index of uploaded gguf files.
+//
+// While a .gguf is uploaded with file_upload_chunk, its header is parsed as
+// soon as it is complete -- usually after the first few chunks -- into an
+// index of every tensor: name, ggml type, absolute byte offset in the file and
+// size. The index lives in the heap; after an upgrade it is rebuilt lazily
+// from the file's header (which is cheap: no tensor data is read).
+//
+// The uploaded_file_tensor_index query returns it together with the file's
+// streaming SHA-256, so a client can verify the upload tensor by tensor and
+// locate any tensor without parsing the gguf itself.
+#pragma once
+
+#include "wasm_symbol.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct GgufTensorIndexEntry {
+  std::string name;
+  std::string ggml_type;
+  uint64_t offset; // absolute offset of the tensor data in the file
+  uint64_t nbytes;
+};
+
+struct GgufTensorIndex {
+  uint64_t data_offset = 0; // start of the tensor data section
+  uint64_t data_end = 0;    // end of the last tensor's data
+  std::vector<GgufTensorIndexEntry> tensors;
+};
+
+// Called by file_upload_chunk_ after every chunk. Builds the index once the
+// header is complete. A chunk at offset 0 starts over.
+void gguf_index_on_upload_chunk(const std::string &filename, uint64_t offset,
+                                uint64_t filesize);
+
+// The index of a gguf file, rebuilt from its header when not in the heap.
+// Returns nullptr if the file has no (complete) gguf header.
+const GgufTensorIndex *gguf_index_get(const std::string &filename);
+
+void uploaded_file_tensor_index()
+    WASM_SYMBOL_EXPORTED("canister_query uploaded_file_tensor_index");
@@ -0,0 +1,23 @@
+// Instruction counter — implementation.
+// See instructions.h for the high-level contract.
+
+#include "instructions.h"
+
+#include "ic0.h"
+
+#ifdef __wasi__
+// Declared by hand, like ic0_stable64_size in memory_status.cpp: a plain ic0
+// system-API import, so it survives wasi2ic untouched. Counter type 0 is the
+// instruction counter of the current message execution.
+// See: https://internetcomputer.org/docs/current/references/ic-interface-spec#system-api-performance-counter
+extern "C" uint64_t ic0_performance_counter64(uint32_t counter_type)
+    WASM_SYMBOL_IMPORTED("ic0", "performance_counter");
+#endif
+
+uint64_t instruction_counter() {
+#ifdef __wasi__
+  return ic0_performance_counter64(0);
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,19 @@
+// Instruction counter of the current message execution.
+//
+// Wraps ic0.performance_counter(0): the number of wasm instructions executed
+// so far in this update/query call -- the quantity that is capped by the IC's
+// per-message instruction limit (40 B for an update call). Use it to report
+// how much of that budget an operation used, and to stop a sliced operation
+// before the limit is hit.
+//
+// Native (MockIC) builds have no instruction counter and always return 0.
+#pragma once
+
+#include <cstdint>
+
+// The IC's instruction limit for a single update call.
+const uint64_t IC_INSTRUCTION_LIMIT_UPDATE = 40'000'000'000ULL;
+// ... and for a single query call.
+const uint64_t IC_INSTRUCTION_LIMIT_QUERY = 5'000'000'000ULL;
+
+uint64_t instruction_counter();
@@ -0,0 +1,217 @@
+// LoRA adapter endpoints — implementation.
+// See lora.h for the high-level contract; the adapters themselves live with
+// their resident model in main_.cpp.
+
+#include "lora.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "auth.h"
+#include "cache_index.h"
+#include "main_.h"
+#include "utils.h"
+
+#include "ic_api.h"
+
+struct LoraSelection {
+  std::string name;
+  float scale = 1.0f;
+};
+
+// The adapter each principal selected; absent = none. A cache of the
+// selection files, which survive an upgrade: an upgrade starts with an empty
+// map, and the selections are read back by the first update that runs. A
+// query reads the file without caching it: its heap changes are discarded.
+static std::map<std::string, LoraSelection> lora_selections;
+
+static std::string lora_selection_dir(const std::string &principal_id) {
+  return ".canister_cache/" + principal_id + "/lora";
+}
+
+static std::string lora_selection_path(const std::string &principal_id) {
+  return lora_selection_dir(principal_id) + "/selection.dat";
+}
+
+// Saves the selection of a principal; an empty name removes it.
+static bool save_selection(const std::string &principal_id,
+                           const LoraSelection &selection,
+                           std::string &error_msg) {
+  const std::string path = lora_selection_path(principal_id);
+  if (selection.name.empty()) {
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    cache_index_note_remove(path);
+    return true;
+  }
+  if (!my_create_directory(lora_selection_dir(principal_id), error_msg)) {
+    return false;
+  }
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    error_msg = "Failed to open " + path + " for writing";
+    return false;
+  }
+  const uint64_t size = selection.name.size();
+  file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  file.write(selection.name.data(), size);
+  file.write(reinterpret_cast<const char *>(&selection.scale),
+             sizeof(selection.scale));
+  file.close();
+  cache_index_note_write(path);
+  return true;
+}
+
+// The selection of a principal: from the cache, else from its file, which is
+// then cached when asked (on the update path only).
+static LoraSelection find_selection(const std::string &principal_id,
+                                    bool cache) {
+  auto it = lora_selections.find(principal_id);
+  if (it != lora_selections.end()) {
+    return it->second;
+  }
+  LoraSelection selection;
+  std::ifstream file(lora_selection_path(principal_id), std::ios::binary);
+  uint64_t size = 0;
+  if (file.is_open() &&
+      file.read(reinterpret_cast<char *>(&size), sizeof(size)) &&
+      size <= MAX_FILENAME_SIZE) {
+    std::string name(size, '\0');
+    float scale = 1.0f;
+    if (file.read(name.data(), size) &&
+        file.read(reinterpret_cast<char *>(&scale), sizeof(scale))) {
+      selection = LoraSelection{name, scale};
+    }
+  }
+  if (cache) {
+    lora_selections[principal_id] = selection;
+  }
+  return selection;
+}
+
+static void send_lora_error_to_wire(IC_API &ic_api, const std::string &func,
+                                    const std::string &msg) {
+  ic_api.to_wire(CandidTypeVariant{
+      "Err",
+      CandidTypeVariant{"Other", CandidTypeText{func + ": " + msg}}});
+}
+
+void load_lora() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string name;
+  std::string path;
+  CandidTypeRecord r_in;
+  r_in.append("name", CandidTypeText{&name});
+  r_in.append("path", CandidTypeText{&path});
+  ic_api.from_wire(r_in);
+
+  if (name.empty()) {
+    send_lora_error_to_wire(ic_api, __func__, "name must not be empty");
+    return;
+  }
+
+  std::string error_msg;
+  if (icpp_load_lora(name, path, error_msg) != 0) {
+    send_lora_error_to_wire(ic_api, __func__, error_msg);
+    return;
+  }
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - loaded " << name
+            << " from " << path << std::endl;
+
+  CandidTypeRecord status_code_record;
+  status_code_record.append("status_code", CandidTypeNat16{200});
+  ic_api.to_wire(CandidTypeVariant{"Ok", status_code_record});
+}
+
+void select_lora() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_or_whitelisted(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+  std::string principal_id = ic_api.get_caller().get_text();
+
+  std::string name;
+  float scale = 1.0f;
+  CandidTypeRecord r_in;
+  r_in.append("name", CandidTypeText{&name});
+  r_in.append("scale", CandidTypeFloat32{&scale});
+  ic_api.from_wire(r_in);
+
+  if (!name.empty()) {
+    // Checked against the active model now for early feedback, and again at
+    // every run: the model may be swapped after this call.
+    std::vector<std::string> names = icpp_lora_names();
+    if (std::find(names.begin(), names.end(), name) == names.end()) {
+      send_lora_error_to_wire(ic_api, __func__,
+                              "LoRA adapter '" + name +
+                                  "' is not loaded for the active model");
+      return;
+    }
+  }
+
+  const LoraSelection selection =
+      name.empty() ? LoraSelection{} : LoraSelection{name, scale};
+  std::string error_msg;
+  if (!save_selection(principal_id, selection, error_msg)) {
+    send_lora_error_to_wire(ic_api, __func__, error_msg);
+    return;
+  }
+  lora_selections[principal_id] = selection;
+
+  CandidTypeRecord status_code_record;
+  status_code_record.append("status_code", CandidTypeNat16{200});
+  ic_api.to_wire(CandidTypeVariant{"Ok", status_code_record});
+}
+
+void get_loras() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_or_whitelisted(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+  std::string principal_id = ic_api.get_caller().get_text();
+
+  const LoraSelection selection = find_selection(principal_id, false);
+
+  CandidTypeRecord r_out;
+  r_out.append("names", CandidTypeVecText{icpp_lora_names()});
+  r_out.append("selected", CandidTypeText{selection.name});
+  r_out.append("scale", CandidTypeFloat32{selection.scale});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
+
+void lora_cache_selection(const std::string &principal_id) {
+  find_selection(principal_id, true);
+}
+
+bool lora_apply_selection(const std::string &principal_id,
+                          std::string &error_msg) {
+  LoraSelection selection = find_selection(principal_id, false);
+  if (!selection.name.empty()) {
+    // Its adapter is gone with an upgrade or an eviction, or was loaded for
+    // another model: run without one instead of failing every run
+    std::vector<std::string> names = icpp_lora_names();
+    if (std::find(names.begin(), names.end(), selection.name) == names.end()) {
+      std::cout << "llama_cpp: " << std::string(__func__)
+                << " - Warning: LoRA adapter '" << selection.name
+                << "' selected by " << principal_id
+                << " is not loaded for the active model; running without it"
+                << std::endl;
+      selection = LoraSelection{};
+    }
+  }
+  return icpp_apply_lora(selection.name, selection.scale, error_msg) == 0;
+}
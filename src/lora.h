@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ic_api.h"
+#include "wasm_symbol.h"
+#include <string>
+
+// LoRA adapters on top of a resident base model.
+// An admin loads a named adapter once, from an uploaded gguf, for the active
+// model; it stays resident as long as that model does (adapters are freed
+// together with their model). Each principal selects the adapter (and scale)
+// their runs use; it is attached to the context per run, so many fine-tuned
+// variants are served at the memory cost of one base model.
+// The adapters are lost with their model in an upgrade, and must be loaded
+// again with load_lora; the selections are not: they are saved in
+// .canister_cache/<principal>/lora/selection.dat.
+// The attached adapter is part of the prompt-cache identity: a prompt-cache
+// written with another adapter (or none) is discarded and started cold.
+void load_lora() WASM_SYMBOL_EXPORTED("canister_update load_lora");
+void select_lora() WASM_SYMBOL_EXPORTED("canister_update select_lora");
+void get_loras() WASM_SYMBOL_EXPORTED("canister_query get_loras");
+
+// Reads the selection of this principal into the resident cache. Called on
+// the update path only: a query reads the selection file every time.
+void lora_cache_selection(const std::string &principal_id);
+
+// Attaches the adapter selected by this principal (or none) to the active
+// context. Called by main_ before every inference. A selection whose adapter
+// is not loaded for the active model runs without an adapter, with a warning
+// in the log, until the adapter is loaded again.
+bool lora_apply_selection(const std::string &principal_id,
+                          std::string &error_msg);
@@ -0,0 +1,176 @@
+// LZ4 block compression — implementation.
+// See lz4.h for the high-level contract.
+//
+// Block format: a sequence of
+//   token (4 bits literal length, 4 bits match length - 4)
+//   [literal length bytes] literals
+//   offset (2 bytes, little-endian) [match length bytes]
+// where a length nibble of 15 continues in bytes of 255 until a smaller one.
+// The last sequence has literals only. The end-of-block rules: the last 5
+// bytes are literals, and the last match starts at least 12 bytes before the
+// end.
+
+#include "lz4.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const size_t LZ4_MIN_MATCH = 4;
+const size_t LZ4_LAST_LITERALS = 5;
+const size_t LZ4_MF_LIMIT = 12;
+const size_t LZ4_MAX_OFFSET = 65535;
+const int LZ4_HASH_LOG = 16;
+
+uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t lz4_hash(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+// A length that does not fit its 4-bit nibble: the rest in bytes of 255
+void write_length(std::vector<uint8_t> &out, size_t len) {
+  while (len >= 255) {
+    out.push_back(255);
+    len -= 255;
+  }
+  out.push_back(static_cast<uint8_t>(len));
+}
+
+bool read_length(const uint8_t *src, size_t n, size_t &ip, size_t &len) {
+  uint8_t b;
+  do {
+    if (ip >= n) {
+      return false;
+    }
+    b = src[ip++];
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+void write_literals(std::vector<uint8_t> &out, const uint8_t *literals,
+                    size_t n_literals, uint8_t token_low) {
+  out.push_back(static_cast<uint8_t>(std::min<size_t>(n_literals, 15) << 4 |
+                                     token_low));
+  if (n_literals >= 15) {
+    write_length(out, n_literals - 15);
+  }
+  out.insert(out.end(), literals, literals + n_literals);
+}
+} // namespace
+
+void lz4_compress_block(const uint8_t *src, size_t n,
+                        std::vector<uint8_t> &out) {
+  out.clear();
+  out.reserve(n + n / 255 + 16); // worst case: incompressible
+
+  // Hash of 4 bytes -> their position + 1 (0 = empty)
+  std::vector<uint32_t> table(size_t{1} << LZ4_HASH_LOG, 0);
+
+  size_t anchor = 0; // start of the literals not yet written
+  size_t ip = 0;
+  if (n > LZ4_MF_LIMIT) {
+    const size_t match_start_limit = n - LZ4_MF_LIMIT;
+    const size_t match_end_limit = n - LZ4_LAST_LITERALS;
+    while (ip <= match_start_limit) {
+      const uint32_t sequence = read32(src + ip);
+      uint32_t &slot = table[lz4_hash(sequence)];
+      size_t ref = slot;
+      slot = static_cast<uint32_t>(ip + 1);
+      if (ref == 0 || ip - (ref - 1) > LZ4_MAX_OFFSET ||
+          read32(src + ref - 1) != sequence) {
+        ip++;
+        continue;
+      }
+      ref--;
+
+      // Extend the match backwards into the pending literals, then forwards
+      while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+        ip--;
+        ref--;
+      }
+      size_t len = LZ4_MIN_MATCH;
+      while (ip + len < match_end_limit && src[ip + len] == src[ref + len]) {
+        len++;
+      }
+
+      const size_t match_len = len - LZ4_MIN_MATCH;
+      write_literals(out, src + anchor, ip - anchor,
+                     static_cast<uint8_t>(std::min<size_t>(match_len, 15)));
+      const size_t offset = ip - ref;
+      out.push_back(static_cast<uint8_t>(offset & 0xff));
+      out.push_back(static_cast<uint8_t>(offset >> 8));
+      if (match_len >= 15) {
+        write_length(out, match_len - 15);
+      }
+
+      ip += len;
+      anchor = ip;
+    }
+  }
+  write_literals(out, src + anchor, n - anchor, 0);
+}
+
+bool lz4_decompress_block(const uint8_t *src, size_t n, size_t dst_size,
+                          std::vector<uint8_t> &out, std::string &error_msg) {
+  out.clear();
+  out.reserve(dst_size);
+
+  size_t ip = 0;
+  while (ip < n) {
+    const uint8_t token = src[ip++];
+
+    size_t n_literals = token >> 4;
+    if (n_literals == 15 && !read_length(src, n, ip, n_literals)) {
+      error_msg = "truncated literal length";
+      return false;
+    }
+    if (n_literals > n - ip || n_literals > dst_size - out.size()) {
+      error_msg = "literals run past the end of the block";
+      return false;
+    }
+    out.insert(out.end(), src + ip, src + ip + n_literals);
+    ip += n_literals;
+    if (ip == n) {
+      break; // the last sequence has no match
+    }
+
+    if (n - ip < 2) {
+      error_msg = "truncated match offset";
+      return false;
+    }
+    const size_t offset = src[ip] | (size_t{src[ip + 1]} << 8);
+    ip += 2;
+    if (offset == 0 || offset > out.size()) {
+      error_msg = "match offset " + std::to_string(offset) + " out of range";
+      return false;
+    }
+    size_t match_len = token & 0x0f;
+    if (match_len == 15 && !read_length(src, n, ip, match_len)) {
+      error_msg = "truncated match length";
+      return false;
+    }
+    match_len += LZ4_MIN_MATCH;
+    if (match_len > dst_size - out.size()) {
+      error_msg = "match runs past the uncompressed size";
+      return false;
+    }
+    // Byte by byte: a match may overlap the bytes it produces (offset < len)
+    const size_t from = out.size() - offset;
+    for (size_t k = 0; k < match_len; k++) {
+      out.push_back(out[from + k]);
+    }
+  }
+
+  if (out.size() != dst_size) {
+    error_msg = "decompressed to " + std::to_string(out.size()) +
+                " bytes, expected " + std::to_string(dst_size);
+    return false;
+  }
+  return true;
+}
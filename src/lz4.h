@@ -0,0 +1,25 @@
+// LZ4 block compression, for the compressed prompt-cache transfer endpoints.
+//
+// Implements the standard LZ4 *block* format (no frame header, no checksum),
+// so a chunk compressed here is read by any LZ4 implementation, e.g. Python's
+// lz4.block.decompress(data, uncompressed_size=...), and vice versa.
+//
+// Single-threaded and allocation-light: one 64K-entry hash table per call. The
+// compressor is the greedy single-probe variant (like LZ4's "fast" level 1);
+// for f16 KV tensors the gain comes mostly from the long runs of zeros in the
+// unused cells, which any LZ4 level finds.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compresses src[0..n) into out (replaced).
+void lz4_compress_block(const uint8_t *src, size_t n,
+                        std::vector<uint8_t> &out);
+
+// Decompresses the block src[0..n) into out (replaced), which must come out at
+// exactly dst_size bytes. Returns false with error_msg for a malformed block.
+bool lz4_decompress_block(const uint8_t *src, size_t n, size_t dst_size,
+                          std::vector<uint8_t> &out, std::string &error_msg);
@@ -2,7 +2,12 @@
 // Internet Computer SmartContract version of: tools/completion/completion.cpp
 // See: https://github.com/onicai/llama_cpp_onicai_fork/tree/master/tools/completion/README.md
 #include "main_.h"
+#include "allowed_tokens.h"
+#include "cache_index.h"
 #include "ic_api.h"
+#include "instructions.h"
+#include "lora.h"
+#include "model_registry.h"
 #include "promptcache.h"
 #include "utils.h"
 // ICPP-PATCH-END
@@ -22,17 +27,27 @@
 #endif
 #include "common.h"
 #include "console.h"
+#include "gguf.h"
+#include "llama-cpp.h"
 #include "llama.h"
 #include "log.h"
 #include "sampling.h"
 
+// ICPP-PATCH: internal header, for llama_context::memory_breakdown()
+#include "llama-context.h"
+
+#include <algorithm>
 #include <clocale>
+#include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <ctime>
+#include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -69,11 +84,56 @@ static bool is_interacting = false;
 static bool need_insert_eot = false;
 
 // ICPP-PATCH-START
-// The model & context must survive across canister update calls (Orthogonal
-// Persistence). Upstream's common_init_result owns both, so we keep the owning
-// pointer alive in static memory instead of release()-ing the model out of it.
-// They are freed together in icpp_free_model().
-static common_init_result_ptr g_llama_init;
+// A model & its context, resident in Orthogonal Persisted memory.
+struct IcppResidentModel {
+  std::string path; // --model
+
+  // Owners. Upstream's common_init_result owns both the model & the context,
+  // so we keep it alive instead of release()-ing the model out of it. The
+  // phased load creates them itself. (Declared model first, so the context
+  // is destroyed first.)
+  common_init_result_ptr llama_init;
+  llama_model_ptr model_owned;
+  llama_context_ptr ctx_owned;
+
+  llama_model *model = nullptr;
+  llama_context *ctx = nullptr;
+
+  uint64_t last_used_ns = 0; // for the LRU eviction
+
+  // The compute buffers (graph allocator) are reserved for the worst-case
+  // prefill (n_ubatch tokens) AND decode (1 token) graphs when the context is
+  // created. We record their size at load, and check after every decode that
+  // the hot path did not grow them: the wasm32 heap never shrinks, so a
+  // re-reservation permanently costs heap and fragments it.
+  uint64_t compute_buffer_bytes_at_load = 0;
+  uint64_t compute_buffer_reallocs = 0;
+
+  // KV cache types the context was created with. They are part of the
+  // prompt-cache identity: a session file holds the KV cache in these types.
+  ggml_type cache_type_k = GGML_TYPE_F16;
+  ggml_type cache_type_v = GGML_TYPE_F16;
+
+  // The other context args the context was created with. A run that reuses
+  // this model cannot change them: the context is not rebuilt.
+  int32_t n_ctx = 0;
+  int32_t n_batch = 0;
+  int32_t n_ubatch = 0;
+  llama_flash_attn_type flash_attn_type = LLAMA_FLASH_ATTN_TYPE_AUTO;
+
+  // LoRA adapters loaded on top of this model, by name (see lora.h). They are
+  // owned by the model, and freed together with it.
+  std::map<std::string, llama_adapter_lora *> loras;
+  // The adapter attached to the context, e.g. "name@1.00"; empty = none. Also
+  // part of the prompt-cache identity: the KV cache depends on it.
+  std::string applied_lora;
+};
+
+// The resident models (see model_registry.h), and the active one: the model &
+// context main_ runs with. g_model_persistent & g_ctx_persistent alias the
+// active entry, and are nullptr when no model is active.
+static std::vector<std::unique_ptr<IcppResidentModel>> g_resident_models;
+static IcppResidentModel *g_active_model = nullptr;
 static llama_model *g_model_persistent = nullptr;
 static llama_context *g_ctx_persistent = nullptr;
 
@@ -81,6 +141,320 @@ static llama_context *g_ctx_persistent = nullptr;
 // references, so llama_backend_free() must NOT be called at the end of main_().
 // It is called from icpp_free_model(), together with freeing the model.
 static bool g_backend_initialized = false;
+
+// Phased (multi-call) model load: load_model_begin, load_model_step (x2) and
+// load_model_finish. The weights and the context are created in separate
+// update calls, so the context's cost does not add to the weights' cost. The
+// weights themselves are still read in ONE call: a model whose weights alone
+// exceed the instruction limit needs a resumable loader in the fork. Until
+// finish, they are owned here and are NOT visible to main_; icpp_free_model
+// discards them.
+static IcppLoadPhase g_load_phase = IcppLoadPhase::NONE;
+static std::vector<std::string> g_load_args;
+static std::string g_load_model_path; // --model of the phased load
+static llama_model_ptr g_load_model;
+static llama_context_ptr g_load_ctx;
+
+// KV cache types with a wasm SIMD path through attention: the K·Q dot uses the
+// type's vec_dot (arch/wasm/quants.c for q8_0 & q4_0) and V is dequantized row
+// by row inside the CPU flash-attention kernel. Anything else falls back to the
+// generic scalar code, or is not supported by the CPU backend at all.
+static bool icpp_is_supported_cache_type(ggml_type type) {
+  return type == GGML_TYPE_F16 || type == GGML_TYPE_Q8_0 ||
+         type == GGML_TYPE_Q4_0;
+}
+
+// Canister-wide overrides of the parsed CLI args. Applied right after every
+// parse of the CLI args (main_ and the phased loader).
+static void icpp_clamp_params(common_params &params) {
+  // A canister is single threaded. Constructing a std::thread traps at runtime
+  // in this build, so clamp the thread counts right after parsing the CLI args.
+  params.cpuparams.n_threads = 1;
+  params.cpuparams_batch.n_threads = 1;
+
+  // b10076 defaults params.use_jinja to true (common.h), but common/jinja/* and
+  // common/chat*.cpp are not compiled into the canister (WASM globals limit) --
+  // src/wasi-chat-stubs.cpp traps if a template path is actually taken. Force it
+  // off so every downstream use_jinja branch is consistent with what is linked.
+  //
+  // This also keeps tokenization identical to b4531: upstream computes
+  //   add_bos = llama_vocab_get_add_bos(vocab) && !params.use_jinja
+  // which would silently flip add_bos to false and change tokenization.
+  params.use_jinja = false;
+
+  // A canister has no network. Force offline so the model-resolution path in
+  // common_params_handle_model (arg.cpp) skips common_download_run_tasks
+  // entirely. Models are uploaded into the virtual filesystem, never fetched.
+  params.offline = true;
+
+  // The model lives in the virtual filesystem (stable memory, through the
+  // ic-wasi-polyfill); there is no host file to mmap, so the loader must read
+  // the tensors with fread. It does so straight into the tensor buffers, one
+  // bulk read per tensor, without a staging copy. Warmup would run a full
+  // decode inside load_model, burning instructions for nothing in a canister.
+  // Both defaults are also patched in the fork's common.h, but that patch was
+  // silently lost in a merge once (README-0003 Bugs #3 & #4), and --mmap /
+  // --warmup on the command line would override it anyway. Force them here.
+  params.use_mmap = false;
+  params.warmup = false;
+}
+
+// Initialize the backend only once. It must stay alive for as long as the
+// persisted model exists (llama_backend_free is called by icpp_free_model).
+static void icpp_backend_init(const common_params &params) {
+  if (!g_backend_initialized) {
+    LOG_INF("%s: llama backend init\n", __func__);
+
+    llama_backend_init();
+    llama_numa_init(params.numa);
+
+    g_backend_initialized = true;
+  }
+}
+
+// Validate the KV cache types before the context is created. A quantized V
+// cache is only supported through flash attention; llama_context throws
+// otherwise, and in a canister a throw is a trap.
+static bool icpp_prepare_cache_types(common_params &params,
+                                     std::string &icpp_error_msg) {
+  for (const ggml_type type : {params.cache_type_k, params.cache_type_v}) {
+    if (!icpp_is_supported_cache_type(type)) {
+      icpp_error_msg = std::format(
+          "{}: error: unsupported KV cache type '{}' (use f16, q8_0 or q4_0)",
+          __func__, ggml_type_name(type));
+      LOG_ERR("%s\n", icpp_error_msg.c_str());
+      return false;
+    }
+  }
+  if (ggml_is_quantized(params.cache_type_v)) {
+    if (params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+      icpp_error_msg = std::format(
+          "{}: error: a quantized V cache ('{}') requires flash attention",
+          __func__, ggml_type_name(params.cache_type_v));
+      LOG_ERR("%s\n", icpp_error_msg.c_str());
+      return false;
+    }
+    params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+  }
+  return true;
+}
+
+// Sums the memory breakdown of a context over all buffer types.
+static IcppMemoryBreakdown icpp_sum_memory_breakdown(llama_context *ctx) {
+  IcppMemoryBreakdown mb;
+  for (const auto &[buft, data] : ctx->memory_breakdown()) {
+    (void)buft;
+    mb.model_bytes += data.model;
+    mb.context_bytes += data.context;
+    mb.compute_bytes += data.compute;
+  }
+  return mb;
+}
+
+// The compute buffers must not have grown beyond the worst-case reservation
+// made at load. If they did, a graph shape escaped the reservation (e.g. a
+// batch larger than n_ubatch); count it so get_memory_status exposes it.
+// Called right after every llama_decode, so a call that returns early (the
+// max_tokens budget, an error) still records it.
+static void icpp_check_compute_buffers(llama_context *ctx) {
+  if (g_active_model == nullptr) {
+    return;
+  }
+  const IcppMemoryBreakdown mb = icpp_sum_memory_breakdown(ctx);
+  if (mb.compute_bytes > g_active_model->compute_buffer_bytes_at_load) {
+    LOG_WRN("%s: compute buffers were re-reserved on the inference path: "
+            "%llu -> %llu bytes\n",
+            __func__,
+            (unsigned long long)g_active_model->compute_buffer_bytes_at_load,
+            (unsigned long long)mb.compute_bytes);
+    g_active_model->compute_buffer_reallocs++;
+    g_active_model->compute_buffer_bytes_at_load = mb.compute_bytes;
+  }
+}
+
+static void icpp_activate_model(IcppResidentModel *entry) {
+  g_active_model = entry;
+  g_model_persistent = entry ? entry->model : nullptr;
+  g_ctx_persistent = entry ? entry->ctx : nullptr;
+  if (entry) {
+    entry->last_used_ns = IC_API::time();
+  }
+}
+
+// Reads an unsigned integer hyperparameter of the gguf's architecture, e.g.
+// "llama.block_count". Returns `fallback` when it is missing or per-layer.
+static uint64_t icpp_gguf_arch_u32(const gguf_context *gguf,
+                                   const std::string &arch,
+                                   const std::string &key, uint64_t fallback) {
+  const int64_t id = gguf_find_key(gguf, (arch + "." + key).c_str());
+  if (id < 0 || gguf_get_kv_type(gguf, id) != GGUF_TYPE_UINT32) {
+    return fallback;
+  }
+  return gguf_get_val_u32(gguf, id);
+}
+
+// Estimates the heap a model from params.model.path will take once loaded:
+// the weights (≈ the file size), the KV cache and the compute buffers. The
+// KV cache and compute buffers follow from the hparams in the gguf header and
+// the context args; the compute buffers are an upper-bound estimate of the
+// largest graph: the logits of a ubatch, plus the KQ matrix without flash
+// attention, plus the feed-forward activations.
+static uint64_t icpp_estimate_model_bytes(const common_params &params) {
+  std::error_code ec;
+  uint64_t file_bytes = std::filesystem::file_size(params.model.path, ec);
+  if (ec) {
+    return 0;
+  }
+
+  gguf_init_params gguf_params = {/*no_alloc =*/true, /*ctx =*/nullptr};
+  gguf_context *gguf =
+      gguf_init_from_file(params.model.path.c_str(), gguf_params);
+  if (gguf == nullptr) {
+    return file_bytes;
+  }
+
+  std::string arch;
+  const int64_t arch_id = gguf_find_key(gguf, "general.architecture");
+  if (arch_id >= 0) {
+    arch = gguf_get_val_str(gguf, arch_id);
+  }
+  uint64_t n_vocab = 0;
+  const int64_t tokens_id = gguf_find_key(gguf, "tokenizer.ggml.tokens");
+  if (tokens_id >= 0) {
+    n_vocab = gguf_get_arr_n(gguf, tokens_id);
+  }
+  const uint64_t n_layer = icpp_gguf_arch_u32(gguf, arch, "block_count", 0);
+  const uint64_t n_embd = icpp_gguf_arch_u32(gguf, arch, "embedding_length", 0);
+  const uint64_t n_ff = icpp_gguf_arch_u32(gguf, arch, "feed_forward_length", 0);
+  const uint64_t n_head =
+      icpp_gguf_arch_u32(gguf, arch, "attention.head_count", 1);
+  const uint64_t n_head_kv =
+      icpp_gguf_arch_u32(gguf, arch, "attention.head_count_kv", n_head);
+  const uint64_t head_dim = n_head > 0 ? n_embd / n_head : 0;
+  const uint64_t n_embd_k =
+      n_head_kv * icpp_gguf_arch_u32(gguf, arch, "attention.key_length",
+                                     head_dim);
+  const uint64_t n_embd_v =
+      n_head_kv * icpp_gguf_arch_u32(gguf, arch, "attention.value_length",
+                                     head_dim);
+  const uint64_t n_ctx_train =
+      icpp_gguf_arch_u32(gguf, arch, "context_length", 0);
+  gguf_free(gguf);
+
+  const uint64_t n_ctx = params.n_ctx > 0 ? params.n_ctx : n_ctx_train;
+  const uint64_t n_ubatch = std::min<uint64_t>(params.n_ubatch, n_ctx);
+
+  // ggml_row_size of a quantized type counts whole blocks; n_embd_k/v are a
+  // multiple of the block size for every supported cache type.
+  const uint64_t kv_bytes =
+      n_ctx * n_layer *
+      (ggml_row_size(params.cache_type_k, n_embd_k) +
+       ggml_row_size(params.cache_type_v, n_embd_v));
+
+  uint64_t compute_floats = n_ubatch * (n_vocab + 2 * n_ff + 4 * n_embd);
+  if (params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+    compute_floats += n_ubatch * n_ctx * n_head;
+  }
+  return file_bytes + kv_bytes + compute_floats * sizeof(float);
+}
+
+// Evict least recently used models until the model of params fits: fewer
+// than max_resident_models, and -- with a budget -- the resident bytes plus
+// the model's estimated footprint (icpp_estimate_model_bytes) within
+// resident_models_budget_bytes.
+static void icpp_make_room_for_model(const common_params &params) {
+  uint64_t needed = 0;
+  if (resident_models_budget_bytes > 0 && !g_resident_models.empty()) {
+    needed = icpp_estimate_model_bytes(params);
+    LOG_INF("%s: %s needs an estimated %.2f MiB\n", __func__,
+            params.model.path.c_str(), needed / 1024.0 / 1024.0);
+  }
+  while (!g_resident_models.empty()) {
+    uint64_t resident_bytes = 0;
+    for (const auto &entry : g_resident_models) {
+      const IcppMemoryBreakdown mb = icpp_sum_memory_breakdown(entry->ctx);
+      resident_bytes += mb.model_bytes + mb.context_bytes + mb.compute_bytes;
+    }
+    const bool too_many = g_resident_models.size() >= max_resident_models;
+    const bool too_big = resident_models_budget_bytes > 0 &&
+                         resident_bytes + needed > resident_models_budget_bytes;
+    if (!too_many && !too_big) {
+      break;
+    }
+    auto lru = std::min_element(
+        g_resident_models.begin(), g_resident_models.end(),
+        [](const auto &a, const auto &b) {
+          return a->last_used_ns < b->last_used_ns;
+        });
+    const std::string evicted = (*lru)->path;
+    LOG_INF("%s: evicting resident model %s\n", __func__, evicted.c_str());
+    icpp_unload_model(evicted);
+  }
+}
+
+// A run with the --model of a resident model runs with the context that model
+// was loaded with. Refuse context args that ask for another one, instead of
+// silently ignoring them. Args left at their default do not ask for anything.
+static bool icpp_check_context_params(const common_params &params,
+                                      std::string &icpp_error_msg) {
+  if (g_active_model == nullptr) {
+    return true;
+  }
+  const common_params defaults{};
+  std::string differ;
+  auto check = [&](const char *arg, bool is_default, bool is_same) {
+    if (!is_default && !is_same) {
+      differ += differ.empty() ? arg : std::string(", ") + arg;
+    }
+  };
+  check("-c", params.n_ctx == defaults.n_ctx,
+        params.n_ctx == g_active_model->n_ctx);
+  check("--batch-size", params.n_batch == defaults.n_batch,
+        params.n_batch == g_active_model->n_batch);
+  check("--ubatch-size", params.n_ubatch == defaults.n_ubatch,
+        params.n_ubatch == g_active_model->n_ubatch);
+  check("--cache-type-k", params.cache_type_k == defaults.cache_type_k,
+        params.cache_type_k == g_active_model->cache_type_k);
+  check("--cache-type-v", params.cache_type_v == defaults.cache_type_v,
+        params.cache_type_v == g_active_model->cache_type_v);
+  check("--flash-attn", params.flash_attn_type == defaults.flash_attn_type,
+        params.flash_attn_type == g_active_model->flash_attn_type);
+  if (differ.empty()) {
+    return true;
+  }
+  icpp_error_msg = std::format(
+      "{}: error: model {} is resident with other context args ({}); call "
+      "load_model with the new args to rebuild its context",
+      __func__, g_active_model->path, differ);
+  LOG_ERR("%s\n", icpp_error_msg.c_str());
+  return false;
+}
+
+// Add a freshly loaded model to the resident models and make it the active one.
+// Records what its context was created with: the KV cache types and the compute
+// buffers reserved for the worst-case graphs.
+static void icpp_register_model(std::unique_ptr<IcppResidentModel> entry,
+                                const common_params &params) {
+  entry->cache_type_k = params.cache_type_k;
+  entry->cache_type_v = params.cache_type_v;
+  entry->n_ctx = params.n_ctx;
+  entry->n_batch = params.n_batch;
+  entry->n_ubatch = params.n_ubatch;
+  entry->flash_attn_type = params.flash_attn_type;
+
+  const IcppMemoryBreakdown mb = icpp_sum_memory_breakdown(entry->ctx);
+  entry->compute_buffer_bytes_at_load = mb.compute_bytes;
+  entry->compute_buffer_reallocs = 0;
+
+  g_resident_models.push_back(std::move(entry));
+  icpp_activate_model(g_resident_models.back().get());
+
+  LOG_INF("%s: reserved compute buffers = %.2f MiB (model = %.2f MiB, "
+          "context = %.2f MiB), %zu resident model(s)\n",
+          __func__, mb.compute_bytes / 1024.0 / 1024.0,
+          mb.model_bytes / 1024.0 / 1024.0, mb.context_bytes / 1024.0 / 1024.0,
+          g_resident_models.size());
+}
 // ICPP-PATCH-END
 
 static void print_usage(int argc, char **argv) {
@@ -135,7 +509,8 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
           std::string &prompt_remaining, bool &generated_eog,
           uint64_t &n_prompt_tokens, uint64_t &n_prompt_tokens_cached,
           uint64_t &n_prompt_tokens_decoded, uint64_t &n_tokens_generated,
-          uint64_t &n_prompt_tokens_remaining) {
+          uint64_t &n_prompt_tokens_remaining,
+          IcppPhaseInstructions &phase_instructions) {
   // Exact token accounting (put on the wire by run.cpp). Initialize to 0 so the
   // early return-sites below (embedding tool, load_model_only) report 0; the real
   // values are assigned just before the success `return 0;` at the end.
@@ -144,6 +519,9 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
   n_prompt_tokens_decoded = 0;
   n_tokens_generated = 0;
   n_prompt_tokens_remaining = 0;
+  // ICPP-PATCH: instructions per phase, accumulated where each phase runs.
+  phase_instructions = IcppPhaseInstructions{};
+  uint64_t phase_start = 0;
   LOG_INF("%s: Called with following arguments:\n", __func__);
   LOG_INF("- principal_id    = %s\n", principal_id.c_str());
   LOG_INF("- load_model_only = %s\n",
@@ -154,6 +532,7 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
 
   g_params = &params;
 
+  phase_start = instruction_counter(); // ICPP-PATCH
   if (!common_params_parse(argc, argv, params, LLAMA_EXAMPLE_COMPLETION,
                            print_usage)) {
     // ICPP-PATCH-START
@@ -161,28 +540,10 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
     // ICPP-PATCH-END
     return 1;
   }
+  phase_instructions.arg_parse += instruction_counter() - phase_start; // ICPP-PATCH
 
-  // ICPP-PATCH-START
-  // A canister is single threaded. Constructing a std::thread traps at runtime
-  // in this build, so clamp the thread counts right after parsing the CLI args.
-  params.cpuparams.n_threads = 1;
-  params.cpuparams_batch.n_threads = 1;
-
-  // b10076 defaults params.use_jinja to true (common.h), but common/jinja/* and
-  // common/chat*.cpp are not compiled into the canister (WASM globals limit) --
-  // src/wasi-chat-stubs.cpp traps if a template path is actually taken. Force it
-  // off so every downstream use_jinja branch is consistent with what is linked.
-  //
-  // This also keeps tokenization identical to b4531: upstream computes
-  //   add_bos = llama_vocab_get_add_bos(vocab) && !params.use_jinja
-  // which would silently flip add_bos to false and change tokenization.
-  params.use_jinja = false;
-
-  // A canister has no network. Force offline so the model-resolution path in
-  // common_params_handle_model (arg.cpp) skips common_download_run_tasks
-  // entirely. Models are uploaded into the virtual filesystem, never fetched.
-  params.offline = true;
-  // ICPP-PATCH-END
+  // ICPP-PATCH: canister-wide clamps (threads, jinja, offline)
+  icpp_clamp_params(params);
 
   common_init();
 
@@ -221,16 +582,19 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
             params.rope_freq_scale);
   }
 
-  // ICPP-PATCH-START
-  // Initialize the backend only once. It must stay alive for as long as the
-  // persisted model exists (llama_backend_free is called by icpp_free_model).
-  if (!g_backend_initialized) {
-    LOG_INF("%s: llama backend init\n", __func__);
-
-    llama_backend_init();
-    llama_numa_init(params.numa);
+  // ICPP-PATCH: initialize the backend only once (see icpp_backend_init)
+  icpp_backend_init(params);
 
-    g_backend_initialized = true;
+  // ICPP-PATCH-START
+  // A phased load owns a partial model until load_model_finish. Do not start a
+  // second, regular load of that same model on top of it. The other resident
+  // models keep serving.
+  if (g_load_phase != IcppLoadPhase::NONE &&
+      params.model.path == g_load_model_path) {
+    icpp_error_msg = std::format(
+        "{}: error: a phased load of {} is in progress ({})", __func__,
+        g_load_model_path, icpp_load_model_progress());
+    return 1;
   }
   // ICPP-PATCH-END
 
@@ -260,23 +624,40 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
 
   // ICPP-PATCH-START
   // Load the model & context only once and keep them alive in Orthogonal
-  // Persisted memory. Ownership stays with the static g_llama_init, so that
-  // icpp_free_model() can release model + context together.
+  // Persisted memory, as a resident model. Ownership stays with its
+  // common_init_result, so that model + context are released together.
   if (model == nullptr) {
-    g_llama_init = common_init_from_params(params);
+    if (!icpp_prepare_cache_types(params, icpp_error_msg)) {
+      return 1;
+    }
+
+    icpp_make_room_for_model(params);
+
+    auto entry = std::make_unique<IcppResidentModel>();
+    entry->path = params.model.path;
+    entry->llama_init = common_init_from_params(params);
 
-    if (!g_llama_init) {
+    if (!entry->llama_init) {
       LOG_ERR("%s: error: common_init_from_params returned null\n", __func__);
       icpp_error_msg = std::format(
           "{}: error: common_init_from_params returned null)", __func__);
       return 1;
     }
 
-    model = g_llama_init->model();
-    ctx = g_llama_init->context();
+    entry->model = entry->llama_init->model();
+    entry->ctx = entry->llama_init->context();
+
+    // Only a complete model & context becomes resident; errors below
+    if (entry->model != nullptr && entry->ctx != nullptr) {
+      icpp_register_model(std::move(entry), params);
+    }
   } else {
     LOG_INF("%s: reusing the model & context loaded in a previous call\n",
             __func__);
+    if (!params.model.path.empty() &&
+        !icpp_check_context_params(params, icpp_error_msg)) {
+      return 1;
+    }
   }
   // ICPP-PATCH-END
 
@@ -303,6 +684,11 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
     return 0;
   }
 
+  // Attach the LoRA adapter this principal selected, if any
+  if (!lora_apply_selection(principal_id, icpp_error_msg)) {
+    return 1;
+  }
+
   // The context is reused across calls, so we must start each inference call
   // from a clean memory. When a prompt-cache is used, the KV cache is restored
   // from the session file further down (llama_state_load_file).
@@ -463,6 +849,7 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
   // ICPP-PATCH-END
   std::vector<llama_token> session_tokens;
 
+  phase_start = instruction_counter(); // ICPP-PATCH
   if (!path_session.empty()) {
     LOG_INF("%s: attempting to load saved session from '%s'\n", __func__,
             path_session.c_str());
@@ -504,10 +891,12 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
         return 1;
       }
       session_tokens.resize(n_token_count_out);
+      cache_index_note_access(path_session); // ICPP-PATCH: LRU for quotas
       LOG_INF("%s: loaded a session with prompt size of %d tokens\n", __func__,
               (int)session_tokens.size());
     }
   }
+  phase_instructions.session_load += instruction_counter() - phase_start; // ICPP-PATCH
 
   // ICPP-PATCH: upstream added '&& !params.use_jinja', but jinja/chat templates
   //             are not compiled into the canister, so we keep our own logic.
@@ -555,7 +944,10 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
     if (params.interactive_first || !params.prompt.empty() ||
         session_tokens.empty()) {
       LOG_DBG("tokenize the prompt\n");
+      phase_start = instruction_counter(); // ICPP-PATCH
       embd_inp = common_tokenize(ctx, prompt, true, true);
+      phase_instructions.tokenization +=
+          instruction_counter() - phase_start; // ICPP-PATCH
     } else {
       LOG_DBG("use session tokens\n");
       embd_inp = session_tokens;
@@ -753,15 +1145,42 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
     }
   }
 
+  // ICPP-PATCH-START
+  // Restricted generation: the allowed-tokens sampler goes first in the chain,
+  // so no sampler can pick another token, and the ones after it only walk the
+  // allowed tokens instead of the whole vocabulary.
+  llama_sampler *allowed_sampler = nullptr;
+  if (!allowed_token_ids.empty()) {
+    allowed_sampler = allowed_tokens_sampler_init(vocab, icpp_error_msg);
+    if (allowed_sampler == nullptr) {
+      LOG_ERR("%s\n", icpp_error_msg.c_str());
+      return 1;
+    }
+  }
+  // ICPP-PATCH-END
+
   // ICPP-PATCH: upstream now takes the sampler from common_init_result, but
   //             that one is owned by the persisted g_llama_init. We create &
   //             free our own sampler for each call instead.
   smpl = common_sampler_init(model, sparams);
   if (!smpl) {
     LOG_ERR("%s: failed to initialize sampling subsystem\n", __func__);
+    // ICPP-PATCH-START
+    if (allowed_sampler != nullptr) {
+      llama_sampler_free(allowed_sampler);
+    }
+    // ICPP-PATCH-END
     return 1;
   }
 
+  // ICPP-PATCH-START
+  if (allowed_sampler != nullptr) {
+    allowed_tokens_sampler_prepend(common_sampler_get(smpl), allowed_sampler);
+    LOG_INF("%s: generation restricted to %zu allowed tokens\n", __func__,
+            allowed_token_ids.size());
+  }
+  // ICPP-PATCH-END
+
   LOG_INF("sampler seed: %u\n", common_sampler_get_seed(smpl));
   LOG_INF("sampler params: \n%s\n", sparams.print().c_str());
   LOG_INF("sampler chain: %s\n", common_sampler_print(smpl).c_str());
@@ -831,6 +1250,9 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
   // ICPP-PATCH-START
   // We can only handle max_tokens evaluations per call
   int n_eval_total = 0;
+  // ICPP-PATCH: whether embd holds a sampled token (generation) or prompt
+  //             tokens (prefill), to attribute the decode instructions.
+  bool embd_is_generated = false;
   // We break out of the while loop below a little bit different at end of generation
   // we actually first go back one more time, to store the eog token in the conversation & cache,
   // while llama.cpp does not do that
@@ -1030,7 +1452,11 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
 
         LOG_DBG("eval: %s\n", string_from(ctx, embd).c_str());
 
-        if (llama_decode(ctx, llama_batch_get_one(&embd[i], n_eval))) {
+        phase_start = instruction_counter(); // ICPP-PATCH
+        const int decode_result =
+            llama_decode(ctx, llama_batch_get_one(&embd[i], n_eval));
+        icpp_check_compute_buffers(ctx); // ICPP-PATCH
+        if (decode_result != 0) {
           LOG_ERR("%s : failed to eval\n", __func__);
           // ICPP-PATCH-START
           icpp_error_msg =
@@ -1038,6 +1464,13 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
           // ICPP-PATCH-END
           return 1;
         }
+        // ICPP-PATCH-START
+        if (embd_is_generated) {
+          phase_instructions.generation += instruction_counter() - phase_start;
+        } else {
+          phase_instructions.prefill += instruction_counter() - phase_start;
+        }
+        // ICPP-PATCH-END
 
         n_past += n_eval;
 
@@ -1118,19 +1551,27 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
         LOG_INF("%s", msg.c_str());
         // ICPP-PATCH-END
         need_to_save_session = false;
+        phase_start = instruction_counter(); // ICPP-PATCH
         llama_state_save_file(ctx, path_session.c_str(), session_tokens.data(),
                               session_tokens.size());
+        // ICPP-PATCH-START
+        phase_instructions.session_save += instruction_counter() - phase_start;
+        cache_index_note_write(path_session);
+        // ICPP-PATCH-END
 
         LOG_DBG("saved session to %s\n", path_session.c_str());
       }
 
+      phase_start = instruction_counter(); // ICPP-PATCH
       const llama_token id = common_sampler_sample(smpl, ctx, -1);
 
       common_sampler_accept(smpl, id, /* accept_grammar= */ true);
+      phase_instructions.sampling += instruction_counter() - phase_start; // ICPP-PATCH
 
       // LOG_DBG("last: %s\n", string_from(ctx, smpl->prev.to_vector()).c_str());
 
       embd.push_back(id);
+      embd_is_generated = true; // ICPP-PATCH
 
       // echo this to console
       input_echo = true;
@@ -1143,6 +1584,7 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
       // some user input remains from prompt or interaction, forward it to processing
       LOG_DBG("embd_inp.size(): %d, n_consumed: %d\n", (int)embd_inp.size(),
               n_consumed);
+      embd_is_generated = false; // ICPP-PATCH
       while ((int)embd_inp.size() > n_consumed) {
         embd.push_back(embd_inp[n_consumed]);
 
@@ -1455,8 +1897,12 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
   if (!path_session.empty() && !params.prompt_cache_ro) {
     LOG("\n%s: saving final output to session file '%s'\n", __func__,
         path_session.c_str());
+    phase_start = instruction_counter(); // ICPP-PATCH
     llama_state_save_file(ctx, path_session.c_str(), session_tokens.data(),
                           session_tokens.size());
+    phase_instructions.session_save +=
+        instruction_counter() - phase_start; // ICPP-PATCH
+    cache_index_note_write(path_session); // ICPP-PATCH
     // ICPP-PATCH: (re)stamp the sidecar so it always describes the file we
     // just wrote, with the model that wrote it. Without this, a cache the
     // load above discarded would be re-created unstamped and discarded again
@@ -1504,15 +1950,15 @@ int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
 // ICPP-PATCH-START:
 // functions added for running on IC
 
-// Function to be called by the canister to free the model which is persisted in Orthogonal Persisted memory
+// Function to be called by the canister to free all models which are persisted in Orthogonal Persisted memory
 void icpp_free_model() {
-  // The static common_init_result owns both the model and the context, so
-  // resetting it frees them together. (Upstream no longer allows releasing the
-  // model out of it, so we must not call llama_model_free ourselves.)
-  g_llama_init.reset();
+  // Each resident model's owners free its model and context together.
+  // (Upstream no longer allows releasing the model out of common_init_result,
+  // so we must not call llama_model_free ourselves.)
+  icpp_activate_model(nullptr);
+  g_resident_models.clear();
 
-  g_model_persistent = nullptr;
-  g_ctx_persistent = nullptr;
+  icpp_load_model_abort();
 
   if (g_model) {
     *g_model = nullptr;
@@ -1525,6 +1971,321 @@ void icpp_free_model() {
   g_backend_initialized = false;
 }
 
+// --- Phased model load -------------------------------------------------------
+
+// Parse the args stored by icpp_load_model_begin into params.
+static bool icpp_load_model_parse(common_params &params,
+                                  std::string &icpp_error_msg) {
+  std::vector<char *> argv;
+  for (std::string &arg : g_load_args) {
+    argv.push_back(arg.data());
+  }
+  if (!common_params_parse((int)argv.size(), argv.data(), params,
+                           LLAMA_EXAMPLE_COMPLETION, print_usage)) {
+    icpp_error_msg = "Error in common_params_parse.";
+    return false;
+  }
+  icpp_clamp_params(params);
+  return true;
+}
+
+void icpp_load_model_abort() {
+  // A phased load owns model & context until load_model_finish hands them
+  // over to a resident model. Free the context first.
+  g_load_ctx.reset();
+  g_load_model.reset();
+  g_load_phase = IcppLoadPhase::NONE;
+  g_load_args.clear();
+  g_load_model_path.clear();
+}
+
+void icpp_load_model_abort(const std::string &model_path) {
+  if (g_load_phase != IcppLoadPhase::NONE && g_load_model_path == model_path) {
+    icpp_load_model_abort();
+  }
+}
+
+std::vector<std::string> icpp_load_model_args() {
+  if (g_load_args.empty()) return {};
+  return std::vector<std::string>(g_load_args.begin() + 1, g_load_args.end());
+}
+
+int icpp_load_model_begin(int argc, char **argv, std::string &icpp_error_msg) {
+  // There is one phased load at a time: discard whatever was partially loaded
+  // before, saying so when it was another model.
+  if (g_load_phase != IcppLoadPhase::NONE) {
+    LOG_INF("%s: discarding the phased load of %s (%s)\n", __func__,
+            g_load_model_path.c_str(), icpp_load_model_progress().c_str());
+  }
+  icpp_load_model_abort();
+
+  g_load_args.assign(argv, argv + argc);
+
+  common_params params;
+  if (!icpp_load_model_parse(params, icpp_error_msg)) {
+    g_load_args.clear();
+    return 1;
+  }
+  if (params.model.path.empty()) {
+    icpp_error_msg = "--model not provided in args. Do not know what model to load.";
+    g_load_args.clear();
+    return 1;
+  }
+  // common_init_from_params applies these, the phased loader does not.
+  if (!params.lora_adapters.empty() || !params.control_vectors.empty()) {
+    icpp_error_msg = std::format(
+        "{}: error: --lora and --control-vector are not supported by the "
+        "phased load; use load_model",
+        __func__);
+    g_load_args.clear();
+    return 1;
+  }
+  if (!std::filesystem::exists(params.model.path)) {
+    icpp_error_msg = std::format("{}: error: model file not found: {}",
+                                 __func__, params.model.path);
+    g_load_args.clear();
+    return 1;
+  }
+  if (!icpp_prepare_cache_types(params, icpp_error_msg)) {
+    g_load_args.clear();
+    return 1;
+  }
+
+  // The model is loaded again, with these args
+  icpp_unload_model(params.model.path);
+
+  g_load_model_path = params.model.path;
+  g_load_phase = IcppLoadPhase::BEGUN;
+  return 0;
+}
+
+int icpp_load_model_step(std::string &icpp_error_msg,
+                         std::string &progress_msg) {
+  common_params params;
+  if (!icpp_load_model_parse(params, icpp_error_msg)) {
+    return 1;
+  }
+  common_init();
+  icpp_backend_init(params);
+
+  const uint64_t instructions_start = instruction_counter();
+
+  switch (g_load_phase) {
+  case IcppLoadPhase::BEGUN: {
+    // Step 1: the weights. This reads every tensor out of the file.
+    icpp_make_room_for_model(params);
+    llama_model_params mparams = common_model_params_to_llama(params);
+    g_load_model.reset(
+        llama_model_load_from_file(params.model.path.c_str(), mparams));
+    if (!g_load_model) {
+      icpp_error_msg = std::format("{}: error: unable to load model {}",
+                                   __func__, params.model.path);
+      return 1;
+    }
+    g_load_phase = IcppLoadPhase::MODEL_LOADED;
+    break;
+  }
+  case IcppLoadPhase::MODEL_LOADED: {
+    // Step 2: the context -- KV cache and the worst-case compute buffers.
+    if (!icpp_prepare_cache_types(params, icpp_error_msg)) {
+      return 1;
+    }
+    llama_context_params cparams = common_context_params_to_llama(params);
+    g_load_ctx.reset(llama_init_from_model(g_load_model.get(), cparams));
+    if (!g_load_ctx) {
+      icpp_error_msg =
+          std::format("{}: error: unable to create context", __func__);
+      return 1;
+    }
+    g_load_phase = IcppLoadPhase::CONTEXT_CREATED;
+    break;
+  }
+  case IcppLoadPhase::CONTEXT_CREATED:
+    progress_msg = icpp_load_model_progress() + " - call load_model_finish";
+    return 0;
+  case IcppLoadPhase::NONE:
+  default:
+    icpp_error_msg = "No model load in progress. Call load_model_begin first.";
+    return 1;
+  }
+
+  progress_msg = std::format("{} ({} instructions)", icpp_load_model_progress(),
+                             instruction_counter() - instructions_start);
+  return 0;
+}
+
+int icpp_load_model_finish(std::string &icpp_error_msg) {
+  if (g_load_phase != IcppLoadPhase::CONTEXT_CREATED) {
+    icpp_error_msg = std::format(
+        "{}: error: the model is not fully loaded yet ({})", __func__,
+        icpp_load_model_progress());
+    return 1;
+  }
+  common_params params;
+  if (!icpp_load_model_parse(params, icpp_error_msg)) {
+    return 1;
+  }
+  if (!icpp_prepare_cache_types(params, icpp_error_msg)) {
+    return 1;
+  }
+
+  // Hand over to main_, as the active resident model
+  auto entry = std::make_unique<IcppResidentModel>();
+  entry->path = params.model.path;
+  entry->model = g_load_model.get();
+  entry->ctx = g_load_ctx.get();
+  entry->model_owned = std::move(g_load_model);
+  entry->ctx_owned = std::move(g_load_ctx);
+  icpp_register_model(std::move(entry), params);
+  g_model = &g_model_persistent;
+
+  icpp_load_model_abort();
+  return 0;
+}
+
+std::string icpp_load_model_progress() {
+  switch (g_load_phase) {
+  case IcppLoadPhase::BEGUN:
+    return "step 0/2: args validated, model weights not yet loaded";
+  case IcppLoadPhase::MODEL_LOADED:
+    return "step 1/2: model weights loaded, context not yet created";
+  case IcppLoadPhase::CONTEXT_CREATED:
+    return "step 2/2: model weights loaded, context created";
+  case IcppLoadPhase::NONE:
+  default:
+    return "";
+  }
+}
+
+// The memory breakdown of the active model & context.
+// Returns false when no model is active.
+bool icpp_get_memory_breakdown(IcppMemoryBreakdown &mb) {
+  mb = IcppMemoryBreakdown{};
+  if (g_active_model == nullptr) {
+    return false;
+  }
+  mb = icpp_sum_memory_breakdown(g_active_model->ctx);
+  mb.compute_bytes_at_load = g_active_model->compute_buffer_bytes_at_load;
+  mb.compute_reallocs = g_active_model->compute_buffer_reallocs;
+  return true;
+}
+
+// KV cache types of the active context, e.g. "q8_0/q8_0" (K/V).
+std::string icpp_kv_cache_types() {
+  const ggml_type type_k =
+      g_active_model ? g_active_model->cache_type_k : GGML_TYPE_F16;
+  const ggml_type type_v =
+      g_active_model ? g_active_model->cache_type_v : GGML_TYPE_F16;
+  return std::string(ggml_type_name(type_k)) + "/" + ggml_type_name(type_v);
+}
+
+bool icpp_select_model(const std::string &path) {
+  for (const auto &entry : g_resident_models) {
+    if (entry->path == path) {
+      icpp_activate_model(entry.get());
+      return true;
+    }
+  }
+  // Not resident: main_ loads it (and makes room for it) on the next call
+  icpp_activate_model(nullptr);
+  return false;
+}
+
+void icpp_unload_model(const std::string &path) {
+  for (auto it = g_resident_models.begin(); it != g_resident_models.end();
+       ++it) {
+    if ((*it)->path == path) {
+      if (g_active_model == it->get()) {
+        icpp_activate_model(nullptr);
+      }
+      g_resident_models.erase(it);
+      return;
+    }
+  }
+}
+
+int icpp_load_lora(const std::string &name, const std::string &path,
+                   std::string &icpp_error_msg) {
+  if (g_active_model == nullptr) {
+    icpp_error_msg = "No model loaded. Load the base model first.";
+    return 1;
+  }
+  if (g_active_model->loras.count(name)) {
+    icpp_error_msg = std::format("LoRA adapter '{}' is already loaded", name);
+    return 1;
+  }
+  if (!std::filesystem::exists(path)) {
+    icpp_error_msg = std::format("LoRA adapter file not found: {}", path);
+    return 1;
+  }
+  llama_adapter_lora *adapter =
+      llama_adapter_lora_init(g_active_model->model, path.c_str());
+  if (adapter == nullptr) {
+    icpp_error_msg = std::format(
+        "Unable to load LoRA adapter {} for model {}", path,
+        g_active_model->path);
+    return 1;
+  }
+  g_active_model->loras[name] = adapter;
+  return 0;
+}
+
+int icpp_apply_lora(const std::string &name, float scale,
+                    std::string &icpp_error_msg) {
+  if (g_active_model == nullptr) {
+    return 0; // nothing to attach to; main_ loads the model first
+  }
+  std::vector<common_adapter_lora_info> lora;
+  std::string applied;
+  if (!name.empty()) {
+    auto it = g_active_model->loras.find(name);
+    if (it == g_active_model->loras.end()) {
+      icpp_error_msg =
+          std::format("LoRA adapter '{}' is not loaded for model {}", name,
+                      g_active_model->path);
+      return 1;
+    }
+    common_adapter_lora_info info;
+    info.scale = scale;
+    info.ptr = it->second;
+    lora.push_back(info);
+    applied = std::format("{}@{:.2f}", name, scale);
+  }
+  // The adapters are attached to the context, not merged into the weights,
+  // so switching them is cheap. Skip it when nothing changes.
+  if (applied != g_active_model->applied_lora) {
+    common_set_adapter_lora(g_active_model->ctx, lora);
+    g_active_model->applied_lora = applied;
+  }
+  return 0;
+}
+
+std::vector<std::string> icpp_lora_names() {
+  std::vector<std::string> names;
+  if (g_active_model) {
+    for (const auto &[name, adapter] : g_active_model->loras) {
+      (void)adapter;
+      names.push_back(name);
+    }
+  }
+  return names;
+}
+
+std::string icpp_applied_lora() {
+  return g_active_model ? g_active_model->applied_lora : "";
+}
+
+std::vector<IcppResidentModelInfo> icpp_resident_models() {
+  std::vector<IcppResidentModelInfo> infos;
+  for (const auto &entry : g_resident_models) {
+    const IcppMemoryBreakdown mb = icpp_sum_memory_breakdown(entry->ctx);
+    infos.push_back({entry->path, mb.model_bytes, mb.context_bytes,
+                     mb.compute_bytes, entry->last_used_ns,
+                     entry.get() == g_active_model});
+  }
+  return infos;
+}
+
 void reset_static_memory() {
   /* Tip: to find what must be reset, use a native debug build and stop here
             in lldb:
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <sstream>
+#include <string>
+#include <vector>
 
 // Forward declaration for llama_model
 struct llama_model;
@@ -8,13 +11,85 @@ struct llama_model;
 // Global model pointer (defined in main_.cpp)
 extern llama_model **g_model;
 
+// Instructions main_() spent in each phase of a call (put on the wire by
+// run.cpp). Measured with instruction_counter(); all 0 in native builds.
+// What is not listed here (model/context setup, detokenizing the output, ...)
+// is not attributed to a phase.
+struct IcppPhaseInstructions {
+  uint64_t arg_parse = 0;    // common_params_parse
+  uint64_t session_load = 0; // reading the prompt cache
+  uint64_t tokenization = 0; // tokenizing the prompt
+  uint64_t prefill = 0;      // decoding prompt tokens
+  uint64_t generation = 0;   // decoding generated tokens
+  uint64_t sampling = 0;     // sampling the next token
+  uint64_t session_save = 0; // writing the prompt cache
+};
+
 int main_(int argc, char **argv, std::string principal_id, bool load_model_only,
           std::string &icpp_error_msg, std::ostringstream &conversation_ss,
           std::ostringstream &output_ss, const uint64_t &max_tokens,
           std::string &prompt_remaining, bool &generated_eog,
           uint64_t &n_prompt_tokens, uint64_t &n_prompt_tokens_cached,
           uint64_t &n_prompt_tokens_decoded, uint64_t &n_tokens_generated,
-          uint64_t &n_prompt_tokens_remaining);
+          uint64_t &n_prompt_tokens_remaining,
+          IcppPhaseInstructions &phase_instructions);
 
+// Frees all resident models.
 void icpp_free_model();
+
+// Resident models (see model_registry.h), identified by their --model path.
+// Makes the resident model the active one (the one main_ runs with) and
+// returns true. Returns false when it is not resident: main_ loads it then.
+bool icpp_select_model(const std::string &path);
+// Frees the resident model, if any.
+void icpp_unload_model(const std::string &path);
+struct IcppResidentModelInfo {
+  std::string path;
+  uint64_t model_bytes = 0;
+  uint64_t context_bytes = 0;
+  uint64_t compute_bytes = 0;
+  uint64_t last_used_ns = 0;
+  bool active = false;
+};
+std::vector<IcppResidentModelInfo> icpp_resident_models();
+
+// LoRA adapters of the active model (see lora.h), identified by name.
+int icpp_load_lora(const std::string &name, const std::string &path,
+                   std::string &icpp_error_msg);
+// Attaches the adapter to the active context; an empty name detaches it.
+int icpp_apply_lora(const std::string &name, float scale,
+                    std::string &icpp_error_msg);
+std::vector<std::string> icpp_lora_names();
+// The adapter attached to the active context, e.g. "name@1.00"; empty = none.
+std::string icpp_applied_lora();
+
+// Memory breakdown of the active model & context, summed over buffer types.
+struct IcppMemoryBreakdown {
+  uint64_t model_bytes = 0;   // weights
+  uint64_t context_bytes = 0; // KV cache / recurrent state
+  uint64_t compute_bytes = 0; // graph allocator (compute buffers)
+  uint64_t compute_bytes_at_load = 0; // compute buffers reserved at load
+  uint64_t compute_reallocs = 0; // times the hot path grew the compute buffers
+};
+bool icpp_get_memory_breakdown(IcppMemoryBreakdown &mb);
+
+// Phased (multi-call) model load, driven by the load_model_begin /
+// load_model_step / load_model_finish endpoints (model.cpp).
+enum class IcppLoadPhase { NONE, BEGUN, MODEL_LOADED, CONTEXT_CREATED };
+int icpp_load_model_begin(int argc, char **argv, std::string &icpp_error_msg);
+int icpp_load_model_step(std::string &icpp_error_msg,
+                         std::string &progress_msg);
+int icpp_load_model_finish(std::string &icpp_error_msg);
+// Discards a phased load in progress, if any.
+void icpp_load_model_abort();
+// Discards the phased load in progress only if it is one of `model_path`.
+void icpp_load_model_abort(const std::string &model_path);
+// The args of the phased load in progress, without the program name; empty
+// when none is in progress.
+std::vector<std::string> icpp_load_model_args();
+// Human readable progress of a phased load; empty when none is in progress.
+std::string icpp_load_model_progress();
+
+// KV cache types (K/V) of the active context, e.g. "q8_0/q8_0".
+std::string icpp_kv_cache_types();
 void reset_static_memory();
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <string>
 
 #include "auth.h"
+#include "model_recipe.h"
 
 #include "ic_api.h"
 
@@ -22,6 +23,9 @@ void set_max_tokens() {
   r_in.append("max_tokens_query", CandidTypeNat64{&max_tokens_query});
   ic_api.from_wire(r_in);
 
+  // Keep the saved model recipe in sync, for reload_model
+  model_recipe_save_settings();
+
   CandidTypeRecord status_code_record;
   status_code_record.append("status_code", CandidTypeNat16{200});
   ic_api.to_wire(CandidTypeVariant{"Ok", status_code_record});
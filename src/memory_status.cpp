@@ -6,8 +6,10 @@
 #include "auth.h"
 #include "ic0.h"
 #include "ic_api.h"
+#include "main_.h"
 
 #include <cstdint>
+#include <optional>
 #include <string>
 
 #ifdef __wasi__
@@ -52,8 +54,30 @@ void get_memory_status() {
   const uint64_t stable_bytes = 0;
 #endif
 
+  // Breakdown of the loaded model & context (null when no model is loaded).
+  std::optional<uint64_t> model_bytes;
+  std::optional<uint64_t> kv_cache_bytes;
+  std::optional<uint64_t> compute_buffer_bytes;
+  std::optional<uint64_t> compute_buffer_bytes_at_load;
+  std::optional<uint64_t> compute_buffer_reallocs;
+  IcppMemoryBreakdown mb;
+  if (icpp_get_memory_breakdown(mb)) {
+    model_bytes = mb.model_bytes;
+    kv_cache_bytes = mb.context_bytes;
+    compute_buffer_bytes = mb.compute_bytes;
+    compute_buffer_bytes_at_load = mb.compute_bytes_at_load;
+    compute_buffer_reallocs = mb.compute_reallocs;
+  }
+
   CandidTypeRecord r;
   r.append("wasm_heap_bytes", CandidTypeNat64{wasm_heap_bytes});
   r.append("stable_bytes", CandidTypeNat64{stable_bytes});
+  r.append("model_bytes", CandidTypeOptNat64{model_bytes});
+  r.append("kv_cache_bytes", CandidTypeOptNat64{kv_cache_bytes});
+  r.append("compute_buffer_bytes", CandidTypeOptNat64{compute_buffer_bytes});
+  r.append("compute_buffer_bytes_at_load",
+           CandidTypeOptNat64{compute_buffer_bytes_at_load});
+  r.append("compute_buffer_reallocs",
+           CandidTypeOptNat64{compute_buffer_reallocs});
   ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r}});
 }
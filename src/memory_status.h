@@ -12,6 +12,12 @@
 //     ic0.stable_size traps once stable memory passes 4 GiB, which happens as
 //     soon as a canister holds more than one large gguf.
 //
+// When a model is loaded, the heap is further broken down (opt, null when no
+// model is loaded): model_bytes (weights), kv_cache_bytes, and the compute
+// buffers. The compute buffers are reserved once at load for the worst-case
+// prefill and decode graphs; compute_buffer_reallocs counts the decodes in which
+// the inference path had to grow them anyway (should stay 0).
+//
 // Access: non-anonymous callers only (anonymous -> access denied).
 #pragma once
 
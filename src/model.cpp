@@ -3,8 +3,10 @@
 #include "model.h"
 #include "auth.h"
 #include "http.h"
+#include "instructions.h"
 #include "main_.h"
 #include "max_tokens.h"
+#include "model_recipe.h"
 #include "ready.h"
 #include "upload.h"
 #include "utils.h"
@@ -13,8 +15,10 @@
 #include "common.h"
 #include "log.h"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "ic_api.h"
 
@@ -22,6 +26,10 @@ static void print_usage(int argc, char **argv) {
   // do nothing function
 }
 
+static void load_model_(IC_API &ic_api, int argc, char **argv,
+                        const std::string &principal_id, bool save_recipe,
+                        const std::string &output);
+
 void load_model() {
   IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
   if (!has_admin_update_role(ic_api)) {
@@ -32,13 +40,80 @@ void load_model() {
   CandidTypePrincipal caller = ic_api.get_caller();
   std::string principal_id = caller.get_text();
 
-  std::string error_msg;
-
   // Get the data from the wire and prepare arguments for main_
   auto [argc, argv, args] = get_args_for_main(ic_api);
 
+  load_model_(ic_api, argc, argv.data(), principal_id, true,
+              "Model succesfully loaded into memory.");
+}
+
+// Replays the saved load of one model that is not resident, per call. Call it
+// until it reports that all saved models are loaded.
+void reload_model() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_output_record(ic_api);
+    return;
+  }
+
+  CandidTypePrincipal caller = ic_api.get_caller();
+  std::string principal_id = caller.get_text();
+
+  std::vector<ModelRecipe> recipes;
+  std::string error_msg;
+  if (!model_recipe_restore(recipes, error_msg)) {
+    send_output_record_result_error_to_wire(
+        ic_api, Http::StatusCode::InternalServerError, error_msg);
+    return;
+  }
+
+  std::vector<std::string> resident;
+  for (const IcppResidentModelInfo &info : icpp_resident_models()) {
+    resident.push_back(info.path);
+  }
+  for (size_t i = 0; i < recipes.size(); i++) {
+    if (std::find(resident.begin(), resident.end(), recipes[i].path) !=
+        resident.end()) {
+      continue;
+    }
+
+    // The first argv is always the program name
+    std::vector<std::string> args = recipes[i].args;
+    args.insert(args.begin(), "llama_cpp_canister");
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+      argv.push_back(arg.data());
+    }
+
+    // Do not save the recipe again: that would move it to the end
+    std::string output = "Model succesfully loaded into memory: " +
+                         recipes[i].path + " (" + std::to_string(i + 1) + "/" +
+                         std::to_string(recipes.size()) + " saved models).";
+    load_model_(ic_api, (int)argv.size(), argv.data(), principal_id, false,
+                output);
+    return;
+  }
+
+  CandidTypeRecord r_out;
+  r_out.append("status_code", CandidTypeNat16{Http::StatusCode::OK}); // 200
+  r_out.append("conversation", CandidTypeText{""});
+  r_out.append("output",
+               CandidTypeText{"All " + std::to_string(recipes.size()) +
+                              " saved models are loaded."});
+  r_out.append("error", CandidTypeText{""});
+  r_out.append("prompt_remaining", CandidTypeText{""});
+  r_out.append("generated_eog", CandidTypeBool{false});
+  ic_api.to_wire(CandidTypeVariant{"Ok", r_out});
+}
+
+// Loads the model with the given args, saves the recipe on success when asked,
+// and replies over the wire with the given output.
+static void load_model_(IC_API &ic_api, int argc, char **argv,
+                        const std::string &principal_id, bool save_recipe,
+                        const std::string &output) {
+  std::string error_msg;
   common_params params;
-  if (!common_params_parse(argc, argv.data(), params, LLAMA_EXAMPLE_COMPLETION,
+  if (!common_params_parse(argc, argv, params, LLAMA_EXAMPLE_COMPLETION,
                            print_usage)) {
     error_msg = "Cannot parse args.";
     send_output_record_result_error_to_wire(
@@ -47,8 +122,11 @@ void load_model() {
   }
 
   if (!params.model.empty()) {
-    // We're going to load a new model, first free the Orthogonally Persisted memory of a previously loaded model
-    icpp_free_model();
+    // We're going to (re)load this model with these args, so a phased load
+    // of it is discarded. Other resident models, and a phased load of another
+    // model, stay, unless they must make room for it.
+    icpp_load_model_abort(params.model.path);
+    icpp_unload_model(params.model.path);
   } else {
     error_msg = "--model not provided in args. Do not know what model to load.";
     send_output_record_result_error_to_wire(
@@ -69,11 +147,14 @@ void load_model() {
   uint64_t n_prompt_tokens_decoded = 0;
   uint64_t n_tokens_generated = 0;
   uint64_t n_prompt_tokens_remaining = 0;
+  IcppPhaseInstructions phase_instructions;
+  const uint64_t instructions_start = instruction_counter();
   int result = main_(
-      argc, argv.data(), principal_id, load_model_only, icpp_error_msg,
+      argc, argv, principal_id, load_model_only, icpp_error_msg,
       conversation_ss, output_ss, max_tokens_update, prompt_remaining,
       generated_eog, n_prompt_tokens, n_prompt_tokens_cached,
-      n_prompt_tokens_decoded, n_tokens_generated, n_prompt_tokens_remaining);
+      n_prompt_tokens_decoded, n_tokens_generated, n_prompt_tokens_remaining,
+      phase_instructions);
 
   // Exit if there was an error
   if (result != 0) {
@@ -82,16 +163,114 @@ void load_model() {
     return;
   }
 
+  // Report the load cost, to see how close it is to the instruction limit
+  const uint64_t instructions = instruction_counter() - instructions_start;
+  std::cout << "llama_cpp: " << std::string(__func__) << " - "
+            << instructions << " instructions ("
+            << (100 * instructions / IC_INSTRUCTION_LIMIT_UPDATE)
+            << "% of the update call limit)" << std::endl;
+
   // If we get this far, everything is Ok and ready to be used
   ready_for_inference = true;
 
+  // Save the recipe, so reload_model can replay it after an upgrade
+  if (save_recipe) {
+    model_recipe_save_args(std::vector<std::string>(argv + 1, argv + argc));
+  }
+
   CandidTypeRecord r_out;
   r_out.append("status_code", CandidTypeNat16{Http::StatusCode::OK}); // 200
   r_out.append("conversation", CandidTypeText{""});
-  r_out.append("output",
-               CandidTypeText{"Model succesfully loaded into memory."});
+  r_out.append("output", CandidTypeText{output});
   r_out.append("error", CandidTypeText{""});
   r_out.append("prompt_remaining", CandidTypeText{""});
   r_out.append("generated_eog", CandidTypeBool{generated_eog});
   ic_api.to_wire(CandidTypeVariant{"Ok", r_out});
+}
+
+// Phased (multi-call) model load: the weights and the context are created in
+// separate update calls, for a model whose weights fit in one call but not
+// together with its context (KV cache + compute buffers):
+//   load_model_begin  : validate the args & unload this model, if resident
+//   load_model_step   : call until it reports step 2/2 (weights, then context)
+//   load_model_finish : hand the model over for inference
+// ready() reports the progress while a phased load is in progress. Other
+// resident models keep serving in the meantime.
+
+static void send_load_model_ok_to_wire(IC_API &ic_api,
+                                       const std::string &output) {
+  CandidTypeRecord r_out;
+  r_out.append("status_code", CandidTypeNat16{Http::StatusCode::OK}); // 200
+  r_out.append("conversation", CandidTypeText{""});
+  r_out.append("output", CandidTypeText{output});
+  r_out.append("error", CandidTypeText{""});
+  r_out.append("prompt_remaining", CandidTypeText{""});
+  r_out.append("generated_eog", CandidTypeBool{false});
+  ic_api.to_wire(CandidTypeVariant{"Ok", r_out});
+}
+
+void load_model_begin() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_output_record(ic_api);
+    return;
+  }
+
+  auto [argc, argv, args] = get_args_for_main(ic_api);
+
+  std::string icpp_error_msg;
+  if (icpp_load_model_begin(argc, argv.data(), icpp_error_msg) != 0) {
+    send_output_record_result_error_to_wire(
+        ic_api, Http::StatusCode::InternalServerError, icpp_error_msg);
+    return;
+  }
+
+  // No inference with this model while the phased load is in progress; the
+  // other resident models, if any, keep serving.
+  ready_for_inference = !icpp_resident_models().empty();
+
+  send_load_model_ok_to_wire(ic_api, icpp_load_model_progress());
+}
+
+void load_model_step() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_output_record(ic_api);
+    return;
+  }
+
+  std::string icpp_error_msg;
+  std::string progress_msg;
+  if (icpp_load_model_step(icpp_error_msg, progress_msg) != 0) {
+    send_output_record_result_error_to_wire(
+        ic_api, Http::StatusCode::InternalServerError, icpp_error_msg);
+    return;
+  }
+
+  send_load_model_ok_to_wire(ic_api, progress_msg);
+}
+
+void load_model_finish() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_output_record(ic_api);
+    return;
+  }
+
+  // The args of the load, saved as its recipe: finish discards them
+  const std::vector<std::string> recipe_args = icpp_load_model_args();
+  std::string icpp_error_msg;
+  if (icpp_load_model_finish(icpp_error_msg) != 0) {
+    send_output_record_result_error_to_wire(
+        ic_api, Http::StatusCode::InternalServerError, icpp_error_msg);
+    return;
+  }
+
+  // If we get this far, everything is Ok and ready to be used
+  ready_for_inference = true;
+
+  // Save the recipe, so reload_model can restore it after an upgrade
+  model_recipe_save_args(recipe_args);
+
+  send_load_model_ok_to_wire(ic_api, "Model succesfully loaded into memory.");
 }
\ No newline at end of file
@@ -3,4 +3,12 @@
 #include "wasm_symbol.h"
 #include <string>
 
-void load_model() WASM_SYMBOL_EXPORTED("canister_update load_model");
\ No newline at end of file
+void load_model() WASM_SYMBOL_EXPORTED("canister_update load_model");
+// Replay the saved load of one resident model that is gone, e.g. after an
+// upgrade (see model_recipe.h). Call until all saved models are loaded.
+void reload_model() WASM_SYMBOL_EXPORTED("canister_update reload_model");
+void load_model_begin()
+    WASM_SYMBOL_EXPORTED("canister_update load_model_begin");
+void load_model_step() WASM_SYMBOL_EXPORTED("canister_update load_model_step");
+void load_model_finish()
+    WASM_SYMBOL_EXPORTED("canister_update load_model_finish");
\ No newline at end of file
@@ -0,0 +1,192 @@
+// Saved recipes of the resident models — implementation.
+// See model_recipe.h for the high-level contract.
+
+#include "model_recipe.h"
+#include "allowed_tokens.h"
+#include "main_.h"
+#include "max_tokens.h"
+#include "model_registry.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// File path to store the recipes persistently
+const std::string MODEL_RECIPE_FILE = "model_recipe.dat";
+
+// Hard cap on the number of recipes / args / allowed token ids read back,
+// against a corrupted file
+const uint64_t MAX_RECIPE_ENTRIES = 1'000'000;
+
+// The inference settings saved with the recipes
+struct ModelRecipeSettings {
+  uint64_t max_tokens_update = 0;
+  uint64_t max_tokens_query = 0;
+  std::vector<uint64_t> allowed_token_ids;
+  uint64_t max_resident_models = 1;
+  uint64_t resident_models_budget_bytes = 0;
+};
+
+static void write_u64(std::ofstream &file, uint64_t value) {
+  file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void write_string(std::ofstream &file, const std::string &s) {
+  write_u64(file, s.size());
+  file.write(s.data(), s.size());
+}
+
+static bool read_u64(std::ifstream &file, uint64_t &value) {
+  file.read(reinterpret_cast<char *>(&value), sizeof(value));
+  return file.good();
+}
+
+static bool read_string(std::ifstream &file, std::string &s) {
+  uint64_t size = 0;
+  if (!read_u64(file, size) || size > MAX_FILENAME_SIZE) {
+    return false;
+  }
+  s.assign(size, '\0');
+  file.read(s.data(), size);
+  return file.good();
+}
+
+static void model_recipe_write(const std::vector<ModelRecipe> &recipes) {
+  std::ofstream file(MODEL_RECIPE_FILE, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open model recipe file for writing" << std::endl;
+    return;
+  }
+
+  write_u64(file, recipes.size());
+  for (const ModelRecipe &recipe : recipes) {
+    write_string(file, recipe.path);
+    write_u64(file, recipe.args.size());
+    for (const auto &arg : recipe.args) {
+      write_string(file, arg);
+    }
+  }
+  write_u64(file, max_tokens_update);
+  write_u64(file, max_tokens_query);
+  write_u64(file, allowed_token_ids.size());
+  for (const uint64_t id : allowed_token_ids) {
+    write_u64(file, id);
+  }
+  write_u64(file, max_resident_models);
+  write_u64(file, resident_models_budget_bytes);
+}
+
+static bool model_recipe_read(std::vector<ModelRecipe> &recipes,
+                              ModelRecipeSettings &settings,
+                              std::string &msg) {
+  std::ifstream file(MODEL_RECIPE_FILE, std::ios::binary);
+  if (!file.is_open()) {
+    msg = "No model recipe saved. Load the model with load_model first.";
+    return false;
+  }
+
+  uint64_t n_recipes = 0;
+  if (!read_u64(file, n_recipes) || n_recipes > MAX_RECIPE_ENTRIES) {
+    msg = "Corrupted model recipe (recipes)";
+    return false;
+  }
+  recipes.clear();
+  for (uint64_t r = 0; r < n_recipes; r++) {
+    ModelRecipe recipe;
+    uint64_t n_args = 0;
+    if (!read_string(file, recipe.path) || !read_u64(file, n_args) ||
+        n_args > MAX_RECIPE_ENTRIES) {
+      msg = "Corrupted model recipe (model)";
+      return false;
+    }
+    for (uint64_t i = 0; i < n_args; i++) {
+      std::string arg;
+      if (!read_string(file, arg)) {
+        msg = "Corrupted model recipe (args)";
+        return false;
+      }
+      recipe.args.push_back(arg);
+    }
+    recipes.push_back(recipe);
+  }
+
+  uint64_t count = 0;
+  if (!read_u64(file, settings.max_tokens_update) ||
+      !read_u64(file, settings.max_tokens_query) || !read_u64(file, count) ||
+      count > MAX_RECIPE_ENTRIES) {
+    msg = "Corrupted model recipe (settings)";
+    return false;
+  }
+  settings.allowed_token_ids.resize(count);
+  for (uint64_t i = 0; i < count; i++) {
+    if (!read_u64(file, settings.allowed_token_ids[i])) {
+      msg = "Corrupted model recipe (allowed tokens)";
+      return false;
+    }
+  }
+  if (!read_u64(file, settings.max_resident_models) ||
+      !read_u64(file, settings.resident_models_budget_bytes)) {
+    msg = "Corrupted model recipe (resident models)";
+    return false;
+  }
+  return true;
+}
+
+void model_recipe_save_args(const std::vector<std::string> &args) {
+  std::string path;
+  std::vector<std::string> resident;
+  for (const IcppResidentModelInfo &info : icpp_resident_models()) {
+    resident.push_back(info.path);
+    if (info.active) {
+      path = info.path;
+    }
+  }
+
+  // Keep the recipes of the other resident models, in load order, and put
+  // this one last: it is the most recently loaded.
+  std::vector<ModelRecipe> recipes;
+  ModelRecipeSettings settings;
+  std::string msg;
+  std::vector<ModelRecipe> saved;
+  if (model_recipe_read(saved, settings, msg)) {
+    for (const ModelRecipe &recipe : saved) {
+      if (recipe.path != path &&
+          std::find(resident.begin(), resident.end(), recipe.path) !=
+              resident.end()) {
+        recipes.push_back(recipe);
+      }
+    }
+  }
+  recipes.push_back(ModelRecipe{path, args});
+  model_recipe_write(recipes);
+}
+
+void model_recipe_save_settings() {
+  // Without saved recipes yet, the settings are saved alone: set before the
+  // first load_model, they must survive an upgrade too
+  std::vector<ModelRecipe> recipes;
+  ModelRecipeSettings settings;
+  std::string msg;
+  if (!model_recipe_read(recipes, settings, msg)) {
+    recipes.clear();
+  }
+  model_recipe_write(recipes);
+}
+
+// Restores the inference settings and returns the recipes.
+bool model_recipe_restore(std::vector<ModelRecipe> &recipes, std::string &msg) {
+  ModelRecipeSettings settings;
+  if (!model_recipe_read(recipes, settings, msg)) {
+    return false;
+  }
+  max_tokens_update = settings.max_tokens_update;
+  max_tokens_query = settings.max_tokens_query;
+  allowed_token_ids = settings.allowed_token_ids;
+  max_resident_models = settings.max_resident_models;
+  resident_models_budget_bytes = settings.resident_models_budget_bytes;
+  return true;
+}
@@ -0,0 +1,35 @@
+// Saved recipes of the resident models, to replay their loads after an upgrade.
+//
+// An upgrade wipes the heap -- and with it the resident models -- but not the
+// virtual filesystem. On every successful load, the load args of the model are
+// saved in the recipe file, next to those of the other resident models, together
+// with the inference settings (max_tokens, allowed tokens, the resident-model
+// limits). After an upgrade, reload_model replays the loads, one model per call,
+// and restores the settings.
+//
+// This is a replay of load_model, not a snapshot of the loaded model: each
+// reload costs as much as the original load_model call did.
+//
+// Lifecycle is operator-driven, like the timers: reload_model is NOT called
+// from canister_post_upgrade. The upgrade workflow calls it once the canister
+// is reachable.
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct ModelRecipe {
+  std::string path;              // --model
+  std::vector<std::string> args; // load args, without the program name
+};
+
+// Save the args (without the program name) of a successful load of the active
+// model, replacing its earlier recipe, plus the current inference settings.
+// Recipes of models that are no longer resident are dropped.
+void model_recipe_save_args(const std::vector<std::string> &args);
+// Re-save the current inference settings, keeping the saved recipes. Saves
+// them with no recipes when no model was loaded yet.
+void model_recipe_save_settings();
+// Restore the saved inference settings, and return the saved recipes, in the
+// order the models were loaded. Used by reload_model.
+bool model_recipe_restore(std::vector<ModelRecipe> &recipes, std::string &msg);
@@ -0,0 +1,95 @@
+// Multiple resident models — endpoints.
+// See model_registry.h for the high-level contract; the models themselves
+// live in main_.cpp.
+
+#include "model_registry.h"
+#include "model_recipe.h"
+
+#include <iostream>
+#include <string>
+
+#include "auth.h"
+#include "http.h"
+#include "main_.h"
+
+#include "ic_api.h"
+
+uint64_t max_resident_models{1};          // 1 = one model at a time
+uint64_t resident_models_budget_bytes{0}; // 0 = no budget
+
+void set_model_registry_config() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  uint64_t max_models = 0;
+  uint64_t heap_budget_bytes = 0;
+  CandidTypeRecord r_in;
+  r_in.append("max_models", CandidTypeNat64{&max_models});
+  r_in.append("heap_budget_bytes", CandidTypeNat64{&heap_budget_bytes});
+  ic_api.from_wire(r_in);
+
+  if (max_models == 0) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{
+                   "Other", CandidTypeText{std::string(__func__) +
+                                           ": max_models must be at least 1"}}});
+    return;
+  }
+
+  // Applied at the next load: resident models are not evicted here
+  max_resident_models = max_models;
+  resident_models_budget_bytes = heap_budget_bytes;
+  model_recipe_save_settings();
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - max_models "
+            << max_resident_models << ", heap_budget_bytes "
+            << resident_models_budget_bytes << std::endl;
+
+  CandidTypeRecord status_code_record;
+  status_code_record.append("status_code", CandidTypeNat16{200});
+  ic_api.to_wire(CandidTypeVariant{"Ok", status_code_record});
+}
+
+void get_resident_models() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::vector<std::string> paths;
+  std::vector<uint64_t> model_bytes;
+  std::vector<uint64_t> kv_cache_bytes;
+  std::vector<uint64_t> compute_buffer_bytes;
+  std::vector<uint64_t> last_used_ns;
+  std::string active_model; // empty = none
+  for (const IcppResidentModelInfo &info : icpp_resident_models()) {
+    paths.push_back(info.path);
+    model_bytes.push_back(info.model_bytes);
+    kv_cache_bytes.push_back(info.context_bytes);
+    compute_buffer_bytes.push_back(info.compute_bytes);
+    last_used_ns.push_back(info.last_used_ns);
+    if (info.active) {
+      active_model = info.path;
+    }
+  }
+
+  CandidTypeRecord models;
+  models.append("path", CandidTypeVecText{paths});
+  models.append("model_bytes", CandidTypeVecNat64{model_bytes});
+  models.append("kv_cache_bytes", CandidTypeVecNat64{kv_cache_bytes});
+  models.append("compute_buffer_bytes",
+                CandidTypeVecNat64{compute_buffer_bytes});
+  models.append("last_used_ns", CandidTypeVecNat64{last_used_ns});
+
+  CandidTypeRecord r_out;
+  r_out.append("max_models", CandidTypeNat64{max_resident_models});
+  r_out.append("heap_budget_bytes",
+               CandidTypeNat64{resident_models_budget_bytes});
+  r_out.append("active_model", CandidTypeText{active_model});
+  r_out.append("models", CandidTypeVecRecord{models});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
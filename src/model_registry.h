@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ic_api.h"
+#include "wasm_symbol.h"
+#include <string>
+
+// Multiple resident models, hot-swapped without reloading.
+// Every model loaded (load_model, the phased load, or run with --model) stays
+// resident, keyed by its --model path, and run with the --model of a resident
+// model reuses it. Before a new model is loaded, the least recently used
+// models are evicted until it fits:
+//  - max_models       : at most this many resident models (default 1)
+//  - heap_budget_bytes: resident bytes (weights + KV cache + compute buffers)
+//                       plus the new model's estimated footprint (file size,
+//                       KV cache and compute buffers from its gguf header and
+//                       context args) within this budget (0 = no budget, the
+//                       default)
+// A run with the --model of a resident model cannot change its context args
+// (-c, --batch-size, --ubatch-size, --cache-type-k/v, --flash-attn): it is an
+// error. Call load_model with the new args to rebuild the context.
+void set_model_registry_config()
+    WASM_SYMBOL_EXPORTED("canister_update set_model_registry_config");
+void get_resident_models()
+    WASM_SYMBOL_EXPORTED("canister_query get_resident_models");
+
+extern uint64_t max_resident_models;
+extern uint64_t resident_models_budget_bytes;
@@ -1,10 +1,12 @@
 #include "promptcache.h"
 
 #include "auth.h"
+#include "cache_index.h"
 #include "common.h"
 #include "db_chats.h"
 #include "download.h"
 #include "http.h"
+#include "lz4.h"
 #include "main_.h"
 #include "max_tokens.h"
 #include "run.h"
@@ -15,6 +17,9 @@
 #include "llama.h" // llama_model_desc, for the model-identity stamp
 #include "log.h"
 
+// This library is included with icpp-pro
+#include "hash-library/sha256.h"
+
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -41,15 +46,21 @@ static void print_usage(int argc, char **argv) {
 // Bump this whenever a llama.cpp upgrade changes the session serialization.
 //   1 = llama.cpp b4531 (6152129d) and earlier -- never actually stamped
 //   2 = llama.cpp b10076 (305ba519), llama_memory_* refactor
-static const char *PROMPT_CACHE_FORMAT = "llama_cpp_canister-prompt-cache-v2";
+//   3 = the model identity on the second line includes the KV cache types
+//       (" kv=<k>/<v>") and the attached LoRA adapter. Every v2 cache is
+//       discarded once: its identity line can no longer match.
+static const char *PROMPT_CACHE_FORMAT = "llama_cpp_canister-prompt-cache-v3";
+
+static const char *PROMPT_CACHE_STAMP_SUFFIX = ".icppfmt";
 
 static std::string
 prompt_cache_stamp_path(const std::string &canister_path_session) {
-  return canister_path_session + ".icppfmt";
+  return canister_path_session + PROMPT_CACHE_STAMP_SUFFIX;
 }
 
 std::string prompt_cache_model_id() {
-  // Identity of the currently loaded model, e.g. "qwen3 1.7B Q4_K_M".
+  // Identity of the currently loaded model, e.g. "qwen3 1.7B Q4_K_M kv=q8_0/q8_0",
+  // with " lora=<name>@<scale>" when a LoRA adapter is attached.
   // Empty when no model is loaded yet (g_model is set by main_ at load_model).
   if (g_model == nullptr || *g_model == nullptr) return "";
 
@@ -58,7 +69,14 @@ std::string prompt_cache_model_id() {
   // snprintf semantics: the return value is the length the description WOULD
   // have, so read the (always NUL-terminated) buffer instead of trusting it.
   llama_model_desc(*g_model, buf, sizeof(buf));
-  return std::string(buf);
+  // The KV cache types are part of the identity: a session file stores the KV
+  // cache in the types the context was created with, and llama.cpp refuses to
+  // restore it into a context with different ones.
+  std::string id = std::string(buf) + " kv=" + icpp_kv_cache_types();
+  // So is an attached LoRA adapter: it changes the K & V projections.
+  const std::string lora = icpp_applied_lora();
+  if (!lora.empty()) id += " lora=" + lora;
+  return id;
 }
 
 bool prompt_cache_format_is_current(const std::string &canister_path_session) {
@@ -93,6 +111,11 @@ void prompt_cache_remove_stamp(const std::string &canister_path_session) {
   if (canister_path_session.empty()) return;
   std::error_code ec;
   std::filesystem::remove(prompt_cache_stamp_path(canister_path_session), ec);
+  cache_index_note_remove(prompt_cache_stamp_path(canister_path_session));
+}
+
+bool prompt_cache_is_stamp(const std::string &path) {
+  return path.ends_with(PROMPT_CACHE_STAMP_SUFFIX);
 }
 
 void prompt_cache_copy_stamp(const std::string &from_session,
@@ -110,6 +133,7 @@ void prompt_cache_copy_stamp(const std::string &from_session,
   if (std::filesystem::exists(from_stamp)) {
     std::filesystem::copy(from_stamp, to_stamp, ec);
   }
+  cache_index_note_write(to_stamp);
 }
 
 void prompt_cache_write_format_stamp(const std::string &canister_path_session) {
@@ -119,6 +143,8 @@ void prompt_cache_write_format_stamp(const std::string &canister_path_session) {
     f << PROMPT_CACHE_FORMAT << std::endl;
     f << prompt_cache_model_id() << std::endl;
   }
+  f.close();
+  cache_index_note_write(prompt_cache_stamp_path(canister_path_session));
 }
 
 bool prompt_cache_discard_if_stale(const std::string &canister_path_session,
@@ -141,8 +167,11 @@ bool prompt_cache_discard_if_stale(const std::string &canister_path_session,
   //
   // Either way: delete it and start cold. That is recoverable; a trap is not.
   std::error_code ec;
+  file_upload_close(canister_path_session);
   std::filesystem::remove(canister_path_session, ec);
   std::filesystem::remove(prompt_cache_stamp_path(canister_path_session), ec);
+  cache_index_note_remove(canister_path_session);
+  cache_index_note_remove(prompt_cache_stamp_path(canister_path_session));
 
   msg = "Discarded prompt-cache file that was not written by this build with "
         "the currently loaded model (" +
@@ -226,7 +255,9 @@ void remove_prompt_cache() {
   if (!path_session.empty()) {
     // Remove the file if it exists
     if (std::filesystem::exists(path_session)) {
+      file_upload_close(path_session);
       bool success = std::filesystem::remove(path_session);
+      cache_index_note_remove(path_session);
       // Never leave the stamp behind: it would vouch for whatever bytes appear
       // at this path next (e.g. an uploaded cache from another build/model).
       prompt_cache_remove_stamp(path_session);
@@ -302,7 +333,9 @@ void copy_prompt_cache() {
 
   // first remove the 'to' file if it already exists
   if (std::filesystem::exists(to_path)) {
+    file_upload_close(to_path);
     bool success = std::filesystem::remove(to_path);
+    cache_index_note_remove(to_path);
     if (!success) {
       error_msg = "Could not remove existing 'to' file " + to_path;
       ic_api.to_wire(CandidTypeVariant{
@@ -314,6 +347,7 @@ void copy_prompt_cache() {
   // now copy the 'from' file to 'to' file
   std::error_code ec;
   std::filesystem::copy(from_path, to_path, ec);
+  cache_index_note_write(to_path);
   if (ec) {
     error_msg = "Error copying file from " + from_path + " to " + to_path;
     ic_api.to_wire(CandidTypeVariant{
@@ -407,6 +441,151 @@ void upload_prompt_cache_chunk() {
   file_upload_chunk_(ic_api, filename, v, chunksize, offset);
 }
 
+void download_prompt_cache_chunk_lz4() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  CandidTypePrincipal caller = ic_api.get_caller();
+  std::string principal_id = caller.get_text();
+
+  std::string promptcache{""};
+  uint64_t chunksize{0};
+  uint64_t offset{0};
+
+  CandidTypeRecord r_in;
+  r_in.append("promptcache", CandidTypeText{&promptcache});
+  r_in.append("chunksize", CandidTypeNat64{&chunksize});
+  r_in.append("offset", CandidTypeNat64{&offset});
+  ic_api.from_wire(r_in);
+
+  // An incompressible chunk grows, so the reply would exceed the message limit
+  if (chunksize > MAX_LZ4_CHUNK_SIZE) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{
+                   "Other", CandidTypeText{std::string(__func__) +
+                                           ": chunksize " +
+                                           std::to_string(chunksize) +
+                                           " exceeds limit " +
+                                           std::to_string(MAX_LZ4_CHUNK_SIZE)}}});
+    return;
+  }
+
+  // Each principal has their own cache folder
+  std::string filename;
+  std::string error_msg;
+  if (!get_canister_path_session(promptcache, principal_id, filename,
+                                 error_msg)) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{error_msg}}});
+    return;
+  }
+
+  std::vector<uint8_t> v;
+  uint64_t filesize{0};
+  if (!read_file_chunk(filename, chunksize, offset, v, filesize, error_msg)) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                         ": " + error_msg}}});
+    return;
+  }
+
+  SHA256 sha256;
+  sha256.add(v.data(), v.size());
+  std::vector<uint8_t> compressed;
+  lz4_compress_block(v.data(), v.size(), compressed);
+
+  bool done =
+      (offset > UINT64_MAX - chunksize) || (offset + chunksize >= filesize);
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - " << filename
+            << ": offset=" << offset << "; chunksize=" << v.size()
+            << "; compressed=" << compressed.size() << "; done=" << done
+            << std::endl;
+
+  CandidTypeRecord r_out;
+  r_out.append("chunk", CandidTypeVecNat8{compressed});
+  r_out.append("chunksize", CandidTypeNat64{v.size()});
+  r_out.append("sha256", CandidTypeText{sha256.getHash()});
+  r_out.append("filesize", CandidTypeNat64{filesize});
+  r_out.append("offset", CandidTypeNat64{offset});
+  r_out.append("done", CandidTypeBool{done});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
+
+void upload_prompt_cache_chunk_lz4() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  CandidTypePrincipal caller = ic_api.get_caller();
+  std::string principal_id = caller.get_text();
+
+  std::string promptcache{""};
+  std::vector<uint8_t> compressed;
+  uint64_t chunksize{0};        // uncompressed size of this chunk
+  uint64_t upload_chunksize{0}; // of the upload; a shorter chunk is the last
+  uint64_t offset{0};
+  std::string expected_sha256{""};
+
+  CandidTypeRecord r_in;
+  r_in.append("promptcache", CandidTypeText{&promptcache});
+  r_in.append("chunk", CandidTypeVecNat8{&compressed});
+  r_in.append("chunksize", CandidTypeNat64{&chunksize});
+  r_in.append("upload_chunksize", CandidTypeNat64{&upload_chunksize});
+  r_in.append("offset", CandidTypeNat64{&offset});
+  r_in.append("sha256", CandidTypeText{&expected_sha256});
+  ic_api.from_wire(r_in);
+
+  std::string filename;
+  std::string error_msg;
+  if (!get_canister_path_session(promptcache, principal_id, filename,
+                                 error_msg)) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{error_msg}}});
+    return;
+  }
+
+  // Check the size before decompressing into it
+  if (chunksize > upload_chunksize) {
+    error_msg = "chunksize " + std::to_string(chunksize) +
+                " exceeds upload_chunksize " + std::to_string(upload_chunksize);
+  } else if (upload_chunksize > MAX_LZ4_CHUNK_SIZE) {
+    // Same limit as the download, so an incompressible chunk fits the request
+    error_msg = "upload_chunksize " + std::to_string(upload_chunksize) +
+                " exceeds limit " + std::to_string(MAX_LZ4_CHUNK_SIZE);
+  }
+  std::vector<uint8_t> v;
+  if (error_msg.empty() &&
+      !lz4_decompress_block(compressed.data(), compressed.size(), chunksize, v,
+                            error_msg)) {
+    error_msg = "invalid LZ4 block: " + error_msg;
+  }
+  if (error_msg.empty()) {
+    SHA256 sha256;
+    sha256.add(v.data(), v.size());
+    if (sha256.getHash() != expected_sha256) {
+      error_msg = "sha256 of the decompressed chunk does not match";
+    }
+  }
+  if (!error_msg.empty()) {
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
+                                                         ": " + error_msg}}});
+    return;
+  }
+
+  // See upload_prompt_cache_chunk
+  prompt_cache_remove_stamp(filename);
+
+  // The upload's chunksize, so a short last chunk closes the file
+  file_upload_chunk_(ic_api, filename, v, upload_chunksize, offset);
+}
+
 void uploaded_prompt_cache_details() {
   // Returns the metadata for an uploaded prompt cache
 
@@ -30,7 +30,8 @@ bool get_canister_path_session(const std::string &path_session,
 // mismatched. Bump PROMPT_CACHE_FORMAT whenever a llama.cpp upgrade changes
 // the session serialization.
 
-// Description of the currently loaded model, e.g. "qwen3 1.7B Q4_K_M".
+// Description of the currently loaded model and its KV cache types, e.g.
+// "qwen3 1.7B Q4_K_M kv=q8_0/q8_0".
 // Empty string when no model is loaded.
 std::string prompt_cache_model_id();
 
@@ -44,6 +45,9 @@ void prompt_cache_write_format_stamp(const std::string &canister_path_session);
 // then traps on it.
 void prompt_cache_remove_stamp(const std::string &canister_path_session);
 
+// True for the stamp sidecar of a cache, which lives next to it in sessions/
+bool prompt_cache_is_stamp(const std::string &path);
+
 // Carry the stamp along when the cache BYTES are copied (copy_prompt_cache).
 // The copied cache really was written by this build with this model, so it
 // stays valid — without this, save/restore silently degrades to a cold start.
@@ -64,5 +68,14 @@ void download_prompt_cache_chunk()
     WASM_SYMBOL_EXPORTED("canister_query download_prompt_cache_chunk");
 void upload_prompt_cache_chunk()
     WASM_SYMBOL_EXPORTED("canister_update upload_prompt_cache_chunk");
+// Compressed transfer: the same as download_prompt_cache_chunk and
+// upload_prompt_cache_chunk, but every chunk travels as one LZ4 block (see
+// lz4.h), with its uncompressed size and SHA-256. Each chunk is compressed on
+// its own, so a transfer resumes at any chunk boundary, and mixes freely with
+// the uncompressed endpoints.
+void download_prompt_cache_chunk_lz4()
+    WASM_SYMBOL_EXPORTED("canister_query download_prompt_cache_chunk_lz4");
+void upload_prompt_cache_chunk_lz4()
+    WASM_SYMBOL_EXPORTED("canister_update upload_prompt_cache_chunk_lz4");
 void uploaded_prompt_cache_details()
     WASM_SYMBOL_EXPORTED("canister_query uploaded_prompt_cache_details");
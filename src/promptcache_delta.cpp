@@ -0,0 +1,192 @@
+// Block-hash delta sync of a prompt cache — implementation.
+// See promptcache_delta.h for the high-level contract.
+
+#include "promptcache_delta.h"
+
+#include "auth.h"
+#include "instructions.h"
+#include "promptcache.h"
+#include "utils.h"
+
+// This library is included with icpp-pro
+#include "hash-library/sha256.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ic_api.h"
+
+namespace {
+// Stop well before the query instruction limit, leaving room for the reply
+const uint64_t DELTA_INSTRUCTION_BUDGET = IC_INSTRUCTION_LIMIT_QUERY / 2;
+// A hash is 64 hex characters: this keeps a reply of hashes, and the client's
+// hashes in a download_prompt_cache_blocks call, well below 2 MiB
+const uint64_t MAX_BLOCK_HASHES_PER_REPLY = 16384;
+
+void send_delta_error_to_wire(IC_API &ic_api, const std::string &func,
+                              const std::string &msg) {
+  ic_api.to_wire(CandidTypeVariant{
+      "Err", CandidTypeVariant{"Other", CandidTypeText{func + ": " + msg}}});
+}
+
+// The state shared by both endpoints: an open prompt cache of this caller
+struct DeltaFile {
+  std::ifstream if_stream;
+  uint64_t filesize = 0;
+  uint64_t block_size = 0;
+  uint64_t n_blocks = 0;
+};
+
+bool open_delta_file(IC_API &ic_api, const std::string &func,
+                     const std::string &promptcache, uint64_t block_size,
+                     DeltaFile &file) {
+  if (block_size == 0 || block_size > MAX_CHUNK_SIZE) {
+    send_delta_error_to_wire(ic_api, func,
+                             "block_size must be in [1, " +
+                                 std::to_string(MAX_CHUNK_SIZE) + "]");
+    return false;
+  }
+
+  // Each principal has their own cache folder
+  std::string principal_id = ic_api.get_caller().get_text();
+  std::string filename;
+  std::string msg;
+  if (!get_canister_path_session(promptcache, principal_id, filename, msg) ||
+      !open_ifstream(filename, std::ios::binary, file.if_stream, msg)) {
+    send_delta_error_to_wire(ic_api, func, msg);
+    return false;
+  }
+  file.if_stream.seekg(0, std::ios::end);
+  file.filesize = file.if_stream.tellg();
+  file.block_size = block_size;
+  file.n_blocks = (file.filesize + block_size - 1) / block_size;
+  return true;
+}
+
+// Reads block `index` into v and returns its SHA-256
+std::string read_block(DeltaFile &file, uint64_t index,
+                       std::vector<uint8_t> &v) {
+  v.resize(file.block_size);
+  file.if_stream.clear();
+  file.if_stream.seekg(index * file.block_size, std::ios::beg);
+  file.if_stream.read(reinterpret_cast<char *>(v.data()), file.block_size);
+  v.resize(file.if_stream.gcount());
+
+  SHA256 sha256;
+  sha256.add(v.data(), v.size());
+  return sha256.getHash();
+}
+} // namespace
+
+void prompt_cache_block_hashes() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string promptcache{""};
+  uint64_t block_size{0};
+  uint64_t first_block{0};
+  CandidTypeRecord r_in;
+  r_in.append("promptcache", CandidTypeText{&promptcache});
+  r_in.append("block_size", CandidTypeNat64{&block_size});
+  r_in.append("first_block", CandidTypeNat64{&first_block});
+  ic_api.from_wire(r_in);
+
+  DeltaFile file;
+  if (!open_delta_file(ic_api, __func__, promptcache, block_size, file)) {
+    return;
+  }
+
+  const uint64_t instructions_start = instruction_counter();
+  std::vector<std::string> hashes;
+  std::vector<uint8_t> v;
+  uint64_t index = first_block;
+  while (index < file.n_blocks && hashes.size() < MAX_BLOCK_HASHES_PER_REPLY &&
+         instruction_counter() - instructions_start <
+             DELTA_INSTRUCTION_BUDGET) {
+    hashes.push_back(read_block(file, index, v));
+    index++;
+  }
+
+  CandidTypeRecord r_out;
+  r_out.append("filesize", CandidTypeNat64{file.filesize});
+  r_out.append("block_size", CandidTypeNat64{file.block_size});
+  r_out.append("first_block", CandidTypeNat64{first_block});
+  r_out.append("hashes", CandidTypeVecText{hashes});
+  r_out.append("next_block", CandidTypeNat64{index});
+  r_out.append("done", CandidTypeBool{index >= file.n_blocks});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
+
+void download_prompt_cache_blocks() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  // hashes[i] is the client's hash of block first_block + i
+  std::string promptcache{""};
+  uint64_t block_size{0};
+  uint64_t first_block{0};
+  std::vector<std::string> hashes;
+  CandidTypeRecord r_in;
+  r_in.append("promptcache", CandidTypeText{&promptcache});
+  r_in.append("block_size", CandidTypeNat64{&block_size});
+  r_in.append("first_block", CandidTypeNat64{&first_block});
+  r_in.append("hashes", CandidTypeVecText{&hashes});
+  ic_api.from_wire(r_in);
+
+  DeltaFile file;
+  if (!open_delta_file(ic_api, __func__, promptcache, block_size, file)) {
+    return;
+  }
+
+  if (hashes.size() > MAX_BLOCK_HASHES_PER_REPLY) {
+    send_delta_error_to_wire(
+        ic_api, __func__,
+        "at most " + std::to_string(MAX_BLOCK_HASHES_PER_REPLY) +
+            " hashes per call");
+    return;
+  }
+
+  // Examine blocks until the reply is full or the budget is used. A page
+  // covers at most MAX_BLOCK_HASHES_PER_REPLY blocks, so a client that sends
+  // that many hashes has sent one for every block the page can reach.
+  const uint64_t instructions_start = instruction_counter();
+  std::vector<uint8_t> data;
+  std::vector<uint64_t> indices;
+  std::vector<uint8_t> v;
+  uint64_t index = first_block;
+  while (index < file.n_blocks &&
+         index - first_block < MAX_BLOCK_HASHES_PER_REPLY &&
+         data.size() + file.block_size <= MAX_CHUNK_SIZE &&
+         instruction_counter() - instructions_start <
+             DELTA_INSTRUCTION_BUDGET) {
+    const std::string hash = read_block(file, index, v);
+    const uint64_t i = index - first_block;
+    if (i >= hashes.size() || hashes[i] != hash) {
+      indices.push_back(index);
+      data.insert(data.end(), v.begin(), v.end());
+    }
+    index++;
+  }
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - " << promptcache
+            << ": blocks [" << first_block << ", " << index << ") of "
+            << file.n_blocks << "; changed=" << indices.size() << std::endl;
+
+  CandidTypeRecord r_out;
+  r_out.append("filesize", CandidTypeNat64{file.filesize});
+  r_out.append("block_size", CandidTypeNat64{file.block_size});
+  r_out.append("indices", CandidTypeVecNat64{indices});
+  r_out.append("data", CandidTypeVecNat8{data});
+  r_out.append("next_block", CandidTypeNat64{index});
+  r_out.append("done", CandidTypeBool{index >= file.n_blocks});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
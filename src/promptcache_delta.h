@@ -0,0 +1,25 @@
+// Block-hash delta sync of a prompt cache.
+//
+// A client that backs up a session after every turn only needs the blocks
+// that changed, usually the tail. The sync works like rsync with fixed
+// blocks:
+//  - prompt_cache_block_hashes returns the SHA-256 of every block_size block
+//  - download_prompt_cache_blocks takes the client's hashes and returns only
+//    the blocks whose hash differs (or that the client does not have)
+// The client writes each returned block at index * block_size and truncates
+// its copy to filesize.
+//
+// Both are queries that can run out of instructions on a large cache, so they
+// page: a reply covers the blocks [first_block, next_block), and the client
+// calls again from next_block until done. A page covers at most 16384 blocks,
+// and download_prompt_cache_blocks takes at most that many hashes: the client
+// sends only the hashes of the blocks [first_block, first_block + 16384).
+#pragma once
+
+#include "wasm_symbol.h"
+
+// Query endpoints — RBAC: has_admin_query_role required.
+void prompt_cache_block_hashes()
+    WASM_SYMBOL_EXPORTED("canister_query prompt_cache_block_hashes");
+void download_prompt_cache_blocks()
+    WASM_SYMBOL_EXPORTED("canister_query download_prompt_cache_blocks");
@@ -1,5 +1,6 @@
 #include "ready.h"
 #include "http.h"
+#include "main_.h"
 
 #include <iostream>
 #include <string>
@@ -14,6 +15,10 @@ void ready() {
 
   if (!ready_for_inference) {
     std::string error_msg = "Model not yet loaded";
+    const std::string progress = icpp_load_model_progress();
+    if (!progress.empty()) {
+      error_msg = "Model load in progress: " + progress;
+    }
     ic_api.to_wire(CandidTypeVariant{
         "Err", CandidTypeVariant{"Other", CandidTypeText{error_msg}}});
     return;
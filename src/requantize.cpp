@@ -0,0 +1,473 @@
+// On-canister requantization of an uploaded gguf — implementation.
+// See requantize.h for the high-level contract.
+
+#include "requantize.h"
+
+#include "auth.h"
+#include "ic_api.h"
+#include "instructions.h"
+#include "upload.h"
+
+#include "ggml.h"
+#include "gguf.h"
+#include "llama.h"
+
+#include "hash-library/sha256.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// --- Defaults & bounds ---------------------------------------------------
+namespace {
+constexpr uint64_t NS_PER_SEC = 1'000'000'000ULL;
+constexpr uint64_t TICK_NS = 1ULL * NS_PER_SEC; // next slice, 1 s later
+
+// Instructions per slice: well under the 40B limit of a timer message
+constexpr uint64_t DEFAULT_SLICE_INSTRUCTIONS = 10'000'000'000ULL;
+constexpr uint64_t SLICE_INSTRUCTIONS_CEILING = 30'000'000'000ULL;
+
+// Source bytes converted per step, i.e. between instruction-budget checks
+constexpr uint64_t STEP_BYTES = 1024 * 1024;
+
+// The target formats: those with a wasm SIMD vec_dot kernel (the formats
+// scripts/gguf_meta.py --tensors reports as "wasm SIMD"). For the same model,
+// q8_0 keeps the quality and q4_0 runs fastest on wasm32.
+struct RequantizeTarget {
+  const char *name;
+  ggml_type type;
+  llama_ftype ftype; // general.file_type of the output
+};
+constexpr RequantizeTarget REQUANTIZE_TARGETS[] = {
+    {"q4_0", GGML_TYPE_Q4_0, LLAMA_FTYPE_MOSTLY_Q4_0},
+    {"q4_1", GGML_TYPE_Q4_1, LLAMA_FTYPE_MOSTLY_Q4_1},
+    {"q5_0", GGML_TYPE_Q5_0, LLAMA_FTYPE_MOSTLY_Q5_0},
+    {"q5_1", GGML_TYPE_Q5_1, LLAMA_FTYPE_MOSTLY_Q5_1},
+    {"q8_0", GGML_TYPE_Q8_0, LLAMA_FTYPE_MOSTLY_Q8_0},
+    {"q4_K", GGML_TYPE_Q4_K, LLAMA_FTYPE_MOSTLY_Q4_K_S},
+    {"q5_K", GGML_TYPE_Q5_K, LLAMA_FTYPE_MOSTLY_Q5_K_S},
+    {"q6_K", GGML_TYPE_Q6_K, LLAMA_FTYPE_MOSTLY_Q6_K},
+};
+
+struct RequantizeTensor {
+  ggml_type src_type;
+  ggml_type dst_type;
+  int64_t n_per_row;
+  int64_t nrows;
+  uint64_t src_offset; // absolute offset in the input file
+  uint64_t dst_offset; // absolute offset in the output file
+};
+
+// --- File-scope state ----------------------------------------------------
+// One requantization at a time; in-memory only.
+struct RequantizeJob {
+  std::string input;
+  std::string output;
+  std::string qtype;
+  uint64_t slice_instructions = DEFAULT_SLICE_INSTRUCTIONS;
+
+  std::vector<RequantizeTensor> tensors;
+  uint64_t tensors_converted = 0; // converted (the others are copied)
+  size_t tensor = 0;              // next tensor
+  int64_t row = 0;                // next row of that tensor
+  uint64_t alignment = GGUF_DEFAULT_ALIGNMENT;
+
+  std::ifstream in;
+  std::ofstream out; // writes part, renamed to output when done
+  std::string part;
+  SHA256 sha256; // of the bytes written, for the upload metadata
+  uint64_t bytes_written = 0;
+  uint64_t bytes_total = 0;
+  uint64_t slices = 0;
+
+  std::string state = "idle"; // idle | running | stopped | done | error
+  std::string error;
+  uint64_t timer_id = 0;
+};
+RequantizeJob job;
+
+const RequantizeTarget *find_target_(const std::string &qtype) {
+  for (const RequantizeTarget &target : REQUANTIZE_TARGETS) {
+    if (qtype == target.name) {
+      return &target;
+    }
+  }
+  return nullptr;
+}
+
+// Like llama-quant: only weight matrices, never the norms & biases (1D) or
+// the MoE router, and only when a row is a whole number of blocks.
+ggml_type dst_type_(const ggml_tensor *t, ggml_type target) {
+  const std::string name = ggml_get_name(t);
+  const bool is_weight = name.size() > 7 &&
+                         name.compare(name.size() - 7, 7, ".weight") == 0;
+  const bool convertible =
+      t->type == GGML_TYPE_F32 || t->type == GGML_TYPE_F16 ||
+      t->type == GGML_TYPE_BF16 || t->type == GGML_TYPE_Q8_0;
+  if (!is_weight || !convertible || ggml_n_dims(t) < 2 ||
+      name.find("ffn_gate_inp") != std::string::npos ||
+      t->ne[0] % ggml_blck_size(target) != 0) {
+    return t->type;
+  }
+  return target;
+}
+
+void arm_timer_() {
+  job.timer_id = IC_API::set_timer_recurring(
+      TICK_NS, []() { run_requantize_slice(); });
+}
+
+void cancel_timer_() {
+  if (job.timer_id != 0) {
+    IC_API::cancel_timer(job.timer_id);
+    job.timer_id = 0;
+  }
+}
+
+void fail_(const std::string &msg) {
+  cancel_timer_();
+  job.in.close();
+  job.out.close();
+  std::error_code ec;
+  std::filesystem::remove(job.part, ec);
+  job.state = "error";
+  job.error = msg;
+  std::cout << "llama_cpp: requantize - " << msg << std::endl;
+}
+
+// The output is written sequentially, so its sha256 is computed on the way
+void write_output_(const void *data, size_t n) {
+  job.out.write(reinterpret_cast<const char *>(data), n);
+  job.sha256.add(data, n);
+  job.bytes_written += n;
+}
+
+bool pad_output_to_(uint64_t offset) {
+  static const char zeros[GGUF_DEFAULT_ALIGNMENT * 8] = {};
+  while (job.bytes_written < offset) {
+    const uint64_t n =
+        std::min<uint64_t>(offset - job.bytes_written, sizeof(zeros));
+    write_output_(zeros, n);
+  }
+  return job.out.good();
+}
+
+// Reads the input header, writes the output header, and lays out the output
+// tensors. Leaves the input & output streams open for the slices.
+bool prepare_(const RequantizeTarget &target, std::string &msg) {
+  ggml_context *meta_in = nullptr;
+  gguf_init_params params = {/*.no_alloc =*/true, /*.ctx =*/&meta_in};
+  gguf_context *in = gguf_init_from_file(job.input.c_str(), params);
+  if (in == nullptr) {
+    msg = "not a (complete) gguf file: " + job.input;
+    return false;
+  }
+
+  const int64_t n_tensors = gguf_get_n_tensors(in);
+  ggml_init_params meta_params = {
+      /*.mem_size   =*/(size_t)(n_tensors + 1) * ggml_tensor_overhead(),
+      /*.mem_buffer =*/nullptr,
+      /*.no_alloc   =*/true};
+  ggml_context *meta_out = ggml_init(meta_params);
+
+  gguf_context *out = gguf_init_empty();
+  gguf_set_kv(out, in);
+  gguf_set_val_u32(out, "general.quantization_version", GGML_QNT_VERSION);
+  gguf_set_val_u32(out, "general.file_type", target.ftype);
+
+  job.tensors.clear();
+  job.tensors_converted = 0;
+  for (int64_t i = 0; i < n_tensors; i++) {
+    const ggml_tensor *t =
+        ggml_get_tensor(meta_in, gguf_get_tensor_name(in, i));
+    const ggml_type dst_type = dst_type_(t, target.type);
+
+    ggml_tensor *t_out =
+        ggml_new_tensor(meta_out, dst_type, ggml_n_dims(t), t->ne);
+    ggml_set_name(t_out, ggml_get_name(t));
+    gguf_add_tensor(out, t_out);
+
+    RequantizeTensor rt;
+    rt.src_type = t->type;
+    rt.dst_type = dst_type;
+    rt.n_per_row = t->ne[0];
+    rt.nrows = ggml_nrows(t);
+    rt.src_offset = gguf_get_data_offset(in) + gguf_get_tensor_offset(in, i);
+    job.tensors.push_back(rt);
+    if (dst_type != t->type) {
+      job.tensors_converted++;
+    }
+  }
+
+  std::vector<uint8_t> header(gguf_get_meta_size(out));
+  gguf_get_meta_data(out, header.data());
+  for (int64_t i = 0; i < n_tensors; i++) {
+    job.tensors[i].dst_offset = header.size() + gguf_get_tensor_offset(out, i);
+  }
+  job.alignment = gguf_get_alignment(out);
+  job.bytes_total = header.size();
+  if (n_tensors > 0) {
+    job.bytes_total = job.tensors.back().dst_offset +
+                      gguf_get_tensor_size(out, n_tensors - 1);
+  }
+  job.bytes_total = GGML_PAD(job.bytes_total, job.alignment);
+
+  gguf_free(out);
+  ggml_free(meta_out);
+  gguf_free(in);
+  ggml_free(meta_in);
+
+  job.in.open(job.input, std::ios::binary);
+  job.part = job.output + ".part";
+  job.out.open(job.part, std::ios::binary | std::ios::trunc);
+  if (!job.in.is_open() || !job.out.is_open()) {
+    msg = "cannot open " + (job.in.is_open() ? job.part : job.input);
+    return false;
+  }
+  job.sha256.reset();
+  job.bytes_written = 0;
+  write_output_(header.data(), header.size());
+  job.tensor = 0;
+  job.row = 0;
+  return job.out.good();
+}
+
+// Converts (or copies) the next rows of the current tensor.
+bool step_(std::string &msg) {
+  RequantizeTensor &t = job.tensors[job.tensor];
+  if (job.row == 0 && !pad_output_to_(t.dst_offset)) {
+    msg = "write error on " + job.part;
+    return false;
+  }
+
+  const size_t src_row_size = ggml_row_size(t.src_type, t.n_per_row);
+  const int64_t rows = std::min<int64_t>(
+      t.nrows - job.row,
+      std::max<int64_t>(1, (int64_t)(STEP_BYTES / src_row_size)));
+
+  std::vector<uint8_t> src(rows * src_row_size);
+  job.in.seekg(t.src_offset + job.row * src_row_size);
+  job.in.read(reinterpret_cast<char *>(src.data()), src.size());
+  if (!job.in.good()) {
+    msg = "read error on " + job.input;
+    return false;
+  }
+
+  if (t.dst_type == t.src_type) {
+    write_output_(src.data(), src.size());
+  } else {
+    const int64_t n = rows * t.n_per_row;
+    std::vector<float> f32(n);
+    if (t.src_type == GGML_TYPE_F32) {
+      std::memcpy(f32.data(), src.data(), n * sizeof(float));
+    } else {
+      ggml_get_type_traits(t.src_type)->to_float(src.data(), f32.data(), n);
+    }
+    std::vector<uint8_t> dst(rows * ggml_row_size(t.dst_type, t.n_per_row));
+    const size_t size = ggml_quantize_chunk(t.dst_type, f32.data(), dst.data(),
+                                            0, rows, t.n_per_row, nullptr);
+    write_output_(dst.data(), size);
+  }
+  if (!job.out.good()) {
+    msg = "write error on " + job.part;
+    return false;
+  }
+
+  job.row += rows;
+  if (job.row == t.nrows) {
+    job.tensor++;
+    job.row = 0;
+  }
+  return true;
+}
+
+CandidTypeRecord build_status_record_() {
+  CandidTypeRecord r;
+  r.append("state", CandidTypeText{job.state});
+  r.append("input", CandidTypeText{job.input});
+  r.append("output", CandidTypeText{job.output});
+  r.append("qtype", CandidTypeText{job.qtype});
+  r.append("tensors_done", CandidTypeNat64{(uint64_t)job.tensor});
+  r.append("tensors_total", CandidTypeNat64{(uint64_t)job.tensors.size()});
+  r.append("tensors_converted", CandidTypeNat64{job.tensors_converted});
+  r.append("bytes_written", CandidTypeNat64{job.bytes_written});
+  r.append("bytes_total", CandidTypeNat64{job.bytes_total});
+  r.append("slices", CandidTypeNat64{job.slices});
+  r.append("error", CandidTypeText{job.error});
+  return r;
+}
+
+void send_requantize_error_to_wire_(IC_API &ic_api, const std::string &func,
+                                    const std::string &msg) {
+  ic_api.to_wire(CandidTypeVariant{
+      "Err",
+      CandidTypeVariant{"Other", CandidTypeText{func + ": " + msg}}});
+}
+
+} // namespace
+
+// --- Slice ----------------------------------------------------------------
+
+void run_requantize_slice() {
+  if (job.state != "running") {
+    return;
+  }
+
+  const uint64_t instructions_start = instruction_counter();
+  std::string msg;
+  while (job.tensor < job.tensors.size() &&
+         instruction_counter() - instructions_start < job.slice_instructions) {
+    if (!step_(msg)) {
+      fail_(msg);
+      return;
+    }
+  }
+  job.slices++;
+
+  if (job.tensor < job.tensors.size()) {
+    return; // the next tick continues
+  }
+
+  if (!pad_output_to_(job.bytes_total)) {
+    fail_("write error on " + job.part);
+    return;
+  }
+  job.in.close();
+  job.out.close();
+
+  // Only a complete output replaces the file, and it is then registered like
+  // an upload, so uploaded_file_details & the loader's checks see it
+  file_upload_close(job.output);
+  std::error_code ec;
+  std::filesystem::rename(job.part, job.output, ec);
+  if (ec) {
+    fail_("cannot rename " + job.part + " to " + job.output + ": " +
+          ec.message());
+    return;
+  }
+  update_file_metadata(job.output, job.bytes_written, job.sha256.getHash());
+
+  cancel_timer_();
+  job.state = "done";
+  std::cout << "llama_cpp: " << std::string(__func__) << " - wrote "
+            << job.output << " (" << job.bytes_written << " bytes, "
+            << job.slices << " slices)" << std::endl;
+}
+
+// --- Endpoints ------------------------------------------------------------
+
+void requantize_start() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string input;
+  std::string output;
+  std::string qtype;
+  std::optional<uint64_t> opt_slice_instructions;
+  CandidTypeRecord r_in;
+  r_in.append("input", CandidTypeText{&input});
+  r_in.append("output", CandidTypeText{&output});
+  r_in.append("qtype", CandidTypeText{&qtype});
+  r_in.append("slice_instructions",
+              CandidTypeOptNat64{&opt_slice_instructions});
+  ic_api.from_wire(r_in);
+
+  if (job.state == "running") {
+    send_requantize_error_to_wire_(ic_api, __func__,
+                                   "a requantization is already running");
+    return;
+  }
+
+  const RequantizeTarget *target = find_target_(qtype);
+  if (target == nullptr) {
+    std::string names;
+    for (const RequantizeTarget &t : REQUANTIZE_TARGETS) {
+      names += std::string(names.empty() ? "" : ", ") + t.name;
+    }
+    send_requantize_error_to_wire_(
+        ic_api, __func__, "qtype must be one of: " + names);
+    return;
+  }
+  if (input.empty() || output.empty() || input == output) {
+    send_requantize_error_to_wire_(
+        ic_api, __func__, "input and output must be two different files");
+    return;
+  }
+
+  if (opt_slice_instructions.has_value()) {
+    job.slice_instructions = std::clamp<uint64_t>(
+        *opt_slice_instructions, 1, SLICE_INSTRUCTIONS_CEILING);
+  }
+
+  const bool resume = job.state == "stopped" && job.input == input &&
+                      job.output == output && job.qtype == qtype;
+  if (!resume) {
+    job.in.close();
+    job.out.close();
+    job.input = input;
+    job.output = output;
+    job.qtype = qtype;
+    job.slices = 0;
+    job.error.clear();
+    std::string msg;
+    if (!prepare_(*target, msg)) {
+      fail_(msg);
+      send_requantize_error_to_wire_(ic_api, __func__, msg);
+      return;
+    }
+  }
+
+  job.state = "running";
+  cancel_timer_();
+  arm_timer_();
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - "
+            << (resume ? "resumed " : "started ") << input << " -> "
+            << output << " (" << qtype << ", " << job.tensors_converted
+            << " of " << job.tensors.size() << " tensors converted)"
+            << std::endl;
+
+  ic_api.to_wire(
+      CandidTypeVariant{"Ok", CandidTypeRecord{build_status_record_()}});
+}
+
+void requantize_stop() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+  ic_api.from_wire();
+
+  if (job.state == "running") {
+    cancel_timer_();
+    job.state = "stopped";
+    std::cout << "llama_cpp: " << std::string(__func__) << " - stopped at "
+              << job.bytes_written << " of " << job.bytes_total << " bytes"
+              << std::endl;
+  }
+
+  ic_api.to_wire(
+      CandidTypeVariant{"Ok", CandidTypeRecord{build_status_record_()}});
+}
+
+void requantize_status() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+  ic_api.from_wire();
+
+  ic_api.to_wire(
+      CandidTypeVariant{"Ok", CandidTypeRecord{build_status_record_()}});
+}
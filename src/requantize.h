@@ -0,0 +1,40 @@
+// On-canister requantization of an uploaded gguf.
+//
+// Converts an uploaded F32/F16/BF16/Q8_0 gguf into a new gguf whose weight
+// matrices are in one of the formats with a wasm SIMD vec_dot kernel (see
+// REQUANTIZE_TARGETS in requantize.cpp), so an operator can pick the speed /
+// quality trade-off on-chain instead of re-uploading a multi-GB file.
+//
+// llama-quant.cpp is not compiled in (it runs std::thread workers), so this
+// is a single-threaded pipeline built on gguf + ggml_quantize_chunk:
+//  - requantize_start writes the new header and arms a timer
+//  - every tick converts rows until the slice's instruction budget is used,
+//    so no single message comes near the IC's instruction limit
+//  - requantize_stop pauses it; requantize_start with the same arguments
+//    resumes where it stopped
+// Only 2D ".weight" tensors are converted; norms, biases and tensors whose
+// rows do not fit the target's block size are copied as-is.
+//
+// The output is written to output + ".part" and renamed when done, then
+// registered in the upload metadata (filesize, sha256) like an uploaded file.
+//
+// Lifecycle is operator-driven, and the state is in-memory only: an upgrade
+// loses a requantization in progress (start it again). The output itself is
+// never left truncated: only the .part file is, and the next start rewrites it.
+#pragma once
+
+#include "wasm_symbol.h"
+
+#include <cstdint>
+
+// Update endpoints — RBAC: has_admin_update_role required.
+void requantize_start() WASM_SYMBOL_EXPORTED("canister_update requantize_start");
+void requantize_stop() WASM_SYMBOL_EXPORTED("canister_update requantize_stop");
+
+// Query endpoint — RBAC: has_admin_query_role required.
+void requantize_status()
+    WASM_SYMBOL_EXPORTED("canister_query requantize_status");
+
+// Converts rows until the slice's instruction budget is used. Called by the
+// timer; does NOT construct an IC_API instance.
+void run_requantize_slice();
@@ -3,6 +3,7 @@
 #include "common.h"
 #include "db_chats.h"
 #include "http.h"
+#include "lora.h"
 #include "main_.h"
 #include "max_tokens.h"
 #include "promptcache.h"
@@ -84,6 +85,15 @@ void new_chat() {
   }
   path_session = canister_path_session;
 
+  // The prompt-cache identity includes the LoRA adapter this principal runs
+  // with, so attach it before checking the cache.
+  lora_cache_selection(principal_id);
+  if (!lora_apply_selection(principal_id, error_msg)) {
+    send_output_record_result_error_to_wire(
+        ic_api, Http::StatusCode::InternalServerError, error_msg);
+    return;
+  }
+
   std::string msg;
   if (!path_session.empty()) {
 
@@ -152,9 +162,16 @@ void run(IC_API &ic_api, const uint64_t &max_tokens, bool is_query) {
     return;
   }
 
-  // If we're going to load a new model, first free the Orthogonally Persisted memory of a previously loaded model
+  // Run with the given model: a resident model is reused, otherwise main_
+  // loads it, evicting the least recently used model(s) to make room for it.
   if (!params.model.empty()) {
-    icpp_free_model();
+    icpp_select_model(params.model.path);
+  }
+
+  // main_ attaches this principal's LoRA adapter; keep the selection resident
+  // for the next runs, but not from a query, which cannot keep it
+  if (!is_query) {
+    lora_cache_selection(principal_id);
   }
 
   // Call main_, just like it is called in the llama-cli app
@@ -173,12 +190,15 @@ void run(IC_API &ic_api, const uint64_t &max_tokens, bool is_query) {
   uint64_t n_prompt_tokens_decoded = 0;
   uint64_t n_tokens_generated = 0;
   uint64_t n_prompt_tokens_remaining = 0;
+  // Instructions per phase of main_(), put on the wire next to the token counts.
+  IcppPhaseInstructions phase_instructions;
   bool load_model_only = false;
   int result = main_(argc, argv.data(), principal_id, load_model_only,
                      icpp_error_msg, conversation_ss, output_ss, max_tokens,
                      prompt_remaining, generated_eog, n_prompt_tokens,
                      n_prompt_tokens_cached, n_prompt_tokens_decoded,
-                     n_tokens_generated, n_prompt_tokens_remaining);
+                     n_tokens_generated, n_prompt_tokens_remaining,
+                     phase_instructions);
 
   // Exit if there was an error
   if (result != 0) {
@@ -228,6 +248,29 @@ void run(IC_API &ic_api, const uint64_t &max_tokens, bool is_query) {
   r_out.append(
       "n_prompt_tokens_remaining",
       CandidTypeOptNat64{std::optional<uint64_t>{n_prompt_tokens_remaining}});
+  // Where the instructions of this call went (opt nat64, success record only,
+  // like the token counts). All 0 in native builds.
+  r_out.append("instructions_arg_parse",
+               CandidTypeOptNat64{std::optional<uint64_t>{
+                   phase_instructions.arg_parse}});
+  r_out.append("instructions_session_load",
+               CandidTypeOptNat64{std::optional<uint64_t>{
+                   phase_instructions.session_load}});
+  r_out.append("instructions_tokenization",
+               CandidTypeOptNat64{std::optional<uint64_t>{
+                   phase_instructions.tokenization}});
+  r_out.append("instructions_prefill",
+               CandidTypeOptNat64{std::optional<uint64_t>{
+                   phase_instructions.prefill}});
+  r_out.append("instructions_generation",
+               CandidTypeOptNat64{std::optional<uint64_t>{
+                   phase_instructions.generation}});
+  r_out.append("instructions_sampling",
+               CandidTypeOptNat64{std::optional<uint64_t>{
+                   phase_instructions.sampling}});
+  r_out.append("instructions_session_save",
+               CandidTypeOptNat64{std::optional<uint64_t>{
+                   phase_instructions.session_save}});
   ic_api.to_wire(CandidTypeVariant{"Ok", r_out});
 }
 
@@ -1,5 +1,7 @@
 #include "upload.h"
 #include "auth.h"
+#include "cache_index.h"
+#include "gguf_index.h"
 #include "http.h"
 #include "ready.h"
 #include "utils.h"
@@ -7,12 +9,17 @@
 // This library is included with icpp-pro
 #include "hash-library/sha256.h"
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <optional>
 #include <stdio.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "ic_api.h"
 
@@ -25,157 +32,302 @@ struct UploadSession {
   uint64_t previous_offset;
   SHA256 sha256_state; // Calculate SHA256 hash for the file we're uploading
       // It is callers responsibility to upload one file from start to finish
+  // The file stays open for the whole upload: opening it through the
+  // ic-wasi-polyfill (path lookup + metadata) for every chunk is pure overhead.
+  std::ofstream of_stream;
 };
 // One upload session per filename
 static std::unordered_map<std::string, UploadSession> upload_sessions;
-
-// Maintain a list of files that are uploaded to the canister with metadata
-// (filename, filesize, sha256) to be used for validation
-struct FileMetadata {
-  std::string filename;
-  uint64_t filesize;
-  std::string sha256;
+// At most one upload keeps its file open: the one that received the last chunk
+static std::string open_upload_filename;
+
+// State of a parallel upload (file_upload_begin / file_upload_chunk_at /
+// file_upload_finish). Chunks arrive in any order, so instead of a streaming
+// SHA-256 we keep the leaf hash of every chunk: the leaves of the Merkle tree
+// whose root is computed at file_upload_finish.
+struct ParallelUploadSession {
+  uint64_t filesize = 0;
+  uint64_t chunksize = 0;
+  std::vector<bool> received; // bitmap, one bit per chunk
+  uint64_t n_received = 0;
+  std::vector<std::array<unsigned char, SHA256::HashBytes>> chunk_hashes;
+  std::ofstream of_stream; // open until file_upload_finish
 };
+static std::unordered_map<std::string, ParallelUploadSession>
+    parallel_upload_sessions;
 
-// In-memory cache of file metadata
-static std::vector<FileMetadata> uploaded_files;
+void file_upload_close(const std::string &filename) {
+  auto it = upload_sessions.find(filename);
+  if (it != upload_sessions.end() && it->second.of_stream.is_open()) {
+    it->second.of_stream.close();
+  }
+  if (open_upload_filename == filename) {
+    open_upload_filename.clear();
+  }
+  // A parallel upload cannot continue once its file is closed
+  parallel_upload_sessions.erase(filename);
+}
 
-// File path to store metadata persistently
+// --- File metadata store ---------------------------------------------------
+//
+// The metadata of all uploaded files is resident in a hash map, loaded from
+// disk once (again after an upgrade), so a lookup costs no I/O.
+//
+// It is persisted incrementally: every change is appended as one record to a
+// log, instead of rewriting the whole store for every uploaded chunk. When the
+// log has grown well past the number of files, it is compacted: the map is
+// written as a snapshot, and the log is truncated. An IC message is atomic
+// (a trap rolls back the filesystem too), so there is no torn state between
+// the two.
+//
+// Snapshot: count, then per file: filename, filesize, sha256 (the original,
+//           whole-store format, so existing canisters keep their metadata),
+//           then a trailer that older versions do not read: count, then per
+//           file of a parallel upload: filename, merkle_chunksize
+// Log     : per change: op (put/put_merkle/delete), filename,
+//           [filesize, sha256], [merkle_chunksize]
+
+// In-memory store of file metadata, by filename
+static std::unordered_map<std::string, FileMetadata> uploaded_files;
+static bool uploaded_files_loaded = false;
+
+// File paths to store metadata persistently
 const std::string METADATA_FILE = "uploaded_files_metadata.dat";
+const std::string METADATA_LOG_FILE = "uploaded_files_metadata.log";
+
+enum MetadataLogOp : uint8_t {
+  METADATA_PUT = 1,
+  METADATA_DELETE = 2,
+  METADATA_PUT_MERKLE = 3
+};
 
-// Save the metadata to disk
-void save_file_metadata() {
+// Records appended since the last compaction. Compact when the log holds more
+// than this many records per resident file (plus a floor, for few files).
+static uint64_t metadata_log_records = 0;
+const uint64_t METADATA_LOG_RECORDS_PER_FILE = 4;
+const uint64_t METADATA_LOG_RECORDS_MIN = 256;
+
+// The log stays open for appends, like the file of an in-flight upload
+static std::ofstream metadata_log;
+
+static void write_string(std::ofstream &file, const std::string &s) {
+  uint64_t size = s.size();
+  file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  file.write(s.data(), size);
+}
+
+static bool read_string(std::ifstream &file, std::string &s,
+                        uint64_t max_size, const char *what) {
+  uint64_t size = 0;
+  file.read(reinterpret_cast<char *>(&size), sizeof(size));
+  if (!file.good()) {
+    return false;
+  }
+  if (size > max_size) {
+    std::cout << "Corrupted metadata: " << what << " " << size
+              << " exceeds limit " << max_size << std::endl;
+    return false;
+  }
+  s.resize(size);
+  file.read(s.data(), size);
+  return file.good();
+}
+
+// Write the snapshot of the whole store
+static void save_file_metadata() {
   std::ofstream file(METADATA_FILE, std::ios::binary | std::ios::trunc);
   if (!file.is_open()) {
     std::cerr << "Failed to open metadata file for writing" << std::endl;
     return;
   }
 
-  // Write number of entries
   uint64_t count = uploaded_files.size();
   file.write(reinterpret_cast<const char *>(&count), sizeof(count));
-
-  // Write each entry
-  for (const auto &metadata : uploaded_files) {
-    // Write filename
-    uint64_t filename_size = metadata.filename.size();
-    file.write(reinterpret_cast<const char *>(&filename_size),
-               sizeof(filename_size));
-    file.write(metadata.filename.c_str(), filename_size);
-
-    // Write filesize
+  for (const auto &[filename, metadata] : uploaded_files) {
+    write_string(file, metadata.filename);
     file.write(reinterpret_cast<const char *>(&metadata.filesize),
                sizeof(metadata.filesize));
-
-    // Write SHA256 hash
-    uint64_t sha256_size = metadata.sha256.size();
-    file.write(reinterpret_cast<const char *>(&sha256_size),
-               sizeof(sha256_size));
-    file.write(metadata.sha256.c_str(), sha256_size);
+    write_string(file, metadata.sha256);
   }
 
-  file.close();
-}
-
-// Load the metadata from disk
-void load_file_metadata() {
-  std::ifstream file(METADATA_FILE, std::ios::binary);
-  if (!file.is_open()) {
-    std::cout << "Metadata file not found, starting with empty list"
-              << std::endl;
-    return;
+  std::vector<const FileMetadata *> merkle;
+  for (const auto &[filename, metadata] : uploaded_files) {
+    if (metadata.merkle_chunksize > 0) {
+      merkle.push_back(&metadata);
+    }
+  }
+  uint64_t merkle_count = merkle.size();
+  file.write(reinterpret_cast<const char *>(&merkle_count),
+             sizeof(merkle_count));
+  for (const FileMetadata *metadata : merkle) {
+    write_string(file, metadata->filename);
+    file.write(reinterpret_cast<const char *>(&metadata->merkle_chunksize),
+               sizeof(metadata->merkle_chunksize));
   }
+}
 
+// Load the snapshot, then replay the log on top of it
+static void load_file_metadata() {
   uploaded_files.clear();
+  metadata_log_records = 0;
 
-  // Read number of entries
-  uint64_t count = 0;
-  file.read(reinterpret_cast<char *>(&count), sizeof(count));
-
-  // Read each entry
-  for (uint64_t i = 0; i < count; i++) {
-    FileMetadata metadata = {};
-
-    // Read filename
-    uint64_t filename_size = 0;
-    file.read(reinterpret_cast<char *>(&filename_size), sizeof(filename_size));
-    if (filename_size > MAX_FILENAME_SIZE) {
-      std::cout << "Corrupted metadata: filename_size " << filename_size
-                << " exceeds limit " << MAX_FILENAME_SIZE << std::endl;
-      break;
-    }
-    metadata.filename.resize(filename_size);
-    file.read(&metadata.filename[0], filename_size);
-
-    // Read filesize
-    file.read(reinterpret_cast<char *>(&metadata.filesize),
-              sizeof(metadata.filesize));
-
-    // Read SHA256 hash
-    uint64_t sha256_size = 0;
-    file.read(reinterpret_cast<char *>(&sha256_size), sizeof(sha256_size));
-    if (sha256_size > MAX_SHA256_SIZE) {
-      std::cout << "Corrupted metadata: sha256_size " << sha256_size
-                << " exceeds limit " << MAX_SHA256_SIZE << std::endl;
-      break;
+  std::ifstream file(METADATA_FILE, std::ios::binary);
+  if (file.is_open()) {
+    uint64_t count = 0;
+    file.read(reinterpret_cast<char *>(&count), sizeof(count));
+    for (uint64_t i = 0; i < count && file.good(); i++) {
+      FileMetadata metadata = {};
+      if (!read_string(file, metadata.filename, MAX_FILENAME_SIZE,
+                       "filename_size")) {
+        break;
+      }
+      file.read(reinterpret_cast<char *>(&metadata.filesize),
+                sizeof(metadata.filesize));
+      if (!read_string(file, metadata.sha256, MAX_SHA256_SIZE,
+                       "sha256_size")) {
+        break;
+      }
+      uploaded_files[metadata.filename] = metadata;
     }
-    metadata.sha256.resize(sha256_size);
-    file.read(&metadata.sha256[0], sha256_size);
 
-    uploaded_files.push_back(metadata);
+    // The trailer; absent in a snapshot of an older version
+    uint64_t merkle_count = 0;
+    file.read(reinterpret_cast<char *>(&merkle_count), sizeof(merkle_count));
+    for (uint64_t i = 0; i < merkle_count && file.good(); i++) {
+      std::string filename;
+      uint64_t merkle_chunksize = 0;
+      if (!read_string(file, filename, MAX_FILENAME_SIZE, "filename_size")) {
+        break;
+      }
+      file.read(reinterpret_cast<char *>(&merkle_chunksize),
+                sizeof(merkle_chunksize));
+      auto it = uploaded_files.find(filename);
+      if (file.good() && it != uploaded_files.end()) {
+        it->second.merkle_chunksize = merkle_chunksize;
+      }
+    }
   }
 
-  file.close();
+  std::ifstream log(METADATA_LOG_FILE, std::ios::binary);
+  if (log.is_open()) {
+    uint8_t op = 0;
+    while (log.read(reinterpret_cast<char *>(&op), sizeof(op))) {
+      FileMetadata metadata = {};
+      if (!read_string(log, metadata.filename, MAX_FILENAME_SIZE,
+                       "filename_size")) {
+        break; // a truncated last record
+      }
+      if (op == METADATA_PUT || op == METADATA_PUT_MERKLE) {
+        log.read(reinterpret_cast<char *>(&metadata.filesize),
+                 sizeof(metadata.filesize));
+        if (!read_string(log, metadata.sha256, MAX_SHA256_SIZE,
+                         "sha256_size")) {
+          break;
+        }
+        if (op == METADATA_PUT_MERKLE &&
+            !log.read(reinterpret_cast<char *>(&metadata.merkle_chunksize),
+                      sizeof(metadata.merkle_chunksize))) {
+          break;
+        }
+        uploaded_files[metadata.filename] = metadata;
+      } else if (op == METADATA_DELETE) {
+        uploaded_files.erase(metadata.filename);
+      } else {
+        std::cout << "Corrupted metadata log: op " << (int)op << std::endl;
+        break;
+      }
+      metadata_log_records++;
+    }
+  }
 }
 
-// Add or update file metadata
-void update_file_metadata(const std::string &filename, uint64_t filesize,
-                          const std::string &sha256) {
-  // Always load the metadata from disk first
+void load_file_metadata_store() {
   load_file_metadata();
+  uploaded_files_loaded = true;
+}
+
+// canister_init & canister_post_upgrade load the store. This is the fallback
+// for when they did not run, e.g. in the native tests.
+static void ensure_file_metadata_loaded() {
+  if (!uploaded_files_loaded) {
+    load_file_metadata_store();
+  }
+}
+
+// Snapshot the store and start an empty log
+static void compact_file_metadata() {
+  metadata_log.close();
+  save_file_metadata();
+  std::ofstream truncated_log(METADATA_LOG_FILE,
+                              std::ios::binary | std::ios::trunc);
+  metadata_log_records = 0;
+}
 
-  // Check if file already exists in our list
-  for (auto &metadata : uploaded_files) {
-    if (metadata.filename == filename) {
-      // Update existing entry
-      metadata.filesize = filesize;
-      metadata.sha256 = sha256;
-      save_file_metadata();
+static void append_file_metadata_log(MetadataLogOp op,
+                                     const FileMetadata &metadata) {
+  if (metadata_log_records >=
+      METADATA_LOG_RECORDS_MIN +
+          METADATA_LOG_RECORDS_PER_FILE * uploaded_files.size()) {
+    compact_file_metadata();
+  }
+  if (!metadata_log.is_open()) {
+    metadata_log.open(METADATA_LOG_FILE, std::ios::binary | std::ios::app);
+    if (!metadata_log.is_open()) {
+      std::cerr << "Failed to open metadata log for writing" << std::endl;
       return;
     }
   }
+  uint8_t op_byte = op;
+  metadata_log.write(reinterpret_cast<const char *>(&op_byte),
+                     sizeof(op_byte));
+  write_string(metadata_log, metadata.filename);
+  if (op == METADATA_PUT || op == METADATA_PUT_MERKLE) {
+    metadata_log.write(reinterpret_cast<const char *>(&metadata.filesize),
+                       sizeof(metadata.filesize));
+    write_string(metadata_log, metadata.sha256);
+  }
+  if (op == METADATA_PUT_MERKLE) {
+    metadata_log.write(
+        reinterpret_cast<const char *>(&metadata.merkle_chunksize),
+        sizeof(metadata.merkle_chunksize));
+  }
+  metadata_log.flush();
+  metadata_log_records++;
+}
 
-  // Add new entry
-  uploaded_files.push_back({filename, filesize, sha256});
-  save_file_metadata();
+// Add or update file metadata
+void update_file_metadata(const std::string &filename, uint64_t filesize,
+                          const std::string &sha256,
+                          uint64_t merkle_chunksize) {
+  ensure_file_metadata_loaded();
+  FileMetadata &metadata = uploaded_files[filename];
+  metadata = {filename, filesize, sha256, merkle_chunksize};
+  append_file_metadata_log(
+      merkle_chunksize > 0 ? METADATA_PUT_MERKLE : METADATA_PUT, metadata);
 }
 
 // Get file metadata by filename
 std::optional<FileMetadata> get_file_metadata(const std::string &filename) {
-  // Always load the metadata from disk first
-  load_file_metadata();
-
-  for (const auto &metadata : uploaded_files) {
-    if (metadata.filename == filename) {
-      return metadata; // Return by value, not pointer
-    }
+  ensure_file_metadata_loaded();
+  auto it = uploaded_files.find(filename);
+  if (it == uploaded_files.end()) {
+    return std::nullopt;
   }
-  return std::nullopt;
+  return it->second; // Return by value, not pointer
 }
 
 // Delete file metadata by filename. Returns true if a matching record was
-// found and removed from the in-memory vector, false otherwise.
+// found and removed from the store, false otherwise.
 bool delete_file_metadata(const std::string &filename) {
-  load_file_metadata();
-
-  for (auto it = uploaded_files.begin(); it != uploaded_files.end(); ++it) {
-    if (it->filename == filename) {
-      uploaded_files.erase(it);
-      save_file_metadata();
-      return true;
-    }
+  ensure_file_metadata_loaded();
+  auto it = uploaded_files.find(filename);
+  if (it == uploaded_files.end()) {
+    return false;
   }
-  return false;
+  FileMetadata metadata = it->second;
+  uploaded_files.erase(it);
+  append_file_metadata_log(METADATA_DELETE, metadata);
+  return true;
 }
 
 void print_file_upload_summary(const std::string &filename,
@@ -229,30 +381,42 @@ void file_upload_chunk_(IC_API &ic_api, const std::string &filename,
   }
 
   // Make sure there's a session entry for this filename
+  if (!open_upload_filename.empty() && open_upload_filename != filename) {
+    file_upload_close(open_upload_filename);
+  }
   auto &session = upload_sessions[filename];
+  std::string msg;
   if (offset == 0) {
-    // First chunk for this file: (re)initialize
+    // First chunk for this file: (re)initialize, and truncate the file to zero
+    // length
     session.is_first_chunk = true;
     session.previous_offset = 0;
     session.sha256_state = SHA256();
+    if (session.of_stream.is_open()) {
+      session.of_stream.close();
+    }
+    if (!open_ofstream(filename, std::ios::binary | std::ios::trunc,
+                       session.of_stream, msg)) {
+      ic_api.to_wire(CandidTypeVariant{
+          "Err", CandidTypeVariant{
+                     "Other", CandidTypeText{std::string(__func__) + ": " +
+                                             msg}}});
+      return;
+    }
+  } else if (!session.of_stream.is_open()) {
+    // A continued upload without an open file (e.g. after an upgrade wiped
+    // the session). Open it without truncating what was uploaded before.
+    if (!open_ofstream(filename, std::ios::binary | std::ios::in | std::ios::out,
+                       session.of_stream, msg)) {
+      ic_api.to_wire(CandidTypeVariant{
+          "Err", CandidTypeVariant{
+                     "Other", CandidTypeText{std::string(__func__) + ": " +
+                                             msg}}});
+      return;
+    }
   }
-
-  // Open an ofstream
-  std::ofstream of_stream;
-  std::string msg;
-  std::ios_base::openmode mode = std::ios::binary;
-  if (offset == 0) {
-    mode |= std::ios::trunc;         // truncate the file to zero length
-    session.is_first_chunk = true;   // reset the first chunk flag
-    session.previous_offset = 0;     // reset the previous offset
-    session.sha256_state = SHA256(); // reset the SHA256 state
-  }
-  if (!open_ofstream(filename, mode, of_stream, msg)) {
-    ic_api.to_wire(CandidTypeVariant{
-        "Err", CandidTypeVariant{"Other", CandidTypeText{std::string(__func__) +
-                                                         ": " + msg}}});
-    return;
-  }
+  std::ofstream &of_stream = session.of_stream;
+  open_upload_filename = filename;
 
   // Check if we already handled this chunk
   if (!session.is_first_chunk && offset == session.previous_offset) {
@@ -282,12 +446,28 @@ void file_upload_chunk_(IC_API &ic_api, const std::string &filename,
         CandidTypeVariant{"Ok", CandidTypeRecord{file_upload_record}});
     return;
   }
+  // Write 'v' to 'filename', starting at 'offset'. Flush, so the bytes are
+  // visible to readers of the file (uploaded_file_tensor_index, load_model)
+  // while the stream stays open.
+  of_stream.seekp(offset);
+  of_stream.write(reinterpret_cast<const char *>(v.data()), v.size());
+  of_stream.flush();
+  if (!of_stream) {
+    of_stream.close(); // reopened by the retry of this chunk
+    ic_api.to_wire(CandidTypeVariant{
+        "Err", CandidTypeVariant{
+                   "Other", CandidTypeText{std::string(__func__) +
+                                           ": failed to write chunk to " +
+                                           filename}}});
+    return;
+  }
   session.is_first_chunk = false;
   session.previous_offset = offset;
 
-  // Write 'v' to 'filename', starting at 'offset'
-  of_stream.seekp(offset);
-  of_stream.write(reinterpret_cast<const char *>(v.data()), v.size());
+  // A short chunk is the last one: the upload is done, release the file
+  if (v.size() < chunksize) {
+    file_upload_close(filename);
+  }
 
   // Check for integer overflow before calculating filesize
   if (offset > UINT64_MAX - v.size()) {
@@ -310,6 +490,10 @@ void file_upload_chunk_(IC_API &ic_api, const std::string &filename,
   std::string filesha256 = session.sha256_state.getHash();
 
   update_file_metadata(filename, filesize, filesha256);
+  cache_index_note_write(filename);
+
+  // Index the tensors of a gguf as soon as its header is complete
+  gguf_index_on_upload_chunk(filename, offset, filesize);
 
   print_file_upload_summary(filename, v, offset, filesize, filesha256);
 
@@ -356,11 +540,348 @@ void uploaded_file_details_(IC_API &ic_api, const std::string &filename) {
   }
   uint64_t filesize = metadata->filesize;
   std::string filesha256 = metadata->sha256;
+  std::optional<uint64_t> merkle_chunksize;
+  if (metadata->merkle_chunksize > 0) {
+    merkle_chunksize = metadata->merkle_chunksize;
+  }
 
   // Return the file details over the wire
   CandidTypeRecord file_upload_record;
   file_upload_record.append("filename", CandidTypeText{filename});
   file_upload_record.append("filesize", CandidTypeNat64{filesize});
   file_upload_record.append("filesha256", CandidTypeText{filesha256});
+  file_upload_record.append("merkle_chunksize",
+                            CandidTypeOptNat64{merkle_chunksize});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{file_upload_record}});
+}
+
+// --- Parallel upload ---------------------------------------------------------
+
+static void send_upload_error_to_wire(IC_API &ic_api, const std::string &func,
+                                      const std::string &msg) {
+  ic_api.to_wire(CandidTypeVariant{
+      "Err",
+      CandidTypeVariant{"Other", CandidTypeText{func + ": " + msg}}});
+}
+
+// Limits of a parallel upload. The session keeps a bit and a SHA-256 per
+// chunk in the heap, so the number of chunks is capped (2 MiB of hashes); the
+// file size is capped to what the wasm32 heap could ever load, twice over.
+const uint64_t MAX_PARALLEL_UPLOAD_CHUNKS = 65536;
+const uint64_t MAX_PARALLEL_UPLOAD_FILESIZE = 8ULL * 1024 * 1024 * 1024;
+
+static uint64_t parallel_upload_n_chunks(const ParallelUploadSession &session) {
+  return (session.filesize + session.chunksize - 1) / session.chunksize;
+}
+
+static void send_parallel_upload_status_to_wire(
+    IC_API &ic_api, const std::string &filename,
+    const ParallelUploadSession &session) {
+  // The first missing chunks, so a client can resume after a failure
+  const uint64_t MAX_MISSING_REPORTED = 1000;
+  std::vector<uint64_t> missing;
+  for (uint64_t i = 0; i < session.received.size() &&
+                       missing.size() < MAX_MISSING_REPORTED;
+       i++) {
+    if (!session.received[i]) {
+      missing.push_back(i);
+    }
+  }
+
+  CandidTypeRecord r_out;
+  r_out.append("filename", CandidTypeText{filename});
+  r_out.append("filesize", CandidTypeNat64{session.filesize});
+  r_out.append("chunksize", CandidTypeNat64{session.chunksize});
+  r_out.append("total_chunks", CandidTypeNat64{parallel_upload_n_chunks(session)});
+  r_out.append("received_chunks", CandidTypeNat64{session.n_received});
+  r_out.append("missing_chunks", CandidTypeVecNat64{missing});
+  ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{r_out}});
+}
+
+// Merkle tree over the chunks, with domain separation (like RFC 6962): a leaf
+// is SHA-256(0x00 || chunk), a parent is SHA-256(0x01 || left || right), so a
+// 64-byte chunk holding two child hashes cannot pass for their parent (a
+// second preimage of the root with fewer chunks). An odd last node is carried
+// up unchanged: with the prefixes it cannot collide with a leaf, and as it is
+// never duplicated, a tree with a repeated last chunk has another root.
+// An empty file has one empty chunk: its root is SHA-256(0x00).
+static const unsigned char MERKLE_LEAF_PREFIX = 0x00;
+static const unsigned char MERKLE_NODE_PREFIX = 0x01;
+
+static std::array<unsigned char, SHA256::HashBytes>
+parallel_upload_merkle_leaf(const std::vector<uint8_t> &chunk) {
+  SHA256 sha256;
+  sha256.add(&MERKLE_LEAF_PREFIX, 1);
+  sha256.add(chunk.data(), chunk.size());
+  std::array<unsigned char, SHA256::HashBytes> leaf;
+  sha256.getHash(leaf.data());
+  return leaf;
+}
+
+static std::string parallel_upload_merkle_root(
+    const std::vector<std::array<unsigned char, SHA256::HashBytes>> &leaves) {
+  std::vector<std::array<unsigned char, SHA256::HashBytes>> level = leaves;
+  if (level.empty()) {
+    level.push_back(parallel_upload_merkle_leaf({}));
+  }
+  while (level.size() > 1) {
+    std::vector<std::array<unsigned char, SHA256::HashBytes>> parents;
+    for (size_t i = 0; i < level.size(); i += 2) {
+      if (i + 1 == level.size()) {
+        parents.push_back(level[i]);
+        continue;
+      }
+      SHA256 sha256;
+      sha256.add(&MERKLE_NODE_PREFIX, 1);
+      sha256.add(level[i].data(), level[i].size());
+      sha256.add(level[i + 1].data(), level[i + 1].size());
+      std::array<unsigned char, SHA256::HashBytes> parent;
+      sha256.getHash(parent.data());
+      parents.push_back(parent);
+    }
+    level = std::move(parents);
+  }
+
+  static const char hex[] = "0123456789abcdef";
+  std::string root;
+  for (unsigned char byte : level[0]) {
+    root += hex[byte >> 4];
+    root += hex[byte & 0x0f];
+  }
+  return root;
+}
+
+void file_upload_begin() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string filename{""};
+  uint64_t filesize{0};
+  uint64_t chunksize{0};
+  CandidTypeRecord r_in;
+  r_in.append("filename", CandidTypeText{&filename});
+  r_in.append("filesize", CandidTypeNat64{&filesize});
+  r_in.append("chunksize", CandidTypeNat64{&chunksize});
+  ic_api.from_wire(r_in);
+
+  if (chunksize == 0 || chunksize > MAX_CHUNK_SIZE) {
+    send_upload_error_to_wire(ic_api, __func__,
+                              "chunksize must be in [1, " +
+                                  std::to_string(MAX_CHUNK_SIZE) + "]");
+    return;
+  }
+  if (filename.empty() || filename.size() > MAX_FILENAME_SIZE) {
+    send_upload_error_to_wire(ic_api, __func__, "invalid filename");
+    return;
+  }
+  if (filesize > MAX_PARALLEL_UPLOAD_FILESIZE) {
+    send_upload_error_to_wire(ic_api, __func__,
+                              "filesize must be at most " +
+                                  std::to_string(MAX_PARALLEL_UPLOAD_FILESIZE));
+    return;
+  }
+  if ((filesize + chunksize - 1) / chunksize > MAX_PARALLEL_UPLOAD_CHUNKS) {
+    send_upload_error_to_wire(
+        ic_api, __func__,
+        "at most " + std::to_string(MAX_PARALLEL_UPLOAD_CHUNKS) +
+            " chunks; use a chunksize of at least " +
+            std::to_string((filesize + MAX_PARALLEL_UPLOAD_CHUNKS - 1) /
+                           MAX_PARALLEL_UPLOAD_CHUNKS));
+    return;
+  }
+
+  // Start over: close the file of any upload in flight, and forget its
+  // metadata -- it is written again at file_upload_finish.
+  file_upload_close(filename);
+  upload_sessions.erase(filename);
+  delete_file_metadata(filename);
+
+  ParallelUploadSession &session = parallel_upload_sessions[filename];
+  session.filesize = filesize;
+  session.chunksize = chunksize;
+  const uint64_t n_chunks = parallel_upload_n_chunks(session);
+  session.received.assign(n_chunks, false);
+  session.chunk_hashes.assign(n_chunks, {});
+
+  std::string msg;
+  if (!open_ofstream(filename, std::ios::binary | std::ios::trunc,
+                     session.of_stream, msg)) {
+    parallel_upload_sessions.erase(filename);
+    send_upload_error_to_wire(ic_api, __func__, msg);
+    return;
+  }
+  // Allocate the whole file up front; chunks are written at their offset
+  std::error_code ec;
+  std::filesystem::resize_file(filename, filesize, ec);
+  if (ec) {
+    session.of_stream.close();
+    parallel_upload_sessions.erase(filename);
+    send_upload_error_to_wire(ic_api, __func__,
+                              "cannot allocate " + std::to_string(filesize) +
+                                  " bytes for " + filename + ": " +
+                                  ec.message());
+    return;
+  }
+
+  // The tensor index is rebuilt at file_upload_finish
+  gguf_index_on_upload_chunk(filename, 0, 0);
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - " << filename
+            << ": " << filesize << " bytes in " << n_chunks << " chunks"
+            << std::endl;
+
+  send_parallel_upload_status_to_wire(ic_api, filename, session);
+}
+
+void file_upload_chunk_at() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string filename{""};
+  std::vector<uint8_t> v;
+  uint64_t index{0};
+  CandidTypeRecord r_in;
+  r_in.append("filename", CandidTypeText{&filename});
+  r_in.append("chunk", CandidTypeVecNat8{&v});
+  r_in.append("index", CandidTypeNat64{&index});
+  ic_api.from_wire(r_in);
+
+  auto it = parallel_upload_sessions.find(filename);
+  if (it == parallel_upload_sessions.end()) {
+    send_upload_error_to_wire(ic_api, __func__,
+                              "no parallel upload in progress for " + filename +
+                                  ". Call file_upload_begin first.");
+    return;
+  }
+  ParallelUploadSession &session = it->second;
+
+  const uint64_t n_chunks = parallel_upload_n_chunks(session);
+  if (index >= n_chunks) {
+    send_upload_error_to_wire(ic_api, __func__,
+                              "chunk index " + std::to_string(index) +
+                                  " out of range, the file has " +
+                                  std::to_string(n_chunks) + " chunks");
+    return;
+  }
+  const uint64_t offset = index * session.chunksize;
+  const uint64_t expected_size =
+      std::min(session.chunksize, session.filesize - offset);
+  if (v.size() != expected_size) {
+    send_upload_error_to_wire(ic_api, __func__,
+                              "chunk " + std::to_string(index) + " must be " +
+                                  std::to_string(expected_size) + " bytes, got " +
+                                  std::to_string(v.size()));
+    return;
+  }
+
+  std::array<unsigned char, SHA256::HashBytes> chunk_hash =
+      parallel_upload_merkle_leaf(v);
+
+  if (session.received[index]) {
+    // A retry: idempotent, as long as it is the same chunk
+    if (chunk_hash != session.chunk_hashes[index]) {
+      send_upload_error_to_wire(ic_api, __func__,
+                                "chunk " + std::to_string(index) +
+                                    " was already received with other bytes");
+      return;
+    }
+    send_parallel_upload_status_to_wire(ic_api, filename, session);
+    return;
+  }
+
+  session.of_stream.seekp(offset);
+  session.of_stream.write(reinterpret_cast<const char *>(v.data()), v.size());
+  session.of_stream.flush();
+  if (!session.of_stream) {
+    session.of_stream.clear();
+    send_upload_error_to_wire(ic_api, __func__,
+                              "failed to write chunk " + std::to_string(index) +
+                                  " to " + filename);
+    return;
+  }
+  session.received[index] = true;
+  session.n_received++;
+  session.chunk_hashes[index] = chunk_hash;
+
+  send_parallel_upload_status_to_wire(ic_api, filename, session);
+}
+
+void file_upload_finish() {
+  IC_API ic_api(CanisterUpdate{std::string(__func__)}, false);
+  if (!has_admin_update_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string filename{""};
+  CandidTypeRecord r_in;
+  r_in.append("filename", CandidTypeText{&filename});
+  ic_api.from_wire(r_in);
+
+  auto it = parallel_upload_sessions.find(filename);
+  if (it == parallel_upload_sessions.end()) {
+    send_upload_error_to_wire(ic_api, __func__,
+                              "no parallel upload in progress for " + filename);
+    return;
+  }
+  ParallelUploadSession &session = it->second;
+  const uint64_t n_chunks = parallel_upload_n_chunks(session);
+  if (session.n_received != n_chunks) {
+    send_upload_error_to_wire(
+        ic_api, __func__,
+        std::to_string(n_chunks - session.n_received) + " of " +
+            std::to_string(n_chunks) +
+            " chunks are missing; see file_upload_status");
+    return;
+  }
+
+  const uint64_t filesize = session.filesize;
+  const uint64_t session_chunksize = session.chunksize;
+  const std::string merkle_root =
+      parallel_upload_merkle_root(session.chunk_hashes);
+  session.of_stream.close();
+  parallel_upload_sessions.erase(it);
+
+  // For a parallel upload, the metadata's sha256 is the Merkle root, marked
+  // with its chunksize so it can be told apart and recomputed
+  update_file_metadata(filename, filesize, merkle_root, session_chunksize);
+  cache_index_note_write(filename);
+  gguf_index_on_upload_chunk(filename, 0, filesize);
+
+  std::cout << "llama_cpp: " << std::string(__func__) << " - " << filename
+            << ": filesize=" << filesize << "; merkle_root=" << merkle_root
+            << std::endl;
+
+  CandidTypeRecord file_upload_record;
+  file_upload_record.append("filename", CandidTypeText{filename});
+  file_upload_record.append("filesize", CandidTypeNat64{filesize});
+  file_upload_record.append("filesha256", CandidTypeText{merkle_root});
   ic_api.to_wire(CandidTypeVariant{"Ok", CandidTypeRecord{file_upload_record}});
-}
\ No newline at end of file
+}
+
+void file_upload_status() {
+  IC_API ic_api(CanisterQuery{std::string(__func__)}, false);
+  if (!has_admin_query_role(ic_api)) {
+    send_access_denied_api_error(ic_api);
+    return;
+  }
+
+  std::string filename{""};
+  CandidTypeRecord r_in;
+  r_in.append("filename", CandidTypeText{&filename});
+  ic_api.from_wire(r_in);
+
+  auto it = parallel_upload_sessions.find(filename);
+  if (it == parallel_upload_sessions.end()) {
+    send_upload_error_to_wire(ic_api, __func__,
+                              "no parallel upload in progress for " + filename);
+    return;
+  }
+  send_parallel_upload_status_to_wire(ic_api, filename, it->second);
+}
@@ -4,6 +4,7 @@
 
 #include "ic_api.h"
 #include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -12,14 +13,64 @@ void file_upload_chunk()
 void uploaded_file_details()
     WASM_SYMBOL_EXPORTED("canister_query uploaded_file_details");
 
+// Parallel upload: chunks of a fixed chunksize, sent concurrently and in any
+// order. The received chunks are tracked in a bitmap, and integrity is a
+// Merkle tree over the chunks, with domain separation: a leaf is
+// SHA-256(0x00 || chunk), a parent SHA-256(0x01 || left || right), and an odd
+// last node is carried up unchanged. Its root is the file's sha256 in the
+// metadata, marked by its merkle_chunksize.
+// The session (bitmap & leaf hashes) is in-memory only, not persisted: an
+// upgrade loses it, with the chunks received so far, and the upload must
+// start over with file_upload_begin.
+void file_upload_begin()
+    WASM_SYMBOL_EXPORTED("canister_update file_upload_begin");
+void file_upload_chunk_at()
+    WASM_SYMBOL_EXPORTED("canister_update file_upload_chunk_at");
+void file_upload_finish()
+    WASM_SYMBOL_EXPORTED("canister_update file_upload_finish");
+void file_upload_status()
+    WASM_SYMBOL_EXPORTED("canister_query file_upload_status");
+
 void file_upload_chunk_(IC_API &ic_api, const std::string &filename,
                         const std::vector<uint8_t> &v,
                         const uint64_t &chunksize, const uint64_t &offset);
 void uploaded_file_details_(IC_API &ic_api, const std::string &filename);
 
+// Close the file an in-flight upload keeps open (and abandon a parallel
+// upload of it). Must be called before the file is removed or replaced by
+// other means than file_upload_chunk.
+void file_upload_close(const std::string &filename);
+
+// Metadata of a file uploaded with file_upload_chunk (filename, filesize,
+// sha256), to be used for validation
+struct FileMetadata {
+  std::string filename;
+  uint64_t filesize;
+  std::string sha256;
+  // 0: sha256 is the SHA-256 of the file. Else, it is the Merkle root of a
+  // parallel upload with this chunksize.
+  uint64_t merkle_chunksize = 0;
+};
+
+// Add or update the metadata of a file written by other means than an upload
+// (e.g. requantize). A merkle_chunksize > 0 marks sha256 as the Merkle root of
+// a parallel upload with that chunksize.
+void update_file_metadata(const std::string &filename, uint64_t filesize,
+                          const std::string &sha256,
+                          uint64_t merkle_chunksize = 0);
+
+// Reads the store (snapshot + log) into the heap. Called from canister_init &
+// canister_post_upgrade: a query cannot keep what it loads, so loading lazily
+// would re-parse the store in every query until an update did it.
+void load_file_metadata_store();
+
+// Served from a resident store, persisted as a snapshot plus an append-only
+// log (see upload.cpp): O(1) per uploaded chunk.
+std::optional<FileMetadata> get_file_metadata(const std::string &filename);
+
 // Remove a metadata record by filename. Returns true if a matching record
-// was found and removed from the in-memory vector, false otherwise. The
-// underlying save_file_metadata() is best-effort; on save failure this still
-// returns true (the record IS removed in memory). Callers that need a
-// stronger durability signal should swap to a richer return type.
+// was found and removed from the resident store, false otherwise. Persisting
+// the removal (a log append) is best-effort; on failure this still returns
+// true (the record IS removed in memory). Callers that need a stronger
+// durability signal should swap to a richer return type.
 bool delete_file_metadata(const std::string &filename);
@@ -11,6 +11,12 @@ const uint64_t MAX_CHUNK_SIZE = 2 * 1024 * 1024; // ICP message size limit
 const uint64_t MAX_FILENAME_SIZE = 4096;         // Linux PATH_MAX
 const uint64_t MAX_SHA256_SIZE = 64;             // SHA256 hex string length
 
+// The largest uncompressed chunk of the LZ4 prompt-cache transfer. LZ4's worst
+// case for incompressible data is n + n/255 + 16 bytes, and the rest of the
+// Candid reply (sha256, sizes, type table) must fit next to it, within 1 KiB.
+const uint64_t MAX_LZ4_CHUNK_SIZE =
+    (MAX_CHUNK_SIZE - 16 - 1024) * 255 / 256; // 2_087_924 bytes
+
 bool open_ifstream(const std::string &f_name,
                    const std::ios_base::openmode &mode,
                    std::ifstream &if_stream, std::string &msg);
@@ -36,6 +36,18 @@ _TOKEN_ACCOUNTING_FIELDS = (
     "n_prompt_tokens",
 )
 
+# The per-phase instruction counts added to the same record later. Also
+# `opt nat64`, and they differ on every call, so they are stripped alike.
+_PHASE_INSTRUCTION_FIELDS = (
+    "instructions_arg_parse",
+    "instructions_session_load",
+    "instructions_tokenization",
+    "instructions_prefill",
+    "instructions_generation",
+    "instructions_sampling",
+    "instructions_session_save",
+)
+
 
 def norm(candid_text: str) -> str:
     """Normalize pretty-printed Candid so dfx-style and icp-style output compare equal.
@@ -53,7 +65,7 @@ def norm(candid_text: str) -> str:
 
 
 def strip_token_accounting(candid_text: str) -> str:
-    """Remove the 5 v0.15.0 `opt nat64` token-accounting fields from a Candid value.
+    """Remove the `opt nat64` token-accounting and phase-instruction fields from a Candid value.
 
     Order-agnostic: matches each field by name wherever it appears in the record,
     so exact-match assertions written before v0.15.0 keep working regardless of
@@ -61,7 +73,7 @@ def strip_token_accounting(candid_text: str) -> str:
     not carry the fields (e.g. new_chat / load_model records).
     """
     s = norm(candid_text)
-    for name in _TOKEN_ACCOUNTING_FIELDS:  # longer names first: no prefix clashes
+    for name in _TOKEN_ACCOUNTING_FIELDS + _PHASE_INSTRUCTION_FIELDS:  # longer names first: no prefix clashes
         s = re.sub(rf";?\s*{name}\s*=\s*opt \([\d_]+ : nat64\)", "", s)
     s = re.sub(r"record \{\s*;\s*", "record { ", s)  # leading field removed
     return norm(s)  # re-normalize spacing / trailing `;`
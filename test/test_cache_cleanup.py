@@ -60,7 +60,7 @@ def _call(method: str, argument: str, network: str) -> str:
 
 def _extract_field(response: str, name: str) -> int:
     """Pull a `<name> = <int> : nat64` field out of a candid response."""
-    match = re.search(rf"{name}\s*=\s*([0-9_]+)\s*:\s*nat64", response)
+    match = re.search(rf"\b{name}\s*=\s*([0-9_]+)\s*:\s*nat64", response)
     if not match:
         raise AssertionError(f"field {name!r} not found in response: {response}")
     return int(match.group(1).replace("_", ""))
@@ -68,7 +68,7 @@ def _extract_field(response: str, name: str) -> int:
 
 def _extract_bool(response: str, name: str) -> bool:
     """Pull a `<name> = <bool>` field out of a candid response."""
-    match = re.search(rf"{name}\s*=\s*(true|false)\b", response)
+    match = re.search(rf"\b{name}\s*=\s*(true|false)\b", response)
     if not match:
         raise AssertionError(f"field {name!r} not found in response: {response}")
     return match.group(1) == "true"
@@ -135,7 +135,7 @@ def _restore_defaults(network: str) -> None:
 def test__cache_cleanup_admin_endpoints_require_auth(
     identity_anonymous: Dict[str, str], network: str
 ) -> None:
-    """All five endpoints (including the query) reject anonymous callers."""
+    """All six endpoints (including the query) reject anonymous callers."""
     assert identity_anonymous["principal"] == "2vxsx-fae"
 
     expected = '(variant { Err = variant { Other = "Access Denied" } })'
@@ -149,6 +149,10 @@ def test__cache_cleanup_admin_endpoints_require_auth(
             "set_cache_cleanup_config",
             "(record { period_seconds = null; ttl_seconds = null; max_files_per_run = null })",
         ),
+        (
+            "set_cache_quota_config",
+            "(record { max_bytes_total = null; max_bytes_per_principal = null })",
+        ),
     ]:
         response = _call(method, arg, network)
         assert response == norm(expected), f"{method}: got {response!r}"
@@ -571,3 +575,109 @@ def test__cache_cleanup_now_respects_cap(network: str, principal: str) -> None:
             )
     finally:
         _restore_defaults(network)
+
+
+# ---------- ticks resume from the cursor -----------------------------------
+
+
+def _get_cursor(network: str) -> str:
+    response = _call("get_cache_cleanup_stats", "()", network)
+    match = re.search(r'\bcursor\s*=\s*"([^"]*)"', response)
+    if not match:
+        raise AssertionError(f"field 'cursor' not found in response: {response}")
+    return match.group(1)
+
+
+def test__cache_cleanup_resumes_from_cursor(network: str, principal: str) -> None:
+    """With cap=1 consecutive ticks examine different files, and with the
+    ceiling cap one tick completes a full sweep."""
+    filenames = [f"cleanup_test_cursor_{i}.cache" for i in range(2)]
+    for fname in filenames:
+        upload_resp = _call(
+            "upload_prompt_cache_chunk",
+            f'(record {{ promptcache = "{fname}"; chunk = blob "\\01\\02"; chunksize = 2 : nat64; offset = 0 : nat64 }})',
+            network,
+        )
+        assert "Ok" in upload_resp, upload_resp
+
+    _set_config(network, max_files_per_run=1)
+    try:
+        _call("cache_cleanup_now", "()", network)
+        first = _get_cursor(network)
+        _call("cache_cleanup_now", "()", network)
+        second = _get_cursor(network)
+        assert first != second, f"cursor did not move: {first!r}"
+
+        _set_config(network, max_files_per_run=MAX_FILES_CEILING)
+        sweeps_before = _extract_field(
+            _call("get_cache_cleanup_stats", "()", network), "sweeps_completed"
+        )
+        _call("cache_cleanup_now", "()", network)
+        response = _call("get_cache_cleanup_stats", "()", network)
+        assert _extract_field(response, "sweeps_completed") == sweeps_before + 1
+        assert _extract_field(response, "last_sweep_files_examined") >= 2
+    finally:
+        _set_config(network, ttl_seconds=0, max_files_per_run=MAX_FILES_CEILING)
+        _call("cache_cleanup_now", "()", network)
+        _restore_defaults(network)
+
+
+# ---------- byte quotas evict the least recently used caches ---------------
+
+
+def _set_quota(
+    network: str,
+    max_bytes_total: Optional[int] = None,
+    max_bytes_per_principal: Optional[int] = None,
+) -> str:
+    def _opt(v: Optional[int]) -> str:
+        return f"opt ({v} : nat64)" if v is not None else "null"
+
+    arg = (
+        "(record { "
+        f"max_bytes_total = {_opt(max_bytes_total)}; "
+        f"max_bytes_per_principal = {_opt(max_bytes_per_principal)} "
+        "})"
+    )
+    return _call("set_cache_quota_config", arg, network)
+
+
+def test__cache_quota_evicts_least_recently_used(
+    network: str, principal: str
+) -> None:
+    """Three 4-byte caches under a 6-byte per-principal quota: the tick keeps
+    only the one written last."""
+    # Leave the other prompt caches of this principal out of it
+    _set_config(network, ttl_seconds=0, max_files_per_run=MAX_FILES_CEILING)
+    _call("cache_cleanup_now", "()", network)
+    _restore_defaults(network)
+
+    filenames = [f"cleanup_test_quota_{i}.cache" for i in range(3)]
+    for fname in filenames:
+        upload_resp = _call(
+            "upload_prompt_cache_chunk",
+            f'(record {{ promptcache = "{fname}"; chunk = blob "\\01\\02\\03\\04"; chunksize = 4 : nat64; offset = 0 : nat64 }})',
+            network,
+        )
+        assert "Ok" in upload_resp, upload_resp
+
+    response = _set_quota(network, max_bytes_per_principal=6)
+    assert _extract_field(response, "max_bytes_per_principal") == 6, response
+    try:
+        _call("cache_cleanup_now", "()", network)
+        response = _call("get_cache_cleanup_stats", "()", network)
+        assert _extract_field(response, "files_evicted") == 2, response
+        assert _extract_field(response, "bytes_evicted") == 8, response
+
+        for fname, kept in zip(filenames, [False, False, True]):
+            details = _call(
+                "uploaded_prompt_cache_details",
+                f'(record {{ promptcache = "{fname}" }})',
+                network,
+            )
+            assert ("Ok" in details) == kept, f"{fname}: {details}"
+    finally:
+        _set_quota(network, max_bytes_total=0, max_bytes_per_principal=0)
+        _set_config(network, ttl_seconds=0)
+        _call("cache_cleanup_now", "()", network)
+        _restore_defaults(network)
@@ -81,6 +81,16 @@ def test__get_memory_status(network: str) -> None:
     assert wasm_heap_bytes % 65536 == 0, response
     assert stable_bytes % 65536 == 0, response
 
+    # The model/context breakdown is opt: null before load_model, a value after.
+    for field in (
+        "model_bytes",
+        "kv_cache_bytes",
+        "compute_buffer_bytes",
+        "compute_buffer_bytes_at_load",
+        "compute_buffer_reallocs",
+    ):
+        assert re.search(rf"{field}\s*=\s*(null|opt)", response), response
+
 
 def test__health(network: str) -> None:
     response = call_canister_api(
@@ -249,6 +259,202 @@ def test__set_max_tokens_anonymous(identity_anonymous: Dict[str, str], network:
     assert response == norm(expected_response)
 
 
+def test__set_allowed_tokens_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test set_allowed_tokens rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="set_allowed_tokens",
+        canister_argument='(record { token_ids = vec { 1 : nat64 } })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__get_allowed_tokens_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test get_allowed_tokens rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_allowed_tokens",
+        canister_argument="()",
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__set_allowed_tokens_roundtrip(network: str) -> None:
+    """Test set_allowed_tokens / get_allowed_tokens, then clear the restriction"""
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="set_allowed_tokens",
+        canister_argument='(record { token_ids = vec { 7 : nat64; 42 : nat64 } })',
+        network=network,
+    )
+    assert response == norm('(variant { Ok = record { status_code = 200 : nat16;} })')
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_allowed_tokens",
+        canister_argument="()",
+        network=network,
+    )
+    assert "(variant { Ok" in response, response
+    assert re.search(r"7\s*:\s*nat64", response), response
+    assert re.search(r"42\s*:\s*nat64", response), response
+
+    # Clear it again, so later tests generate unrestricted.
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="set_allowed_tokens",
+        canister_argument="(record { token_ids = vec {} })",
+        network=network,
+    )
+    assert response == norm('(variant { Ok = record { status_code = 200 : nat16;} })')
+
+
+def test__load_model_begin_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test load_model_begin rejects anonymous caller (OutputRecordResult format)"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="load_model_begin",
+        canister_argument='(record { args = vec { "--help" } })',
+        network=network,
+    )
+    assert 'Err' in response
+    assert 'status_code = 401' in response or 'Access Denied' in response
+
+
+def test__load_model_step_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test load_model_step rejects anonymous caller (OutputRecordResult format)"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="load_model_step",
+        canister_argument="()",
+        network=network,
+    )
+    assert 'Err' in response
+    assert 'status_code = 401' in response or 'Access Denied' in response
+
+
+def test__reload_model_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test reload_model rejects anonymous caller (OutputRecordResult format)"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="reload_model",
+        canister_argument="()",
+        network=network,
+    )
+    assert 'Err' in response
+    assert 'status_code = 401' in response or 'Access Denied' in response
+
+
+def test__set_model_registry_config_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test set_model_registry_config rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="set_model_registry_config",
+        canister_argument="(record { max_models = 2 : nat64; heap_budget_bytes = 0 : nat64 })",
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__get_resident_models_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test get_resident_models rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_resident_models",
+        canister_argument="()",
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__load_lora_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test load_lora rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="load_lora",
+        canister_argument='(record { name = "lora"; path = "models/lora.gguf" })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__select_lora_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test select_lora rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="select_lora",
+        canister_argument='(record { name = "lora"; scale = 1.0 : float32 })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__requantize_start_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test requantize_start rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="requantize_start",
+        canister_argument='(record { input = "a.gguf"; output = "b.gguf"; qtype = "q4_0"; slice_instructions = null })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__requantize_start_unknown_qtype(network: str) -> None:
+    """Test requantize_start rejects a format without a wasm SIMD kernel"""
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="requantize_start",
+        canister_argument='(record { input = "a.gguf"; output = "b.gguf"; qtype = "iq2_xxs"; slice_instructions = null })',
+        network=network,
+    )
+    assert 'Err' in response
+    assert 'qtype must be one of' in response
+
+
 def test__load_model_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
     """Test load_model rejects anonymous caller (OutputRecordResult format)"""
     assert identity_anonymous["identity"] == "anonymous"
@@ -405,6 +611,21 @@ def test__get_chats_anonymous(identity_anonymous: Dict[str, str], network: str)
     assert response == norm(expected_response)
 
 
+def test__get_chats_page_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test get_chats_page rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_chats_page",
+        canister_argument='(record { offset = 0 : nat64; limit = 0 : nat64; since = "" })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
 def test__chats_resume_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
     """Test chats_resume rejects anonymous caller"""
     assert identity_anonymous["identity"] == "anonymous"
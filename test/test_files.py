@@ -51,6 +51,171 @@ def test__upload_prompt_cache_file(network: str, principal: str) -> None:
     expected_response = f'(variant {{ Ok = record {{ filename = ".canister_cache/{principal}/sessions/another_prompt.cache"; filesize = 5 : nat64; filesha256 = "fd789322b6e4d1a517f1b75768f0f9ebc5747076811ee04e8a5f0731320f4884";}} }})'
     assert response == norm(expected_response)
 
+
+def test__prompt_cache_lz4_roundtrip(network: str, principal: str) -> None:
+    # Re-upload prompt.cache as one LZ4 block (token 0x50: 5 literals), then download it compressed
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="upload_prompt_cache_chunk_lz4",
+        canister_argument='(record { promptcache = "prompt.cache"; chunk = blob "\\50\\47\\47\\55\\46\\03"; chunksize = 5 : nat64; upload_chunksize = 1024 : nat64; offset = 0 : nat64; sha256 = "fe3b34fd092c3e2c6da3270eb91c4d3e9c2c6f891c21b6ed7358bf5ecca2d207" })',
+        network=network,
+    )
+    expected_response = f'(variant {{ Ok = record {{ filename = ".canister_cache/{principal}/sessions/prompt.cache"; filesize = 5 : nat64; filesha256 = "fe3b34fd092c3e2c6da3270eb91c4d3e9c2c6f891c21b6ed7358bf5ecca2d207";}} }})'
+    assert response == norm(expected_response)
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="download_prompt_cache_chunk_lz4",
+        canister_argument='(record { promptcache = "prompt.cache"; chunksize = 1024 : nat64; offset = 0 : nat64 })',
+        network=network,
+    )
+    assert response.startswith('(variant { Ok = record {')
+    assert 'chunksize = 5' in response
+    assert 'sha256 = "fe3b34fd092c3e2c6da3270eb91c4d3e9c2c6f891c21b6ed7358bf5ecca2d207"' in response
+    assert 'done = true' in response
+
+
+def test__upload_prompt_cache_chunk_lz4_sha256_mismatch(network: str, principal: str) -> None:
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="upload_prompt_cache_chunk_lz4",
+        canister_argument='(record { promptcache = "prompt.cache"; chunk = blob "\\50\\47\\47\\55\\46\\03"; chunksize = 5 : nat64; upload_chunksize = 1024 : nat64; offset = 0 : nat64; sha256 = "0000" })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "upload_prompt_cache_chunk_lz4: sha256 of the decompressed chunk does not match" } })'
+    assert response == norm(expected_response)
+
+
+def test__upload_prompt_cache_chunk_lz4_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="upload_prompt_cache_chunk_lz4",
+        canister_argument='(record { promptcache = "prompt.cache"; chunk = blob "\\50\\47\\47\\55\\46\\03"; chunksize = 5 : nat64; upload_chunksize = 1024 : nat64; offset = 0 : nat64; sha256 = "" })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__download_prompt_cache_chunk_lz4_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="download_prompt_cache_chunk_lz4",
+        canister_argument='(record { promptcache = "prompt.cache"; chunksize = 1024 : nat64; offset = 0 : nat64 })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+def test__prompt_cache_block_hashes(network: str, principal: str) -> None:
+    # prompt.cache is 5 bytes: one block
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="prompt_cache_block_hashes",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 1024 : nat64; first_block = 0 : nat64 })',
+        network=network,
+    )
+    expected_response = '(variant { Ok = record { filesize = 5 : nat64; block_size = 1_024 : nat64; first_block = 0 : nat64; hashes = vec { "fe3b34fd092c3e2c6da3270eb91c4d3e9c2c6f891c21b6ed7358bf5ecca2d207" }; next_block = 1 : nat64; done = true } })'
+    assert response == norm(expected_response)
+
+
+def test__download_prompt_cache_blocks(network: str, principal: str) -> None:
+    # Up to date: nothing to download
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="download_prompt_cache_blocks",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 1024 : nat64; first_block = 0 : nat64; hashes = vec { "fe3b34fd092c3e2c6da3270eb91c4d3e9c2c6f891c21b6ed7358bf5ecca2d207" } })',
+        network=network,
+    )
+    assert 'indices = vec {}' in response
+    assert 'done = true' in response
+
+    # The client has nothing: the block is returned
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="download_prompt_cache_blocks",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 1024 : nat64; first_block = 0 : nat64; hashes = vec {} })',
+        network=network,
+    )
+    assert 'indices = vec { 0 : nat64 }' in response
+
+
+def test__download_prompt_cache_blocks_tail(network: str, principal: str) -> None:
+    # prompt.cache is "PGGUF": with block_size 2, the blocks are "PG", "GU" and "F"
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="prompt_cache_block_hashes",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 2 : nat64; first_block = 1 : nat64 })',
+        network=network,
+    )
+    expected_response = '(variant { Ok = record { filesize = 5 : nat64; block_size = 2 : nat64; first_block = 1 : nat64; hashes = vec { "86856a090297ec6f5f6a6eb3b7b7837f79cd941ea499c5a8b4c0bc9bced1b1ca"; "f67ab10ad4e4c53121b6a5fe4da9c10ddee905b978d3788d2723d7bfacbe28a9" }; next_block = 3 : nat64; done = true } })'
+    assert response == norm(expected_response)
+
+    # Only the tail differs: only the last block is returned
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="download_prompt_cache_blocks",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 2 : nat64; first_block = 0 : nat64; hashes = vec { "91f026c996feb33556b5d418d17e015945f305c96666b62e5c6284cc1df22a09"; "86856a090297ec6f5f6a6eb3b7b7837f79cd941ea499c5a8b4c0bc9bced1b1ca"; "0000" } })',
+        network=network,
+    )
+    assert 'indices = vec { 2 : nat64 }' in response
+    assert 'data = blob "F"' in response
+    assert 'next_block = 3 : nat64' in response
+    assert 'done = true' in response
+
+    # A page starting at the changed block needs only the hashes from there on
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="download_prompt_cache_blocks",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 2 : nat64; first_block = 2 : nat64; hashes = vec {} })',
+        network=network,
+    )
+    assert 'indices = vec { 2 : nat64 }' in response
+    assert 'done = true' in response
+
+
+def test__prompt_cache_block_hashes_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="prompt_cache_block_hashes",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 1024 : nat64; first_block = 0 : nat64 })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__download_prompt_cache_blocks_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="download_prompt_cache_blocks",
+        canister_argument='(record { promptcache = "prompt.cache"; block_size = 1024 : nat64; first_block = 0 : nat64; hashes = vec {} })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
 # ------------------------------------------------------------------
 def test__recursive_dir_content_non_existing(network: str, principal: str) -> None:
     response = call_canister_api(
@@ -147,6 +312,47 @@ def test__recursive_dir_content_controller(network: str, principal: str) -> None
     expected_response = f'(variant {{ Ok = vec {{ record {{ filename = ".canister_cache/{principal}"; filetype = "directory";}}; record {{ filename = ".canister_cache/{principal}/sessions"; filetype = "directory";}}; record {{ filename = ".canister_cache/{principal}/sessions/prompt.cache"; filetype = "file";}}; record {{ filename = ".canister_cache/{principal}/sessions/another_prompt.cache"; filetype = "file";}};}} }})'
     assert response == norm(expected_response)
 
+def test__recursive_dir_content_page_controller(network: str, principal: str) -> None:
+    # Page 1: the principal & sessions directories
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="recursive_dir_content_page_query",
+        canister_argument=f'(record {{dir = ".canister_cache"; cursor = ""; prefix = ".canister_cache/{principal}"; max_entries = 2 : nat64}})',
+        network=network,
+    )
+    assert f'filename = ".canister_cache/{principal}"' in response
+    assert f'filename = ".canister_cache/{principal}/sessions"' in response
+    assert f'next_cursor = ".canister_cache/{principal}/sessions"' in response
+    assert 'done = false' in response
+
+    # Page 2: the prompt caches, in name order, with their size
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="recursive_dir_content_page_query",
+        canister_argument=f'(record {{dir = ".canister_cache"; cursor = ".canister_cache/{principal}/sessions"; prefix = ".canister_cache/{principal}"; max_entries = 2 : nat64}})',
+        network=network,
+    )
+    assert response.index("another_prompt.cache") < response.index("/prompt.cache")
+    assert 'size = 5 : nat64' in response
+    assert 'next_cursor = ""' in response
+    assert 'done = true' in response
+
+
+def test__recursive_dir_content_page_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="recursive_dir_content_page_query",
+        canister_argument='(record {dir = ".canister_cache"; cursor = ""; prefix = ""; max_entries = 0 : nat64})',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
 # ------------------------------------------------------------------
 def test__filesystem_file_size_non_existing(network: str, principal: str) -> None:
     response = call_canister_api(
@@ -356,6 +562,51 @@ def test__file_download_chunk_anonymous(identity_anonymous: Dict[str, str], netw
     assert response == norm(expected_response)
 
 
+def test__file_download_chunks_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test that file_download_chunks rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+    assert identity_anonymous["principal"] == "2vxsx-fae"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_download_chunks",
+        canister_argument='(record { filenames = vec { "test.bin" }; offsets = vec { 0 : nat64 }; max_bytes = 0 : nat64 })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__file_download_chunks_two_segments(network: str, principal: str) -> None:
+    """Test that two segments of one file are packed into one reply"""
+    filename = f".canister_cache/{principal}/sessions/another_prompt.cache"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_download_chunks",
+        canister_argument=f'(record {{ filenames = vec {{ "{filename}"; "{filename}" }}; offsets = vec {{ 0 : nat64; 3 : nat64 }}; max_bytes = 0 : nat64 }})',
+        network=network,
+    )
+    assert response.startswith('(variant { Ok = record {')
+    assert 'length = 5' in response
+    assert 'length = 2' in response
+
+
+def test__file_download_chunks_length_mismatch(network: str, principal: str) -> None:
+    """Test that file_download_chunks rejects filenames & offsets of different length"""
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_download_chunks",
+        canister_argument='(record { filenames = vec { "test.bin" }; offsets = vec {}; max_bytes = 0 : nat64 })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "file_download_chunks: filenames and offsets must have the same length" } })'
+    assert response == norm(expected_response)
+
+
 # ------------------------------------------------------------------
 # uploaded_file_details tests
 def test__uploaded_file_details_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
@@ -436,3 +687,147 @@ def test__file_upload_chunk_cleanup(network: str, principal: str) -> None:
     )
     # Accept either removed or not found
     assert 'Ok' in response or 'does not exist' in response
+
+
+def test__file_upload_begin_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test that file_upload_begin rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_begin",
+        canister_argument='(record { filename = "test.bin"; filesize = 5 : nat64; chunksize = 3 : nat64 })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
+
+
+def test__file_upload_parallel_out_of_order(network: str, principal: str) -> None:
+    """Test that chunks sent out of order are assembled and verified by a Merkle root"""
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_begin",
+        canister_argument='(record { filename = "models/test_parallel.bin"; filesize = 5 : nat64; chunksize = 3 : nat64 })',
+        network=network,
+    )
+    assert response.startswith('(variant { Ok = record {')
+    assert 'total_chunks = 2' in response
+
+    # the last chunk first
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_chunk_at",
+        canister_argument='(record { filename = "models/test_parallel.bin"; chunk = blob "\\04\\05"; index = 1 : nat64 })',
+        network=network,
+    )
+    assert 'received_chunks = 1' in response
+
+    # finishing with a chunk missing is an error
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_finish",
+        canister_argument='(record { filename = "models/test_parallel.bin" })',
+        network=network,
+    )
+    assert 'Err' in response
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_chunk_at",
+        canister_argument='(record { filename = "models/test_parallel.bin"; chunk = blob "\\01\\02\\03"; index = 0 : nat64 })',
+        network=network,
+    )
+    assert 'received_chunks = 2' in response
+
+    # sha256(01 || sha256(00 || 01 02 03) || sha256(00 || 04 05))
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_finish",
+        canister_argument='(record { filename = "models/test_parallel.bin" })',
+        network=network,
+    )
+    assert 'filesize = 5' in response
+    assert 'filesha256 = "45f9ede1abee6857a9165ab3317dd379771137b14c3ee43ccffb44b767d1082f"' in response
+
+    # the details tell the Merkle root apart, with the chunksize to recompute it
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="uploaded_file_details",
+        canister_argument='(record { filename = "models/test_parallel.bin" })',
+        network=network,
+    )
+    assert 'merkle_chunksize = opt (3 : nat64)' in response
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="filesystem_remove",
+        canister_argument='(record { filename = "models/test_parallel.bin" })',
+        network=network,
+    )
+    assert 'Ok' in response or 'does not exist' in response
+
+
+def test__file_upload_parallel_limits(network: str, principal: str) -> None:
+    """Test that file_upload_begin caps the chunk count, and that an empty file's root is the leaf of one empty chunk"""
+    # 2 GiB in 1-byte chunks would need gigabytes of heap for the session
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_begin",
+        canister_argument='(record { filename = "models/test_parallel.bin"; filesize = 2_147_483_648 : nat64; chunksize = 1 : nat64 })',
+        network=network,
+    )
+    assert 'Err' in response
+    assert 'chunks; use a chunksize of at least 32768' in response
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_begin",
+        canister_argument='(record { filename = "models/test_parallel.bin"; filesize = 0 : nat64; chunksize = 3 : nat64 })',
+        network=network,
+    )
+    assert 'total_chunks = 0' in response
+
+    # sha256(00): the leaf of one empty chunk
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_finish",
+        canister_argument='(record { filename = "models/test_parallel.bin" })',
+        network=network,
+    )
+    assert 'filesha256 = "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d"' in response
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="filesystem_remove",
+        canister_argument='(record { filename = "models/test_parallel.bin" })',
+        network=network,
+    )
+    assert 'Ok' in response or 'does not exist' in response
+
+
+def test__uploaded_file_tensor_index_anonymous(identity_anonymous: Dict[str, str], network: str) -> None:
+    """Test that uploaded_file_tensor_index rejects anonymous caller"""
+    assert identity_anonymous["identity"] == "anonymous"
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="uploaded_file_tensor_index",
+        canister_argument='(record { filename = "models/model.gguf" })',
+        network=network,
+    )
+    expected_response = '(variant { Err = variant { Other = "Access Denied" } })'
+    assert response == norm(expected_response)
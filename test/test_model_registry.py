@@ -0,0 +1,128 @@
+"""Test multiple resident models: hot-swap, LRU eviction, the heap budget.
+
+First deploy the canister:
+$ icpp build-wasm
+$ icp deploy -e local -y
+
+Then upload the same model under three canister filenames, so there are three
+distinct resident models:
+$ for m in tiny tiny2 tiny3; do python -m scripts.upload --network local --canister llama_cpp --canister-filename models/$m.gguf --filetype gguf models/stories260Ktok512.gguf; done
+
+Then run the tests:
+$ pytest -vv --network local --identity "$(icp identity default)" test/test_model_registry.py
+
+The tests run in order, and leave the canister with one resident model.
+"""
+
+# pylint: disable=missing-function-docstring, line-too-long
+
+import re
+from pathlib import Path
+
+from .candid_compat import call_canister_api
+
+ICP_YAML_PATH = Path(__file__).parent / "../icp.yaml"
+CANISTER_NAME = "llama_cpp"
+
+MODEL_1 = "models/tiny.gguf"
+MODEL_2 = "models/tiny2.gguf"
+MODEL_3 = "models/tiny3.gguf"
+
+
+def _call(network: str, method: str, arg: str) -> str:
+    return call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method=method,
+        canister_argument=arg,
+        network=network,
+    )
+
+
+def _config(network: str, max_models: int, heap_budget_bytes: int) -> None:
+    response = _call(
+        network,
+        "set_model_registry_config",
+        f"(record {{ max_models = {max_models} : nat64; heap_budget_bytes = {heap_budget_bytes} : nat64 }})",
+    )
+    assert "status_code = 200" in response, response
+
+
+def _load(network: str, model: str) -> None:
+    response = _call(network, "load_model", f'(record {{ args = vec {{"--model"; "{model}";}} }})')
+    assert "Model succesfully loaded into memory." in response, response
+
+
+def _run(network: str, model: str, extra: str = "") -> str:
+    return _call(
+        network,
+        "run_update",
+        f'(record {{ args = vec {{"--model"; "{model}"; "--prompt"; "Joe loves"; "--n-predict"; "4"; "--temp"; "0.0"{extra}}} }})',
+    )
+
+
+def _resident(network: str) -> tuple[list[str], str]:
+    """The resident model paths, and the active one."""
+    response = _call(network, "get_resident_models", "()")
+    paths = re.search(r"path = vec \{([^}]*)\}", response)
+    active = re.search(r'active_model = "([^"]*)"', response)
+    assert paths and active, response
+    return re.findall(r'"([^"]*)"', paths.group(1)), active.group(1)
+
+
+def test__two_resident_models(network: str) -> None:
+    _config(network, max_models=2, heap_budget_bytes=0)
+    _load(network, MODEL_1)
+    _load(network, MODEL_2)
+    paths, active = _resident(network)
+    assert sorted(paths) == [MODEL_1, MODEL_2]
+    assert active == MODEL_2
+
+
+def test__hot_swap(network: str) -> None:
+    response = _run(network, MODEL_1)
+    assert "status_code = 200" in response, response
+    paths, active = _resident(network)
+    assert sorted(paths) == [MODEL_1, MODEL_2]
+    assert active == MODEL_1
+
+
+def test__context_args_differ(network: str) -> None:
+    response = _run(network, MODEL_1, '; "-c"; "64"')
+    assert "Err" in response, response
+    assert "other context args (-c)" in response, response
+
+
+def test__lru_eviction(network: str) -> None:
+    # MODEL_2 is the least recently used: MODEL_1 ran after it was loaded
+    response = _run(network, MODEL_3)
+    assert "status_code = 200" in response, response
+    paths, active = _resident(network)
+    assert sorted(paths) == [MODEL_1, MODEL_3]
+    assert active == MODEL_3
+
+
+def test__heap_budget_eviction(network: str) -> None:
+    # A budget of 1 byte fits no other model: loading one evicts all the others
+    _config(network, max_models=2, heap_budget_bytes=1)
+    _load(network, MODEL_1)
+    paths, active = _resident(network)
+    assert paths == [MODEL_1]
+    assert active == MODEL_1
+
+
+def test__phased_load_of_another_model_survives(network: str) -> None:
+    response = _call(network, "load_model_begin", f'(record {{ args = vec {{"--model"; "{MODEL_2}";}} }})')
+    assert "step 0/2" in response, response
+    # A load_model of another model leaves the phased load alone
+    _load(network, MODEL_1)
+    response = _call(network, "load_model_step", "()")
+    assert "step 1/2" in response, response
+    # A load_model of the same model discards it
+    _load(network, MODEL_2)
+    response = _call(network, "load_model_step", "()")
+    assert "No model load in progress" in response, response
+
+
+def test__reset_config(network: str) -> None:
+    _config(network, max_models=1, heap_budget_bytes=0)
@@ -122,7 +122,7 @@ def test__upload_prompt_cache_chunk_2(network: str, principal: str) -> None:
         canister_argument='(record { promptcache = "prompt.cache"; chunk = blob "\\03\\46\\55\\47\\47"; chunksize = 5 : nat64; offset = 10 : nat64; })',
         network=network,
     )
-    expected_response = f'(variant {{ Ok = record {{ filename = ".canister_cache/{principal}/sessions/prompt.cache"; filesize = 15 : nat64; filesha256 = "f042bddd385f498e5888d99d83b4e86cde25589356b4a9c89e705413a7b2dc57";}} }})'
+    expected_response = f'(variant {{ Ok = record {{ merkle_chunksize = null; filename = ".canister_cache/{principal}/sessions/prompt.cache"; filesize = 15 : nat64; filesha256 = "f042bddd385f498e5888d99d83b4e86cde25589356b4a9c89e705413a7b2dc57";}} }})'
     assert response == norm(expected_response)
 
 # Continue the other upload to test concurrent uploads
@@ -145,7 +145,7 @@ def test__uploaded_prompt_cache_details(network: str, principal: str) -> None:
         canister_argument='(record { promptcache = "prompt.cache"; })',
         network=network,
     )
-    expected_response = f'(variant {{ Ok = record {{ filename = ".canister_cache/{principal}/sessions/prompt.cache"; filesize = 15 : nat64; filesha256 = "f042bddd385f498e5888d99d83b4e86cde25589356b4a9c89e705413a7b2dc57";}} }})'
+    expected_response = f'(variant {{ Ok = record {{ merkle_chunksize = null; filename = ".canister_cache/{principal}/sessions/prompt.cache"; filesize = 15 : nat64; filesha256 = "f042bddd385f498e5888d99d83b4e86cde25589356b4a9c89e705413a7b2dc57";}} }})'
     assert response == norm(expected_response)
 
 def test__download_prompt_cache_chunk_0(network: str, principal: str) -> None:
@@ -234,6 +234,28 @@ def test__get_chats_1(network: str) -> None:
     )
     assert 'Ok' in response
 
+def test__get_chats_page_1(network: str) -> None:
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_chats_page",
+        canister_argument='(record { offset = 0 : nat64; limit = 1 : nat64; since = "" })',
+        network=network,
+    )
+    assert 'Ok' in response
+    assert 'next_offset = 1 : nat64' in response
+
+    # No chat is that recent
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_chats_page",
+        canister_argument='(record { offset = 0 : nat64; limit = 0 : nat64; since = "9999" })',
+        network=network,
+    )
+    assert 'total = 0 : nat64' in response
+    assert 'done = true' in response
+
 def test__chats_pause(network: str) -> None:
     response = call_canister_api(
         icp_yaml_path=ICP_YAML_PATH,
@@ -265,6 +287,16 @@ def test__new_chat_4(network: str) -> None:
     )
     assert "(variant { Ok" in response
 
+def test__get_chats_page_2(network: str) -> None:
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_chats_page",
+        canister_argument='(record { offset = 0 : nat64; limit = 0 : nat64; since = "" })',
+        network=network,
+    )
+    assert 'Err' in response
+
 def test__get_chats_3(network: str) -> None:
     response = call_canister_api(
         icp_yaml_path=ICP_YAML_PATH,
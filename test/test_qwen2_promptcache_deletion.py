@@ -71,14 +71,14 @@ def _call(method: str, argument: str, network: str) -> str:
 
 
 def _extract_field(response: str, name: str) -> int:
-    match = re.search(rf"{name}\s*=\s*([0-9_]+)\s*:\s*nat64", response)
+    match = re.search(rf"\b{name}\s*=\s*([0-9_]+)\s*:\s*nat64", response)
     if not match:
         raise AssertionError(f"field {name!r} not found in response: {response}")
     return int(match.group(1).replace("_", ""))
 
 
 def _extract_bool(response: str, name: str) -> bool:
-    match = re.search(rf"{name}\s*=\s*(true|false)\b", response)
+    match = re.search(rf"\b{name}\s*=\s*(true|false)\b", response)
     if not match:
         raise AssertionError(f"field {name!r} not found in response: {response}")
     return match.group(1) == "true"
@@ -15,6 +15,9 @@ To run it against a deployment to the IC, just replace `local` with `production`
 """
 # pylint: disable=missing-function-docstring, unused-import, wildcard-import, unused-wildcard-import, line-too-long
 
+import re
+import struct
+import time
 from pathlib import Path
 from typing import Dict
 import pytest
@@ -69,6 +72,34 @@ def test__log_pause(network: str) -> None:
     expected_response = '(variant { Ok = record { status_code = 200 : nat16;} })'
     assert response == norm(expected_response)
 
+def test__load_model_unsupported_cache_type(network: str) -> None:
+    # q4_1 parses, but has no wasm SIMD kernels in the attention path
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="load_model",
+        canister_argument='(record { args = vec {"--model"; "models/tiny.gguf"; "--cache-type-k"; "q4_1";} })',
+        network=network,
+    )
+    if PRINT_RESPONSE:
+        print(f"{current_func_name()}: response: {response}")
+    assert "(variant { Err" in response
+    assert "unsupported KV cache type 'q4_1'" in response
+
+def test__load_model_quantized_v_without_flash_attn(network: str) -> None:
+    # a quantized V cache needs flash attention: an error, not a trap
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="load_model",
+        canister_argument='(record { args = vec {"--model"; "models/tiny.gguf"; "--cache-type-v"; "q8_0"; "--flash-attn"; "off";} })',
+        network=network,
+    )
+    if PRINT_RESPONSE:
+        print(f"{current_func_name()}: response: {response}")
+    assert "(variant { Err" in response
+    assert "requires flash attention" in response
+
 def test__load_model(network: str) -> None:
     response = call_canister_api(
         icp_yaml_path=ICP_YAML_PATH,
@@ -81,6 +112,59 @@ def test__load_model(network: str) -> None:
         print(f"{current_func_name()}: response: {response}")
     assert "(variant { Ok" in response
 
+def _ready(network: str) -> str:
+    return call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="ready",
+        canister_argument="()",
+        network=network,
+    )
+
+def test__load_model_phased(network: str) -> None:
+    # Load the same model again, in phases: begin unloads it, and ready()
+    # reports the progress of each step until finish.
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="load_model_begin",
+        canister_argument='(record { args = vec {"--model"; "models/tiny.gguf";} })',
+        network=network,
+    )
+    if PRINT_RESPONSE:
+        print(f"{current_func_name()}: response: {response}")
+    assert "(variant { Ok" in response
+    assert "step 0/2" in response
+    response = _ready(network)
+    assert "(variant { Err" in response and "step 0/2" in response, response
+
+    for step in ("step 1/2", "step 2/2"):
+        response = call_canister_api(
+            icp_yaml_path=ICP_YAML_PATH,
+            canister_name=CANISTER_NAME,
+            canister_method="load_model_step",
+            canister_argument="()",
+            network=network,
+        )
+        if PRINT_RESPONSE:
+            print(f"{current_func_name()}: response: {response}")
+        assert "(variant { Ok" in response and step in response, response
+        assert "instructions)" in response, response
+        response = _ready(network)
+        assert "(variant { Err" in response and step in response, response
+
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="load_model_finish",
+        canister_argument="()",
+        network=network,
+    )
+    if PRINT_RESPONSE:
+        print(f"{current_func_name()}: response: {response}")
+    assert "(variant { Ok" in response
+    assert _ready(network) == norm('(variant { Ok = record { status_code = 200 : nat16;} })')
+
 def test__uploaded_file_details(network: str) -> None:
     response = call_canister_api(
         icp_yaml_path=ICP_YAML_PATH,
@@ -91,9 +175,23 @@ def test__uploaded_file_details(network: str) -> None:
     )
     if PRINT_RESPONSE:
         print(f"{current_func_name()}: response: {response}")
-    expected_response = '(variant { Ok = record { filename = "models/tiny.gguf"; filesize = 1_185_376 : nat64; filesha256 = "047bf46455a544931cff6fef14d7910154c56afbc23ab1c5e56a72e69912c04b";} })'
+    expected_response = '(variant { Ok = record { merkle_chunksize = null; filename = "models/tiny.gguf"; filesize = 1_185_376 : nat64; filesha256 = "047bf46455a544931cff6fef14d7910154c56afbc23ab1c5e56a72e69912c04b";} })'
     assert response == norm(expected_response)
 
+def test__uploaded_file_tensor_index(network: str) -> None:
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="uploaded_file_tensor_index",
+        canister_argument='(record { filename = "models/tiny.gguf" })',
+        network=network,
+    )
+    if PRINT_RESPONSE:
+        print(f"{current_func_name()}: response: {response}")
+    assert "(variant { Ok" in response
+    assert "complete = true" in response
+    assert 'name = "token_embd.weight"' in response
+
 def test__set_max_tokens(network: str) -> None:
     response = call_canister_api(
         icp_yaml_path=ICP_YAML_PATH,
@@ -265,6 +363,82 @@ def test__run_update_5(network: str) -> None:
     expected_response = '(variant { Ok = record { output = " liked to"; conversation = " Joe loves writing stories. He liked"; error = ""; status_code = 200 : nat16; prompt_remaining = ""; generated_eog = false;} })'
     assert strip_token_accounting(response) == norm(expected_response)
 
+def _opt_nat64(response: str, name: str) -> int:
+    match = re.search(rf"\b{name} = opt \(([\d_]+) : nat64\)", response)
+    assert match, f"{name} missing in: {response}"
+    return int(match.group(1).replace("_", ""))
+
+def test__memory_status_after_run(network: str) -> None:
+    # The runs above prefilled in batches and generated token by token: both
+    # graph shapes were reserved at load, so the compute buffers never grew.
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="get_memory_status",
+        canister_argument="()",
+        network=network,
+    )
+    if PRINT_RESPONSE:
+        print(f"{current_func_name()}: response: {response}")
+    at_load = _opt_nat64(response, "compute_buffer_bytes_at_load")
+    assert at_load > 0, response
+    assert _opt_nat64(response, "compute_buffer_bytes") == at_load, response
+    assert _opt_nat64(response, "compute_buffer_reallocs") == 0, response
+
+def _set_allowed_tokens(network: str, token_ids: str) -> None:
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="set_allowed_tokens",
+        canister_argument=f"(record {{ token_ids = vec {{ {token_ids} }} }})",
+        network=network,
+    )
+    assert response == norm('(variant { Ok = record { status_code = 200 : nat16;} })')
+
+def test__run_update_restricted(network: str) -> None:
+    # The tiny stories vocab starts with <unk>, <s>, </s> and then the 256 byte
+    # tokens <0x00>..<0xFF>: id 68 is <0x41> = "A". With only that token (and
+    # end-of-generation) allowed, nothing else can be generated.
+    _set_allowed_tokens(network, "68 : nat64")
+    try:
+        cache_args = '"--prompt-cache"; "restricted.cache"'
+        response = call_canister_api(
+            icp_yaml_path=ICP_YAML_PATH,
+            canister_name=CANISTER_NAME,
+            canister_method="new_chat",
+            canister_argument=f"(record {{ args = vec {{{cache_args}}} }})",
+            network=network,
+        )
+        assert "(variant { Ok" in response
+
+        output = ""
+        for _ in range(5):  # max_tokens = 5: ingest, then generate
+            response = call_canister_api(
+                icp_yaml_path=ICP_YAML_PATH,
+                canister_name=CANISTER_NAME,
+                canister_method="run_update",
+                canister_argument=f'(record {{ args = vec {{{cache_args}; "--prompt-cache-all"; "--samplers"; "temperature"; "--temp"; "0.0"; "-n"; "3"; "-p"; "Joe loves writing stories"}} }})',
+                network=network,
+            )
+            if PRINT_RESPONSE:
+                print(f"{current_func_name()}: response: {response}")
+            assert "(variant { Ok" in response
+            output += re.search(r'output = "([^"]*)"', response).group(1)
+            if 'prompt_remaining = ""' in response and (
+                output or "generated_eog = true" in response
+            ):
+                break
+        assert set(output) <= {"A"}, output
+    finally:
+        _set_allowed_tokens(network, "")
+        call_canister_api(
+            icp_yaml_path=ICP_YAML_PATH,
+            canister_name=CANISTER_NAME,
+            canister_method="remove_prompt_cache",
+            canister_argument='(record { args = vec {"--prompt-cache"; "restricted.cache"} })',
+            network=network,
+        )
+
 def test__get_chats_ok(network: str) -> None:
     response = call_canister_api(
         icp_yaml_path=ICP_YAML_PATH,
@@ -493,6 +667,173 @@ def test__remove_prompt_cache(network: str) -> None:
     )
     assert "(variant { Ok" in response
 
+def _zero_lora_gguf(n_embd: int = 64, rank: int = 1) -> bytes:
+    """A LoRA adapter gguf for layer 0's attn_q of stories260K, with all-zero
+    weights, so it does not change the output."""
+
+    def gguf_str(s: str) -> bytes:
+        return struct.pack("<Q", len(s)) + s.encode()
+
+    kvs = [
+        ("general.architecture", "llama"),
+        ("general.type", "adapter"),
+        ("adapter.type", "lora"),
+    ]
+    tensors = [  # name, ggml ne, F32
+        ("blk.0.attn_q.weight.lora_a", (n_embd, rank)),
+        ("blk.0.attn_q.weight.lora_b", (rank, n_embd)),
+    ]
+    out = b"GGUF" + struct.pack("<IQQ", 3, len(tensors), len(kvs) + 1)
+    for key, value in kvs:
+        out += gguf_str(key) + struct.pack("<I", 8) + gguf_str(value)
+    out += gguf_str("adapter.lora.alpha") + struct.pack("<If", 6, float(rank))
+    offset = 0
+    for name, ne in tensors:
+        out += gguf_str(name) + struct.pack("<I", len(ne))
+        out += struct.pack(f"<{len(ne)}Q", *ne) + struct.pack("<IQ", 0, offset)
+        offset += 4 * ne[0] * ne[1]  # a multiple of the 32-byte alignment
+    out += b"\0" * (-len(out) % 32)
+    return out + b"\0" * offset
+
+
+def test__lora_round_trip(network: str) -> None:
+    adapter = _zero_lora_gguf()
+    blob = "".join(f"\\{b:02x}" for b in adapter)
+    response = call_canister_api(
+        icp_yaml_path=ICP_YAML_PATH,
+        canister_name=CANISTER_NAME,
+        canister_method="file_upload_chunk",
+        canister_argument=f'(record {{ filename = "models/tiny-lora.gguf"; chunk = blob "{blob}"; chunksize = {len(adapter)} : nat64; offset = 0 : nat64 }})',
+        network=network,
+    )
+    assert f"filesize = {len(adapter)}" in response, response
+
+    def call(method: str, argument: str) -> str:
+        response = call_canister_api(
+            icp_yaml_path=ICP_YAML_PATH,
+            canister_name=CANISTER_NAME,
+            canister_method=method,
+            canister_argument=argument,
+            network=network,
+        )
+        if PRINT_RESPONSE:
+            print(f"{method}: {response}")
+        return response
+
+    try:
+        response = call("load_lora", '(record { name = "zero"; path = "models/tiny-lora.gguf" })')
+        assert "status_code = 200" in response, response
+        response = call("select_lora", '(record { name = "zero"; scale = 0.5 : float32 })')
+        assert "status_code = 200" in response, response
+
+        response = call("get_loras", "()")
+        assert 'names = vec { "zero" }' in norm(response), response
+        assert 'selected = "zero"' in response, response
+        assert "scale = 0.5" in response, response
+
+        # A run attaches the selected adapter
+        response = call(
+            "run_update",
+            '(record { args = vec {"--prompt"; "Joe loves"; "--n-predict"; "4"; "--temp"; "0.0"} })',
+        )
+        assert "(variant { Ok" in response, response
+    finally:
+        call("select_lora", '(record { name = ""; scale = 1.0 : float32 })')
+
+    response = call("get_loras", "()")
+    assert 'selected = ""' in response, response
+
+
+def test__lora_selection_without_adapter(network: str) -> None:
+    # Reloading the model frees its adapters: a run with the selection then goes
+    # ahead without it, instead of failing
+    def call(method: str, argument: str) -> str:
+        response = call_canister_api(
+            icp_yaml_path=ICP_YAML_PATH,
+            canister_name=CANISTER_NAME,
+            canister_method=method,
+            canister_argument=argument,
+            network=network,
+        )
+        if PRINT_RESPONSE:
+            print(f"{method}: {response}")
+        return response
+
+    try:
+        response = call("load_lora", '(record { name = "zero"; path = "models/tiny-lora.gguf" })')
+        assert "status_code = 200" in response, response
+        response = call("select_lora", '(record { name = "zero"; scale = 0.5 : float32 })')
+        assert "status_code = 200" in response, response
+
+        response = call("load_model", '(record { args = vec {"--model"; "models/tiny.gguf";} })')
+        assert "status_code = 200" in response, response
+        response = call("get_loras", "()")
+        assert "names = vec {}" in norm(response), response
+        assert 'selected = "zero"' in response, response
+
+        response = call(
+            "run_update",
+            '(record { args = vec {"--prompt"; "Joe loves"; "--n-predict"; "4"; "--temp"; "0.0"} })',
+        )
+        assert "(variant { Ok" in response, response
+    finally:
+        call("select_lora", '(record { name = ""; scale = 1.0 : float32 })')
+
+def test__requantize_q8_0(network: str) -> None:
+    # Requantize the F32 model to q8_0 on-canister, then load & run the output
+    def call(method: str, argument: str) -> str:
+        response = call_canister_api(
+            icp_yaml_path=ICP_YAML_PATH,
+            canister_name=CANISTER_NAME,
+            canister_method=method,
+            canister_argument=argument,
+            network=network,
+        )
+        if PRINT_RESPONSE:
+            print(f"{method}: {response}")
+        return response
+
+    response = call(
+        "requantize_start",
+        '(record { input = "models/tiny.gguf"; output = "models/tiny-q8_0.gguf"; qtype = "q8_0"; slice_instructions = null })',
+    )
+    assert "(variant { Ok" in response, response
+
+    # A timer converts the rows, one slice per second
+    deadline = time.monotonic() + 120.0
+    while time.monotonic() < deadline:
+        response = call("requantize_status", "()")
+        if 'state = "running"' not in response:
+            break
+        time.sleep(1.0)
+    assert 'state = "done"' in response, response
+    bytes_written = re.search(r"bytes_written = ([\d_]+)", response).group(1)
+
+    # Registered like an upload
+    response = call("uploaded_file_details", '(record { filename = "models/tiny-q8_0.gguf" })')
+    assert f"filesize = {bytes_written}" in response, response
+
+    try:
+        response = call("load_model", '(record { args = vec {"--model"; "models/tiny-q8_0.gguf";} })')
+        assert "status_code = 200" in response, response
+        response = call("new_chat", '(record { args = vec {"--prompt-cache"; "prompt-q8_0.cache"} })')
+        assert "(variant { Ok" in response, response
+
+        # Like run_update_1..5: a few calls ingest the prompt, then it generates
+        for _ in range(10):
+            response = call(
+                "run_update",
+                '(record { args = vec {"--prompt-cache"; "prompt-q8_0.cache"; "--prompt-cache-all"; "--samplers"; "temperature"; "--temp"; "0.0"; "-n"; "3"; "-p"; "Joe loves writing stories"} })',
+            )
+            assert "(variant { Ok" in response, response
+            if 'prompt_remaining = ""' in response:
+                break
+        assert 'prompt_remaining = ""' in response, response
+        assert not re.search(r'output = "";', response), response
+    finally:
+        call("remove_prompt_cache", '(record { args = vec {"--prompt-cache"; "prompt-q8_0.cache"} })')
+        call("load_model", '(record { args = vec {"--model"; "models/tiny.gguf";} })')
+
 def test__remove_log_file(network: str) -> None:
     response = call_canister_api(
         icp_yaml_path=ICP_YAML_PATH,
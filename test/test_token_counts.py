@@ -19,6 +19,8 @@ Asserted properties:
   advances (cur.cached == prev.cached + prev.decoded) and
   first.cached + Σ decoded == n_prompt_tokens
 - warm re-send of a fully cached prefix: cached == n_prompt_tokens, decoded == 0
+- the per-phase instruction counts are on the same record, and a cold call
+  spends instructions on parsing, tokenizing, prefill and saving the cache
 
 Runs against the tiny stories model (models/tiny.gguf) deployed by
 scripts/qa_deploy_and_pytest.py; deterministic at --temp 0.0.
@@ -44,6 +46,16 @@ FIELDS = (
     "n_tokens_generated",
     "n_prompt_tokens_remaining",
 )
+# instructions per phase of the call, on the same record
+PHASES = (
+    "instructions_arg_parse",
+    "instructions_session_load",
+    "instructions_tokenization",
+    "instructions_prefill",
+    "instructions_generation",
+    "instructions_sampling",
+    "instructions_session_save",
+)
 _REMOVE_ARG = '(record { args = vec {"--prompt-cache"; "prompt.cache"} })'
 _NEW_CHAT_ARG = '(record { args = vec {"--prompt-cache"; "prompt.cache"} })'
 
@@ -172,3 +184,23 @@ def test__warm_resend_full_prefix(network: str) -> None:
     assert t["n_prompt_tokens_cached"] == t["n_prompt_tokens"], t
     assert t["n_prompt_tokens_decoded"] == 0, t
     assert t["n_prompt_tokens_remaining"] == 0, t
+
+
+def test__phase_instructions(network: str) -> None:
+    # The success record also says where the instructions went. A cold call
+    # that ingests and generates runs every phase.
+    _call(network, "remove_prompt_cache", _REMOVE_ARG)
+    assert "Ok" in _new_chat(network)
+    resp = _run(network, PROMPT, n="1")
+    phases = {name: _nat(resp, name) for name in PHASES}
+    assert phases["instructions_arg_parse"] > 0, phases
+    assert phases["instructions_tokenization"] > 0, phases
+    assert phases["instructions_prefill"] > 0, phases
+    assert phases["instructions_session_save"] > 0, phases
+    # stays well inside the update call limit
+    assert sum(phases.values()) < 40_000_000_000, phases
+
+    # not on new_chat
+    resp = _new_chat(network)
+    for name in PHASES:
+        assert f"{name} = null" in resp, f"{name} not null on new_chat: {resp}"